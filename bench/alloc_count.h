@@ -0,0 +1,53 @@
+#ifndef BENCH_ALLOC_COUNT_H
+#define BENCH_ALLOC_COUNT_H
+
+#include <stddef.h>
+
+/*
+ * every allocation of process goes through these, so library, json-c and
+ * curl are counted. glibc calls them for its own strdup too. include in
+ * one file of a bench only.
+ */
+extern void *__libc_malloc ( size_t size );
+extern void *__libc_calloc ( size_t n, size_t size );
+extern void *__libc_realloc ( void *p, size_t size );
+extern void __libc_free ( void *p );
+
+static long long int allocs;
+static long long int allocated;
+static long long int frees;
+static long long int reallocs;
+
+void *malloc ( size_t size ) {
+	allocs++;
+	allocated += size;
+	return __libc_malloc ( size );
+}
+
+void *calloc ( size_t n, size_t size ) {
+	allocs++;
+	allocated += n * size;
+	return __libc_calloc ( n, size );
+}
+
+/*
+ * every call is counted in allocs, but only realloc of NULL gives a new
+ * block. reallocs are calls which resize a live one, realloc to 0 frees it.
+ */
+void *realloc ( void *p, size_t size ) {
+	allocs++;
+	allocated += size;
+	if ( p ) reallocs++;
+
+	void *r = __libc_realloc ( p, size );
+	if ( p && size == 0 && !r ) frees++;
+
+	return r;
+}
+
+void free ( void *p ) {
+	if ( p ) frees++;
+	__libc_free ( p );
+}
+
+#endif
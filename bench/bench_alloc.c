@@ -0,0 +1,337 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <tebot.h>
+#include "alloc_count.h"
+
+#define UPDATE_TEXT \
+	"{\"update_id\":%d,\"message\":{\"message_id\":%d,\"date\":1700000000," \
+	"\"chat\":{\"id\":1000,\"first_name\":\"bench\",\"type\":\"private\"}," \
+	"\"from\":{\"id\":1000,\"is_bot\":false,\"first_name\":\"bench\",\"language_code\":\"en\"}," \
+	"\"text\":\"hello\"}}"
+
+#define ANSWER_MESSAGE \
+	"{\"ok\":true,\"result\":{\"message_id\":1,\"date\":1700000000," \
+	"\"chat\":{\"id\":1000,\"type\":\"private\"},\"text\":\"hello\"}}"
+
+#define ANSWER_ME \
+	"{\"ok\":true,\"result\":{\"id\":1,\"is_bot\":true,\"first_name\":\"bench\",\"username\":\"bench_bot\"," \
+	"\"can_join_groups\":true,\"can_read_all_group_messages\":false,\"supports_inline_queries\":false}}"
+
+static char webhook_body[1024];
+static char updates_body[16 * 1024];
+static int layout[] = { 2, 2 };
+
+struct call {
+	const char *name;
+	void ( *run ) ( tebot_handler_t *h, void *markup );
+	long long int allocs;
+	long long int bytes;
+	long long int live;
+	long long int budget_allocs;
+	long long int budget_bytes;
+};
+
+/*
+ * result of parse is freed inside the call, so live is what the call
+ * keeps after return.
+ */
+static void call_get_updates ( tebot_handler_t *h, void *markup ) {
+	if ( tebot_method_get_updates ( h, 0, 10, 0, NULL ) ) tebot_free_update ( h );
+}
+
+static void call_webhook ( tebot_handler_t *h, void *markup ) {
+	if ( tebot_get_data_from_webhook ( h, webhook_body ) ) tebot_free_update ( h );
+}
+
+static void call_webhook_len ( tebot_handler_t *h, void *markup ) {
+	if ( tebot_get_data_from_webhook_len ( h, webhook_body, strlen ( webhook_body ) ) ) tebot_free_update ( h );
+}
+
+static void call_get_me ( tebot_handler_t *h, void *markup ) {
+	tebot_user_t *u = tebot_method_get_me ( h );
+	if ( !u ) return;
+
+	tebot_free ( &h->allocator, u->first_name );
+	tebot_free ( &h->allocator, u->username );
+	tebot_free ( &h->allocator, u );
+}
+
+#define MARKUP(dt) \
+	do { \
+		( dt ).reply_markup = markup; \
+		( dt ).type_of_reply_markup = INLINE_KEYBOARD_MARKUP; \
+		( dt ).layout = layout; \
+		( dt ).size_layout = 2; \
+	} while ( 0 )
+
+static void call_send_message ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_message_t dt = { .chat_id = 1000, .text = "hello", .parse_mode = "HTML" };
+	MARKUP ( dt );
+	tebot_method_send_message ( h, &dt );
+}
+
+static void call_send_document ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_document_t dt = { .chat_id = 1000, .document = "bench.txt", .caption = "document" };
+	MARKUP ( dt );
+	tebot_method_send_document ( h, &dt );
+}
+
+static void call_send_audio ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_audio_t dt = { .chat_id = 1000, .audio = "bench.mp3", .title = "audio", .duration = 10 };
+	MARKUP ( dt );
+	tebot_method_send_audio ( h, &dt );
+}
+
+static void call_send_photo ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_photo_t dt = { .chat_id = 1000, .photo = "bench.jpg", .caption = "photo" };
+	MARKUP ( dt );
+	tebot_method_send_photo ( h, &dt );
+}
+
+static void call_send_video ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_video_t dt = { .chat_id = 1000, .video = "bench.mp4", .caption = "video", .width = 640, .height = 480 };
+	MARKUP ( dt );
+	tebot_method_send_video ( h, &dt );
+}
+
+static void call_send_animation ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_animation_t dt = { .chat_id = 1000, .animation = "bench.gif", .caption = "animation" };
+	MARKUP ( dt );
+	tebot_method_send_animation ( h, &dt );
+}
+
+static void call_send_voice ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_voice_t dt = { .chat_id = 1000, .voice = "bench.ogg", .duration = 5 };
+	MARKUP ( dt );
+	tebot_method_send_voice ( h, &dt );
+}
+
+static void call_send_video_note ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_video_note_t dt = { .chat_id = 1000, .video_note = "bench.mp4", .length = 240 };
+	MARKUP ( dt );
+	tebot_method_send_video_note ( h, &dt );
+}
+
+static void call_send_location ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_location_t dt = { .chat_id = 1000, .latitude = 55.75, .longitude = 37.61 };
+	MARKUP ( dt );
+	tebot_method_send_location ( h, &dt );
+}
+
+static void call_send_venue ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_venue_t dt = { .chat_id = 1000, .latitude = 55.75, .longitude = 37.61, .title = "venue", .address = "street 1" };
+	MARKUP ( dt );
+	tebot_method_send_venue ( h, &dt );
+}
+
+static void call_send_contact ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_contact_t dt = { .chat_id = 1000, .phone_number = "+10000000000", .first_name = "bench" };
+	MARKUP ( dt );
+	tebot_method_send_contact ( h, &dt );
+}
+
+static void call_send_poll ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_poll_t dt = { .chat_id = 1000, .question = "poll", .options = "[\"yes\",\"no\"]" };
+	MARKUP ( dt );
+	tebot_method_send_poll ( h, &dt );
+}
+
+static void call_send_dice ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_dice_t dt = { .chat_id = 1000, .emoji = "🎲" };
+	MARKUP ( dt );
+	tebot_method_send_dice ( h, &dt );
+}
+
+static void call_send_chat_action ( tebot_handler_t *h, void *markup ) {
+	struct tebot_send_chat_action_t dt = { .chat_id = 1000, .action = "typing" };
+	tebot_method_send_chat_action ( h, &dt );
+}
+
+static void call_forward_message ( tebot_handler_t *h, void *markup ) {
+	struct tebot_forward_message_t dt = { .chat_id = 1000, .from_chat_id = 1001, .message_id = 1 };
+	tebot_method_forward_message ( h, &dt );
+}
+
+static void call_copy_message ( tebot_handler_t *h, void *markup ) {
+	struct tebot_copy_message_t dt = { .chat_id = 1000, .from_chat_id = 1001, .message_id = 1, .caption = "copy" };
+	MARKUP ( dt );
+	tebot_method_copy_message ( h, &dt );
+}
+
+static struct call calls[] = {
+	{ "tebot_method_get_updates", call_get_updates },
+	{ "tebot_get_data_from_webhook", call_webhook },
+	{ "tebot_get_data_from_webhook_len", call_webhook_len },
+	{ "tebot_method_get_me", call_get_me },
+	{ "tebot_method_send_message", call_send_message },
+	{ "tebot_method_send_document", call_send_document },
+	{ "tebot_method_send_audio", call_send_audio },
+	{ "tebot_method_send_photo", call_send_photo },
+	{ "tebot_method_send_video", call_send_video },
+	{ "tebot_method_send_animation", call_send_animation },
+	{ "tebot_method_send_voice", call_send_voice },
+	{ "tebot_method_send_video_note", call_send_video_note },
+	{ "tebot_method_send_location", call_send_location },
+	{ "tebot_method_send_venue", call_send_venue },
+	{ "tebot_method_send_contact", call_send_contact },
+	{ "tebot_method_send_poll", call_send_poll },
+	{ "tebot_method_send_dice", call_send_dice },
+	{ "tebot_method_send_chat_action", call_send_chat_action },
+	{ "tebot_method_forward_message", call_forward_message },
+	{ "tebot_method_copy_message", call_copy_message }
+};
+
+static const int size_calls = sizeof ( calls ) / sizeof ( struct call );
+
+/*
+ * budget file has lines "name allocs bytes", -1 or missing line leaves the
+ * limit unchecked.
+ */
+static int read_budgets ( const char *path ) {
+	FILE *fp = fopen ( path, "r" );
+	if ( !fp ) {
+		perror ( path );
+		return -1;
+	}
+
+	char line[256];
+	char name[128];
+	long long int a, b;
+
+	while ( fgets ( line, sizeof ( line ), fp ) ) {
+		if ( line[0] == '#' ) continue;
+		if ( sscanf ( line, "%127s %lld %lld", name, &a, &b ) != 3 ) continue;
+
+		for ( int i = 0; i < size_calls; i++ ) {
+			if ( strcmp ( calls[i].name, name ) ) continue;
+			calls[i].budget_allocs = a;
+			calls[i].budget_bytes = b;
+		}
+	}
+
+	fclose ( fp );
+
+	return 0;
+}
+
+static int write_budgets ( const char *path ) {
+	FILE *fp = fopen ( path, "w" );
+	if ( !fp ) {
+		perror ( path );
+		return -1;
+	}
+
+	fprintf ( fp, "# name allocs bytes\n" );
+	for ( int i = 0; i < size_calls; i++ ) {
+		fprintf ( fp, "%s %lld %lld\n", calls[i].name, calls[i].allocs, calls[i].bytes );
+	}
+
+	fclose ( fp );
+
+	return 0;
+}
+
+/*
+ * first run fills buffers of handler that are reused after, the worst of
+ * the next runs is taken.
+ */
+static void measure ( tebot_handler_t *h, struct call *c, void *markup, const int runs ) {
+	c->run ( h, markup );
+
+	for ( int i = 0; i < runs; i++ ) {
+		const long long int a = allocs;
+		const long long int b = allocated;
+		const long long int f = frees;
+		const long long int r = reallocs;
+
+		c->run ( h, markup );
+
+		const long long int live = ( allocs - a ) - ( reallocs - r ) - ( frees - f );
+
+		if ( allocs - a > c->allocs ) c->allocs = allocs - a;
+		if ( allocated - b > c->bytes ) c->bytes = allocated - b;
+		if ( live > c->live ) c->live = live;
+	}
+}
+
+static void usage ( const char *name ) {
+	fprintf ( stderr, "usage: %s [-n runs] [-b budget_file] [-w budget_file]\n", name );
+	exit ( EXIT_FAILURE );
+}
+
+int main ( int argc, char **argv ) {
+	const char *budgets = NULL;
+	const char *out = NULL;
+	int runs = 16;
+	int opt;
+
+	while ( ( opt = getopt ( argc, argv, "n:b:w:" ) ) != -1 ) {
+		switch ( opt ) {
+			case 'n': runs = atoi ( optarg ); break;
+			case 'b': budgets = optarg; break;
+			case 'w': out = optarg; break;
+			default: usage ( argv[0] );
+		}
+	}
+
+	for ( int i = 0; i < size_calls; i++ ) {
+		calls[i].budget_allocs = -1;
+		calls[i].budget_bytes = -1;
+	}
+
+	if ( budgets && read_budgets ( budgets ) == -1 ) return EXIT_FAILURE;
+
+	snprintf ( webhook_body, sizeof ( webhook_body ), UPDATE_TEXT, 1, 1 );
+
+	int length = snprintf ( updates_body, sizeof ( updates_body ), "{\"ok\":true,\"result\":[" );
+	for ( int i = 0; i < 10; i++ ) {
+		length += snprintf ( &updates_body[length], sizeof ( updates_body ) - length, "%s" UPDATE_TEXT,
+				i ? "," : "", i + 1, i + 1 );
+	}
+	snprintf ( &updates_body[length], sizeof ( updates_body ) - length, "]}" );
+
+	tebot_handler_t *h = tebot_init ( "bench", TEBOT_DEBUG_NOT_SHOW, NULL );
+	tebot_loopback_t *l = tebot_loopback_init ( );
+	tebot_transport_t t;
+
+	tebot_loopback_add ( l, "getUpdates", 200, updates_body );
+	tebot_loopback_add ( l, "getMe", 200, ANSWER_ME );
+	tebot_loopback_add ( l, "*", 200, ANSWER_MESSAGE );
+	tebot_loopback_transport ( l, &t );
+	tebot_set_transport ( h, &t );
+
+	tebot_inline_keyboard_markup_t *markup = tebot_init_inline_keyboard_markup ( 4 );
+	for ( int i = 0; i < 4; i++ ) {
+		markup->inline_keyboard[i]->text = "button";
+		markup->inline_keyboard[i]->callback_data = "data";
+	}
+
+	int over = 0;
+
+	for ( int i = 0; i < size_calls; i++ ) {
+		struct call *c = &calls[i];
+
+		measure ( h, c, markup, runs );
+
+		const int is_over = ( c->budget_allocs >= 0 && c->allocs > c->budget_allocs ) ||
+			( c->budget_bytes >= 0 && c->bytes > c->budget_bytes );
+		over += is_over;
+
+		printf ( "bench_alloc call=%s allocs=%lld bytes=%lld live=%lld budget_allocs=%lld budget_bytes=%lld status=%s\n",
+				c->name, c->allocs, c->bytes, c->live, c->budget_allocs, c->budget_bytes,
+				is_over ? "over" : c->budget_allocs >= 0 || c->budget_bytes >= 0 ? "ok" : "none" );
+	}
+
+	if ( out && write_budgets ( out ) == -1 ) return EXIT_FAILURE;
+
+	for ( int i = 0; i < 4; i++ ) tebot_free ( NULL, markup->inline_keyboard[i] );
+	tebot_free ( NULL, markup->inline_keyboard );
+	tebot_free ( NULL, markup );
+	tebot_loopback_free ( l );
+
+	if ( over ) fprintf ( stderr, "%d calls over budget\n", over );
+
+	return over ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <tebot.h>
+
+static char body[256 * 1024];
+
+static double now ( void ) {
+	struct timespec ts;
+	clock_gettime ( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * getUpdates gives limit text messages starting from offset.
+ */
+static long get_updates ( tebot_handler_t *h, const tebot_request_t *req, void *data ) {
+	long long int offset = 0;
+	int limit = 100;
+
+	for ( int i = 0; i < req->size_params; i++ ) {
+		if ( !strcmp ( req->params[i].name, "offset" ) ) offset = atoll ( req->params[i].value );
+		if ( !strcmp ( req->params[i].name, "limit" ) ) limit = atoi ( req->params[i].value );
+	}
+
+	int length = snprintf ( body, sizeof ( body ), "{\"ok\":true,\"result\":[" );
+	for ( int i = 0; i < limit && length < sizeof ( body ) - 512; i++ ) {
+		length += snprintf ( &body[length], sizeof ( body ) - length,
+				"%s{\"update_id\":%lld,\"message\":{\"message_id\":%lld,\"date\":%ld,"
+				"\"chat\":{\"id\":1,\"type\":\"private\"},"
+				"\"from\":{\"id\":1,\"is_bot\":false,\"first_name\":\"bench\"},"
+				"\"text\":\"hello\"}}", i ? "," : "", offset + i, offset + i, time ( NULL ) );
+	}
+	length += snprintf ( &body[length], sizeof ( body ) - length, "]}" );
+
+	tebot_transport_body ( h, body, length );
+
+	return 200;
+}
+
+int main ( int argc, char **argv ) {
+	const int limit = argc > 1 ? atoi ( argv[1] ) : 100;
+	const int seconds = argc > 2 ? atoi ( argv[2] ) : 5;
+
+	tebot_handler_t *h = tebot_init ( "bench", TEBOT_DEBUG_NOT_SHOW, NULL );
+	tebot_loopback_t *l = tebot_loopback_init ( );
+	tebot_transport_t t;
+
+	tebot_loopback_add_script ( l, "getUpdates", get_updates, NULL );
+	tebot_loopback_add ( l, "sendMessage", 200, "{\"ok\":true,\"result\":{\"message_id\":1,\"date\":0,"
+			"\"chat\":{\"id\":1,\"type\":\"private\"},\"text\":\"hello\"}}" );
+	tebot_loopback_transport ( l, &t );
+	tebot_set_transport ( h, &t );
+
+	long long int offset = 0;
+	long long int updates = 0;
+	double start = now ( );
+	double elapsed = 0;
+
+	while ( ( elapsed = now ( ) - start ) < seconds ) {
+		tebot_result_updated_t *r = tebot_method_get_updates ( h, offset, limit, 0, NULL );
+		if ( !r ) break;
+
+		for ( int i = 0; i < r->size; i++ ) {
+			tebot_update_t *u = r->update[i];
+			struct tebot_send_message_t m;
+			memset ( &m, 0, sizeof ( m ) );
+			m.chat_id = u->message->chat->id;
+			m.text = u->message->text;
+			tebot_method_send_message ( h, &m );
+			offset = u->update_id + 1;
+		}
+
+		updates += r->size;
+		tebot_free_update ( h );
+	}
+
+	printf ( "limit: %d updates: %lld %.0f updates/s %.0f ns/update, getUpdates: %lld sendMessage: %lld\n",
+			limit, updates, updates / elapsed, elapsed * 1e9 / ( updates ? updates : 1 ),
+			tebot_loopback_calls ( l, "getUpdates" ), tebot_loopback_calls ( l, "sendMessage" ) );
+
+	tebot_loopback_free ( l );
+
+	return 0;
+}
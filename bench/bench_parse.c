@@ -0,0 +1,235 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <tebot.h>
+#include "alloc_count.h"
+
+#define CORPUS_SIZE                   64
+#define BATCH_SIZE                    100
+#define BODY_SIZE                     4096
+
+static double now ( void ) {
+	struct timespec ts;
+	clock_gettime ( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static long peak_rss_kb ( void ) {
+	struct rusage ru;
+	getrusage ( RUSAGE_SELF, &ru );
+	return ru.ru_maxrss;
+}
+
+#define USER_JSON \
+	"{\"id\":%d,\"is_bot\":false,\"first_name\":\"User%d\",\"last_name\":\"Test\",\"username\":\"user%d\",\"language_code\":\"en\"}"
+
+static int text_private ( char *buf, const int i ) {
+	return snprintf ( buf, BODY_SIZE, "{\"update_id\":%d,\"message\":{\"message_id\":%d,\"from\":" USER_JSON ","
+			"\"chat\":{\"id\":%d,\"first_name\":\"User%d\",\"username\":\"user%d\",\"type\":\"private\"},"
+			"\"date\":1700000000,\"text\":\"hello, this is message number %d from the corpus\"}}",
+			i, i, 1000 + i, i, i, 1000 + i, i, i, i );
+}
+
+static int media_caption ( char *buf, const int i ) {
+	return snprintf ( buf, BODY_SIZE, "{\"update_id\":%d,\"message\":{\"message_id\":%d,\"from\":" USER_JSON ","
+			"\"chat\":{\"id\":-100%d,\"title\":\"Group %d\",\"type\":\"supergroup\"},\"date\":1700000000,"
+			"\"photo\":["
+			"{\"file_id\":\"AgACAgIAAxkBAAI%dsmall\",\"file_unique_id\":\"AQAD%ds\",\"file_size\":1432,\"width\":90,\"height\":67},"
+			"{\"file_id\":\"AgACAgIAAxkBAAI%dmedium\",\"file_unique_id\":\"AQAD%dm\",\"file_size\":21430,\"width\":320,\"height\":240},"
+			"{\"file_id\":\"AgACAgIAAxkBAAI%dlarge\",\"file_unique_id\":\"AQAD%dl\",\"file_size\":91210,\"width\":1280,\"height\":960}],"
+			"\"caption\":\"Photo %d with a bold word and a link https://example.com/%d\","
+			"\"caption_entities\":[{\"offset\":13,\"length\":4,\"type\":\"bold\"},"
+			"{\"offset\":35,\"length\":22,\"type\":\"url\"}]}}",
+			i, i, 1000 + i, i, i, i, i, i, i, i, i, i, i, i, i );
+}
+
+static int callback_query ( char *buf, const int i ) {
+	return snprintf ( buf, BODY_SIZE, "{\"update_id\":%d,\"callback_query\":{\"id\":\"43958723%d\",\"from\":" USER_JSON ","
+			"\"message\":{\"message_id\":%d,\"from\":{\"id\":1,\"is_bot\":true,\"first_name\":\"Bot\",\"username\":\"test_bot\"},"
+			"\"chat\":{\"id\":%d,\"first_name\":\"User%d\",\"type\":\"private\"},\"date\":1700000000,"
+			"\"text\":\"choose an option\"},\"chat_instance\":\"-83475%d\",\"data\":\"option_%d\"}}",
+			i, i, 1000 + i, i, i, i, 1000 + i, i, i, i % 9 );
+}
+
+static int chat_member ( char *buf, const int i ) {
+	return snprintf ( buf, BODY_SIZE, "{\"update_id\":%d,\"chat_member\":{"
+			"\"chat\":{\"id\":-100%d,\"title\":\"Group %d\",\"type\":\"supergroup\"},\"from\":" USER_JSON ","
+			"\"date\":1700000000,"
+			"\"old_chat_member\":{\"user\":" USER_JSON ",\"status\":\"left\"},"
+			"\"new_chat_member\":{\"user\":" USER_JSON ",\"status\":\"member\"}}}",
+			i, i, i, 1000 + i, i, i, 2000 + i, i, i, 2000 + i, i, i );
+}
+
+static int ( *generators[] ) ( char *buf, const int i ) = { text_private, media_caption, callback_query, chat_member };
+static const char *names[] = { "text_private", "media_caption", "callback_query", "chat_member" };
+
+struct result {
+	long long int updates;
+	double elapsed;
+	long long int allocs;
+	long long int allocated;
+};
+
+static void report ( const char *name, const char *suffix, struct result *r ) {
+	printf ( "bench_parse case=%s%s updates=%lld ns_per_update=%.1f allocs_per_update=%.2f bytes_per_update=%.1f peak_rss_kb=%ld\n",
+			name, suffix, r->updates, r->elapsed * 1e9 / r->updates, ( double ) r->allocs / r->updates,
+			( double ) r->allocated / r->updates, peak_rss_kb ( ) );
+}
+
+static void measure_start ( struct result *r ) {
+	r->allocs = allocs;
+	r->allocated = allocated;
+	r->elapsed = now ( );
+}
+
+static void measure_end ( struct result *r ) {
+	r->elapsed = now ( ) - r->elapsed;
+	r->allocs = allocs - r->allocs;
+	r->allocated = allocated - r->allocated;
+}
+
+static void bench_webhook ( tebot_handler_t *h, const int type, const int iterations, const char *suffix ) {
+	static char corpus[CORPUS_SIZE][BODY_SIZE];
+	static int lengths[CORPUS_SIZE];
+	struct result r = { 0 };
+
+	for ( int i = 0; i < CORPUS_SIZE; i++ ) lengths[i] = generators[type] ( corpus[i], i + 1 );
+
+	for ( int i = 0; i < CORPUS_SIZE; i++ ) {
+		if ( tebot_get_data_from_webhook_len ( h, corpus[i], lengths[i] ) ) tebot_free_update ( h );
+	}
+
+	measure_start ( &r );
+	for ( int i = 0; i < iterations; i++ ) {
+		tebot_result_updated_t *t = tebot_get_data_from_webhook_len ( h, corpus[i % CORPUS_SIZE], lengths[i % CORPUS_SIZE] );
+		if ( !t ) {
+			fprintf ( stderr, "failed to parse %s\n", names[type] );
+			exit ( EXIT_FAILURE );
+		}
+		r.updates += t->size;
+		tebot_free_update ( h );
+	}
+	measure_end ( &r );
+
+	report ( names[type], suffix, &r );
+}
+
+/*
+ * batch goes through getUpdates of loopback transport, so it is parsed by
+ * the same code as polling.
+ */
+static void bench_batch ( tebot_handler_t *h, tebot_loopback_t *l, const int iterations, const char *suffix ) {
+	static char batch[BATCH_SIZE * BODY_SIZE];
+	char body[BODY_SIZE];
+	struct result r = { 0 };
+
+	int length = snprintf ( batch, sizeof ( batch ), "{\"ok\":true,\"result\":[" );
+	for ( int i = 0; i < BATCH_SIZE; i++ ) {
+		generators[i % 4] ( body, i + 1 );
+		length += snprintf ( &batch[length], sizeof ( batch ) - length, "%s%s", i ? "," : "", body );
+	}
+	snprintf ( &batch[length], sizeof ( batch ) - length, "]}" );
+
+	tebot_loopback_add ( l, "getUpdates", 200, batch );
+
+	tebot_method_get_updates ( h, 0, BATCH_SIZE, 0, NULL );
+	tebot_free_update ( h );
+
+	measure_start ( &r );
+	for ( int i = 0; i < iterations / BATCH_SIZE + 1; i++ ) {
+		tebot_result_updated_t *t = tebot_method_get_updates ( h, 0, BATCH_SIZE, 0, NULL );
+		if ( !t ) break;
+		r.updates += t->size;
+		tebot_free_update ( h );
+	}
+	measure_end ( &r );
+
+	report ( "batch_100", suffix, &r );
+}
+
+static void bench_send_message ( tebot_handler_t *h, tebot_loopback_t *l, const int iterations, const int is_keyboard ) {
+	struct result r = { 0 };
+	int layout[] = { 3, 3, 3 };
+	char texts[9][16];
+	char datas[9][16];
+
+	tebot_loopback_add ( l, "sendMessage", 200, "{\"ok\":true,\"result\":{\"message_id\":1,\"date\":1700000000,"
+			"\"chat\":{\"id\":1,\"type\":\"private\"},\"text\":\"hello\"}}" );
+
+	struct tebot_send_message_t m;
+	memset ( &m, 0, sizeof ( m ) );
+	m.chat_id = 1000;
+	m.text = "choose an option from the keyboard below";
+	m.parse_mode = "HTML";
+
+	tebot_inline_keyboard_markup_t *markup = NULL;
+	if ( is_keyboard ) {
+		markup = tebot_init_inline_keyboard_markup ( 9 );
+		for ( int i = 0; i < 9; i++ ) {
+			snprintf ( texts[i], sizeof ( texts[i] ), "button %d", i );
+			snprintf ( datas[i], sizeof ( datas[i] ), "option_%d", i );
+			markup->inline_keyboard[i]->text = texts[i];
+			markup->inline_keyboard[i]->callback_data = datas[i];
+		}
+		m.reply_markup = markup;
+		m.type_of_reply_markup = INLINE_KEYBOARD_MARKUP;
+		m.layout = layout;
+		m.size_layout = 3;
+	}
+
+	tebot_method_send_message ( h, &m );
+
+	measure_start ( &r );
+	for ( int i = 0; i < iterations; i++ ) {
+		tebot_method_send_message ( h, &m );
+		r.updates++;
+	}
+	measure_end ( &r );
+
+	report ( is_keyboard ? "send_message_keyboard" : "send_message_text", "", &r );
+
+	if ( markup ) {
+		for ( int i = 0; markup->inline_keyboard[i]; i++ ) tebot_free ( NULL, markup->inline_keyboard[i] );
+		tebot_free ( NULL, markup->inline_keyboard );
+		tebot_free ( NULL, markup );
+	}
+}
+
+int main ( int argc, char **argv ) {
+	const int iterations = argc > 1 ? atoi ( argv[1] ) : 100000;
+
+	tebot_handler_t *h = tebot_init ( "bench", TEBOT_DEBUG_NOT_SHOW, NULL );
+	tebot_loopback_t *l = tebot_loopback_init ( );
+	tebot_transport_t t;
+
+	tebot_loopback_transport ( l, &t );
+	tebot_set_transport ( h, &t );
+
+	for ( int type = 0; type < 4; type++ ) bench_webhook ( h, type, iterations, "" );
+	bench_batch ( h, l, iterations, "" );
+
+	/*
+	 * lazy cases do not touch nested objects, as a bot reading only text,
+	 * chat and from.
+	 */
+	tebot_set_lazy ( h, 1 );
+	for ( int type = 0; type < 4; type++ ) bench_webhook ( h, type, iterations, "_lazy" );
+	bench_batch ( h, l, iterations, "_lazy" );
+	tebot_set_lazy ( h, 0 );
+
+	/*
+	 * fields of minimal echo bot.
+	 */
+	tebot_set_fields ( h, "message.text, message.chat.id, message.from.id, callback_query.data" );
+	for ( int type = 0; type < 4; type++ ) bench_webhook ( h, type, iterations, "_fields" );
+	bench_batch ( h, l, iterations, "_fields" );
+	tebot_set_fields ( h, NULL );
+	bench_send_message ( h, l, iterations / 10, 0 );
+	bench_send_message ( h, l, iterations / 10, 1 );
+
+	tebot_loopback_free ( l );
+
+	return 0;
+}
@@ -0,0 +1,57 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <tebot.h>
+
+#define SIZE_TEXT                 ( 64 * 1024 * 1024 )
+#define SIZE_PATTERNS             5000
+
+static double now ( void ) {
+	struct timespec ts;
+	clock_gettime ( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void random_word ( char *s, const int length ) {
+	for ( int i = 0; i < length; i++ ) s[i] = 'a' + rand ( ) % 26;
+	s[length] = 0;
+}
+
+static void run ( const char *name, const char **patterns, const int size, const int flags, const char *text ) {
+	tebot_scanner_t *s = tebot_scanner_init ( patterns, size, flags );
+	if ( !s ) {
+		fprintf ( stderr, "failed to compile patterns.\n" );
+		exit ( EXIT_FAILURE );
+	}
+
+	double start = now ( );
+	long long int count = tebot_scanner_scan ( s, text, SIZE_TEXT, NULL, NULL );
+	double elapsed = now ( ) - start;
+
+	printf ( "%-20s patterns: %d matches: %lld %.1f MB/s\n", name, size, count, SIZE_TEXT / elapsed / ( 1024 * 1024 ) );
+
+	tebot_scanner_free ( s );
+}
+
+int main ( int argc, char **argv ) {
+	srand ( 1 );
+
+	char *text = malloc ( SIZE_TEXT + 1 );
+	for ( int i = 0; i < SIZE_TEXT; i++ ) {
+		text[i] = rand ( ) % 6 == 0 ? ' ' : 'a' + rand ( ) % 26;
+	}
+	text[SIZE_TEXT] = 0;
+
+	const char **patterns = calloc ( SIZE_PATTERNS, sizeof ( char * ) );
+	for ( int i = 0; i < SIZE_PATTERNS; i++ ) {
+		char *p = malloc ( 16 );
+		random_word ( p, 4 + rand ( ) % 8 );
+		patterns[i] = p;
+	}
+
+	run ( "case sensitive", patterns, SIZE_PATTERNS, 0, text );
+	run ( "case insensitive", patterns, SIZE_PATTERNS, TEBOT_SCANNER_CASE_INSENSITIVE, text );
+
+	return 0;
+}
@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <tebot.h>
+#include <creqhttp.h>
+
+#define BENCH_PORT                18443
+
+static atomic_llong handled;
+static atomic_llong sent;
+static atomic_llong update_id;
+static atomic_int is_stop;
+static int is_keep_alive;
+
+static double now ( void ) {
+	struct timespec ts;
+	clock_gettime ( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_handle ( creqhttp_epoll_event *v ) {
+	http_req *htr = creqhttp_parse_request ( v->data.data, v->data.len );
+
+	if ( htr ) {
+		tebot_handler_t *h = tebot_webhook_handler ( );
+		tebot_result_updated_t *t = tebot_get_data_from_webhook ( h, htr->post_data );
+		if ( t ) {
+			atomic_fetch_add ( &handled, 1 );
+			tebot_free_update ( h );
+		}
+	}
+
+	v->is_disconnect = 1;
+
+	char *ans = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+	memcpy ( v->data.ans_data, ans, strlen ( ans ) + 1 );
+	v->data.ans_len = strlen ( ans );
+	v->data.is_answer = 1;
+}
+
+static void bench_update ( tebot_handler_t *h, tebot_result_updated_t *t, creqhttp_epoll_event *v ) {
+	atomic_fetch_add ( &handled, 1 );
+}
+
+/*
+ * reads answer with empty body, connection stays open for next request.
+ */
+static int read_answer ( int fd, char *ans, const size_t size ) {
+	size_t length = 0;
+
+	while ( length < size - 1 ) {
+		ssize_t ret = read ( fd, &ans[length], size - 1 - length );
+		if ( ret <= 0 ) return -1;
+		length += ret;
+		ans[length] = 0;
+		if ( strstr ( ans, "\r\n\r\n" ) ) return 0;
+	}
+
+	return -1;
+}
+
+static void *client ( void *_data ) {
+	struct sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons ( BENCH_PORT );
+	addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+
+	char body[512];
+	char req[1024];
+	char ans[512];
+	int fd = -1;
+
+	while ( !atomic_load ( &is_stop ) ) {
+		const long long int id = atomic_fetch_add ( &update_id, 1 );
+		const int size_body = snprintf ( body, sizeof ( body ),
+				"{\"update_id\":%lld,\"message\":{\"message_id\":%lld,\"date\":%ld,"
+				"\"chat\":{\"id\":1,\"type\":\"private\"},"
+				"\"from\":{\"id\":1,\"is_bot\":false,\"first_name\":\"bench\"},"
+				"\"text\":\"hello\"}}", id, id, time ( NULL ) );
+		const int size_req = snprintf ( req, sizeof ( req ),
+				"POST /hook HTTP/1.1\r\nHost: localhost\r\nContent-Type: application/json\r\n"
+				"Content-Length: %d\r\n\r\n%s", size_body, body );
+
+		if ( fd == -1 ) {
+			fd = socket ( AF_INET, SOCK_STREAM, 0 );
+			if ( fd == -1 ) continue;
+
+			if ( connect ( fd, ( struct sockaddr * ) &addr, sizeof ( addr ) ) == -1 ) {
+				close ( fd );
+				fd = -1;
+				continue;
+			}
+		}
+
+		if ( write ( fd, req, size_req ) != size_req ) {
+			close ( fd );
+			fd = -1;
+			continue;
+		}
+
+		if ( is_keep_alive ) {
+			if ( read_answer ( fd, ans, sizeof ( ans ) ) == 0 ) {
+				atomic_fetch_add ( &sent, 1 );
+				continue;
+			}
+		} else {
+			while ( read ( fd, ans, sizeof ( ans ) ) > 0 );
+			atomic_fetch_add ( &sent, 1 );
+		}
+
+		close ( fd );
+		fd = -1;
+	}
+
+	if ( fd != -1 ) close ( fd );
+
+	return NULL;
+}
+
+int main ( int argc, char **argv ) {
+	const int listeners = argc > 1 ? atoi ( argv[1] ) : 1;
+	const int clients = argc > 2 ? atoi ( argv[2] ) : 4;
+	const int seconds = argc > 3 ? atoi ( argv[3] ) : 5;
+	is_keep_alive = argc > 4 ? atoi ( argv[4] ) : 0;
+
+	tebot_handler_t *h = tebot_init ( "bench", TEBOT_DEBUG_NOT_SHOW, NULL );
+
+	struct tebot_setup_webhook sw = {
+		.port = BENCH_PORT,
+		.is_ssl = 0,
+		.msg_handle = is_keep_alive ? NULL : bench_handle,
+		.update_handle = is_keep_alive ? bench_update : NULL,
+		.listeners = listeners,
+		.pin_cpu = 1
+	};
+
+	tebot_set_webhook ( h, &sw );
+
+	pthread_t *threads = calloc ( clients, sizeof ( pthread_t ) );
+	for ( int i = 0; i < clients; i++ ) pthread_create ( &threads[i], NULL, client, NULL );
+
+	double start = now ( );
+	sleep ( seconds );
+	atomic_store ( &is_stop, 1 );
+	for ( int i = 0; i < clients; i++ ) pthread_join ( threads[i], NULL );
+	double elapsed = now ( ) - start;
+
+	printf ( "listeners: %d clients: %d keep-alive: %d requests: %lld updates: %lld %.0f req/s\n",
+			listeners, clients, is_keep_alive, atomic_load ( &sent ), atomic_load ( &handled ), atomic_load ( &sent ) / elapsed );
+
+	return 0;
+}
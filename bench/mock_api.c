@@ -0,0 +1,440 @@
+/*
+ * mock of bot api for benchmarks: answers the methods of library over
+ * plain http, one thread for every connection, connections are kept
+ * alive.
+ *
+ *   -p port             port to listen, 18081 by default
+ *   -b batch            max updates in one getUpdates, 100 by default
+ *   -w ms               long poll delay before getUpdates answers
+ *   -l distribution     latency of every answer in microseconds:
+ *                       fixed:US, uniform:MIN:MAX, exp:MEAN, pareto:MIN:ALPHA
+ *   -r rate             part of requests answered with 429
+ *   -a seconds          retry_after in 429 answers, 1 by default
+ *   -x rate             part of requests where connection is dropped
+ *   -f size             size of downloaded file in bytes, 1 MB by default
+ *
+ * library is pointed to it by tebot_set_api_url ( h, "http://127.0.0.1:18081", NULL ).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <math.h>
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#define MOCK_HEAD_SIZE                (16 * 1024)
+#define MOCK_ANSWER_SIZE              (256 * 1024)
+#define MOCK_FILE_CHUNK               (64 * 1024)
+
+enum latency_type {
+	LATENCY_NONE,
+	LATENCY_FIXED,
+	LATENCY_UNIFORM,
+	LATENCY_EXP,
+	LATENCY_PARETO
+};
+
+static struct {
+	int port;
+	int batch;
+	int poll_delay_ms;
+	enum latency_type latency;
+	double latency_a;
+	double latency_b;
+	double rate_429;
+	int retry_after;
+	double rate_drop;
+	long long int file_size;
+} cfg = { 18081, 100, 0, LATENCY_NONE, 0, 0, 0, 1, 0, 1024 * 1024 };
+
+static atomic_llong requests;
+static atomic_llong answered_429;
+static atomic_llong dropped;
+static atomic_llong updates;
+static atomic_llong message_id;
+static atomic_llong connections;
+static volatile sig_atomic_t is_stop;
+
+static __thread unsigned long long int rnd_state;
+
+/*
+ * seeds of connections differ in few bits, splitmix spreads them.
+ */
+static void rnd_seed ( unsigned long long int seed ) {
+	seed += 0x9e3779b97f4a7c15ULL;
+	seed = ( seed ^ ( seed >> 30 ) ) * 0xbf58476d1ce4e5b9ULL;
+	seed = ( seed ^ ( seed >> 27 ) ) * 0x94d049bb133111ebULL;
+	rnd_state = ( seed ^ ( seed >> 31 ) ) | 1;
+}
+
+static double rnd ( void ) {
+	rnd_state ^= rnd_state << 13;
+	rnd_state ^= rnd_state >> 7;
+	rnd_state ^= rnd_state << 17;
+
+	return ( rnd_state >> 11 ) * ( 1.0 / 9007199254740992.0 );
+}
+
+static void latency_sleep ( void ) {
+	double usec = 0;
+	const double u = rnd ( );
+
+	switch ( cfg.latency ) {
+		case LATENCY_NONE: return;
+		case LATENCY_FIXED: usec = cfg.latency_a; break;
+		case LATENCY_UNIFORM: usec = cfg.latency_a + u * ( cfg.latency_b - cfg.latency_a ); break;
+		case LATENCY_EXP: usec = -cfg.latency_a * log ( 1.0 - u ); break;
+		case LATENCY_PARETO: usec = cfg.latency_a / pow ( 1.0 - u, 1.0 / cfg.latency_b ); break;
+	}
+
+	struct timespec ts = { ( time_t ) ( usec / 1e6 ), ( long ) fmod ( usec * 1000.0, 1e9 ) };
+	nanosleep ( &ts, NULL );
+}
+
+static int parse_latency ( const char *s ) {
+	if ( !strncmp ( s, "fixed:", 6 ) ) {
+		cfg.latency = LATENCY_FIXED;
+		return sscanf ( s + 6, "%lf", &cfg.latency_a ) == 1 ? 0 : -1;
+	}
+	if ( !strncmp ( s, "uniform:", 8 ) ) {
+		cfg.latency = LATENCY_UNIFORM;
+		return sscanf ( s + 8, "%lf:%lf", &cfg.latency_a, &cfg.latency_b ) == 2 ? 0 : -1;
+	}
+	if ( !strncmp ( s, "exp:", 4 ) ) {
+		cfg.latency = LATENCY_EXP;
+		return sscanf ( s + 4, "%lf", &cfg.latency_a ) == 1 ? 0 : -1;
+	}
+	if ( !strncmp ( s, "pareto:", 7 ) ) {
+		cfg.latency = LATENCY_PARETO;
+		return sscanf ( s + 7, "%lf:%lf", &cfg.latency_a, &cfg.latency_b ) == 2 && cfg.latency_b > 0 ? 0 : -1;
+	}
+
+	return -1;
+}
+
+static int write_all ( int fd, const char *buf, size_t size ) {
+	while ( size > 0 ) {
+		ssize_t ret = write ( fd, buf, size );
+		if ( ret <= 0 ) return -1;
+		buf += ret;
+		size -= ret;
+	}
+
+	return 0;
+}
+
+static int answer ( int fd, const int status, const char *reason, const char *body, const size_t size_body ) {
+	char head[256];
+	const int size_head = snprintf ( head, sizeof ( head ), "HTTP/1.1 %d %s\r\n"
+			"Content-Type: application/json\r\n"
+			"Content-Length: %zu\r\n\r\n", status, reason, size_body );
+
+	if ( write_all ( fd, head, size_head ) == -1 ) return -1;
+
+	return write_all ( fd, body, size_body );
+}
+
+static const char *find_header ( const char *head, const char *name ) {
+	const size_t size_name = strlen ( name );
+
+	for ( const char *p = strstr ( head, "\r\n" ); p; p = strstr ( p, "\r\n" ) ) {
+		p += 2;
+		if ( !strncasecmp ( p, name, size_name ) ) {
+			p += size_name;
+			while ( *p == ' ' ) p++;
+			return p;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+ * params come in query or in multipart body made by curl mime.
+ */
+static long long int param_int ( const char *query, const char *body, const char *name, const long long int def ) {
+	char key[64];
+
+	if ( query ) {
+		snprintf ( key, sizeof ( key ), "%s=", name );
+		const char *p = strstr ( query, key );
+		if ( p ) return atoll ( p + strlen ( key ) );
+	}
+
+	if ( body ) {
+		snprintf ( key, sizeof ( key ), "name=\"%s\"", name );
+		const char *p = strstr ( body, key );
+		if ( p && ( p = strstr ( p, "\r\n\r\n" ) ) ) return atoll ( p + 4 );
+	}
+
+	return def;
+}
+
+static int answer_updates ( int fd, char *buf, const char *query, const char *body ) {
+	long long int offset = param_int ( query, body, "offset", 0 );
+	long long int limit = param_int ( query, body, "limit", 100 );
+
+	if ( offset <= 0 ) offset = 1;
+	if ( limit <= 0 || limit > cfg.batch ) limit = cfg.batch;
+
+	if ( cfg.poll_delay_ms > 0 ) {
+		struct timespec ts = { cfg.poll_delay_ms / 1000, ( cfg.poll_delay_ms % 1000 ) * 1000000L };
+		nanosleep ( &ts, NULL );
+	}
+
+	int length = snprintf ( buf, MOCK_ANSWER_SIZE, "{\"ok\":true,\"result\":[" );
+	for ( long long int i = 0; i < limit && length < MOCK_ANSWER_SIZE - 512; i++ ) {
+		length += snprintf ( &buf[length], MOCK_ANSWER_SIZE - length,
+				"%s{\"update_id\":%lld,\"message\":{\"message_id\":%lld,\"date\":%ld,"
+				"\"chat\":{\"id\":1,\"type\":\"private\"},"
+				"\"from\":{\"id\":1,\"is_bot\":false,\"first_name\":\"mock\",\"username\":\"mock\"},"
+				"\"text\":\"hello from mock\"}}", i ? "," : "", offset + i, offset + i, time ( NULL ) );
+		atomic_fetch_add ( &updates, 1 );
+	}
+	length += snprintf ( &buf[length], MOCK_ANSWER_SIZE - length, "]}" );
+
+	return answer ( fd, 200, "OK", buf, length );
+}
+
+static int answer_file ( int fd, char *buf ) {
+	char head[256];
+	const int size_head = snprintf ( head, sizeof ( head ), "HTTP/1.1 200 OK\r\n"
+			"Content-Type: application/octet-stream\r\n"
+			"Content-Length: %lld\r\n\r\n", cfg.file_size );
+
+	if ( write_all ( fd, head, size_head ) == -1 ) return -1;
+
+	for ( int i = 0; i < MOCK_FILE_CHUNK; i++ ) buf[i] = 'a' + i % 26;
+
+	for ( long long int sent = 0; sent < cfg.file_size; sent += MOCK_FILE_CHUNK ) {
+		const long long int size = cfg.file_size - sent < MOCK_FILE_CHUNK ? cfg.file_size - sent : MOCK_FILE_CHUNK;
+		if ( write_all ( fd, buf, size ) == -1 ) return -1;
+	}
+
+	return 0;
+}
+
+static int answer_method ( int fd, char *buf, const char *method, const char *query, const char *body ) {
+	int length = 0;
+
+	if ( !strcmp ( method, "getUpdates" ) ) return answer_updates ( fd, buf, query, body );
+
+	if ( !strcmp ( method, "getMe" ) ) {
+		length = snprintf ( buf, MOCK_ANSWER_SIZE, "{\"ok\":true,\"result\":{\"id\":1,\"is_bot\":true,"
+				"\"first_name\":\"mock\",\"username\":\"mock_bot\"}}" );
+	} else if ( !strcmp ( method, "getFile" ) ) {
+		length = snprintf ( buf, MOCK_ANSWER_SIZE, "{\"ok\":true,\"result\":{\"file_id\":\"mock\","
+				"\"file_unique_id\":\"mock\",\"file_size\":%lld,\"file_path\":\"documents/mock.bin\"}}", cfg.file_size );
+	} else if ( !strncmp ( method, "send", 4 ) || !strcmp ( method, "forwardMessage" ) ) {
+		length = snprintf ( buf, MOCK_ANSWER_SIZE, "{\"ok\":true,\"result\":{\"message_id\":%lld,\"date\":%ld,"
+				"\"chat\":{\"id\":1,\"type\":\"private\"},\"text\":\"mock\"}}",
+				atomic_fetch_add ( &message_id, 1 ) + 1, time ( NULL ) );
+	} else if ( !strcmp ( method, "copyMessage" ) ) {
+		length = snprintf ( buf, MOCK_ANSWER_SIZE, "{\"ok\":true,\"result\":{\"message_id\":%lld}}",
+				atomic_fetch_add ( &message_id, 1 ) + 1 );
+	} else {
+		length = snprintf ( buf, MOCK_ANSWER_SIZE, "{\"ok\":true,\"result\":true}" );
+	}
+
+	return answer ( fd, 200, "OK", buf, length );
+}
+
+/*
+ * reads one request, body is put after head in the same buffer.
+ */
+static int read_request ( int fd, char *head, char **body, size_t *size_body ) {
+	size_t length = 0;
+	char *end = NULL;
+
+	while ( !( end = strstr ( head, "\r\n\r\n" ) ) ) {
+		if ( length >= MOCK_HEAD_SIZE - 1 ) return -1;
+		ssize_t ret = read ( fd, &head[length], MOCK_HEAD_SIZE - 1 - length );
+		if ( ret <= 0 ) return -1;
+		length += ret;
+		head[length] = 0;
+	}
+
+	*end = 0;
+	const size_t size_head = end - head + 4;
+
+	const char *value = find_header ( head, "Content-Length:" );
+	const size_t size = value ? strtoull ( value, NULL, 10 ) : 0;
+
+	value = find_header ( head, "Expect:" );
+	if ( value && !strncasecmp ( value, "100-continue", 12 ) ) {
+		const char *cont = "HTTP/1.1 100 Continue\r\n\r\n";
+		if ( write_all ( fd, cont, strlen ( cont ) ) == -1 ) return -1;
+	}
+
+	*body = malloc ( size + 1 );
+	if ( !*body ) return -1;
+
+	size_t have = length - size_head < size ? length - size_head : size;
+	memcpy ( *body, &head[size_head], have );
+
+	while ( have < size ) {
+		ssize_t ret = read ( fd, &( *body )[have], size - have );
+		if ( ret <= 0 ) {
+			free ( *body );
+			return -1;
+		}
+		have += ret;
+	}
+
+	( *body )[size] = 0;
+	*size_body = size;
+
+	return 0;
+}
+
+static void *connection ( void *_data ) {
+	const int fd = ( int ) ( long ) _data;
+	char *head = malloc ( MOCK_HEAD_SIZE );
+	char *buf = malloc ( MOCK_ANSWER_SIZE );
+
+	rnd_seed ( ( unsigned long long int ) time ( NULL ) ^ ( ( unsigned long long int ) atomic_fetch_add ( &connections, 1 ) << 32 ) );
+
+	while ( head && buf && !is_stop ) {
+		char *body = NULL;
+		size_t size_body = 0;
+
+		head[0] = 0;
+		if ( read_request ( fd, head, &body, &size_body ) == -1 ) break;
+
+		atomic_fetch_add ( &requests, 1 );
+
+		/*
+		 * request line: METHOD /bot<token>/<method>?query HTTP/1.1 or
+		 * GET /file/bot<token>/<path> HTTP/1.1
+		 */
+		char *path = strchr ( head, ' ' );
+		char *path_end = path ? strchr ( path + 1, ' ' ) : NULL;
+		if ( !path || !path_end ) {
+			free ( body );
+			break;
+		}
+		*path_end = 0;
+		path++;
+
+		char *query = strchr ( path, '?' );
+		if ( query ) *query++ = 0;
+
+		const int is_file = !strncmp ( path, "/file/", 6 );
+		const char *method = strrchr ( path, '/' );
+		method = method ? method + 1 : path;
+
+		latency_sleep ( );
+
+		int ret = 0;
+		if ( cfg.rate_drop > 0 && rnd ( ) < cfg.rate_drop ) {
+			atomic_fetch_add ( &dropped, 1 );
+			ret = -1;
+		} else if ( cfg.rate_429 > 0 && rnd ( ) < cfg.rate_429 ) {
+			atomic_fetch_add ( &answered_429, 1 );
+			const int length = snprintf ( buf, MOCK_ANSWER_SIZE, "{\"ok\":false,\"error_code\":429,"
+					"\"description\":\"Too Many Requests: retry after %d\","
+					"\"parameters\":{\"retry_after\":%d}}", cfg.retry_after, cfg.retry_after );
+			ret = answer ( fd, 429, "Too Many Requests", buf, length );
+		} else if ( is_file ) {
+			ret = answer_file ( fd, buf );
+		} else {
+			ret = answer_method ( fd, buf, method, query, body );
+		}
+
+		free ( body );
+		if ( ret == -1 ) break;
+	}
+
+	close ( fd );
+	free ( head );
+	free ( buf );
+
+	return NULL;
+}
+
+static void on_signal ( int sig ) {
+	is_stop = 1;
+}
+
+int main ( int argc, char **argv ) {
+	int opt;
+
+	while ( ( opt = getopt ( argc, argv, "p:b:w:l:r:a:x:f:" ) ) != -1 ) {
+		switch ( opt ) {
+			case 'p': cfg.port = atoi ( optarg ); break;
+			case 'b': cfg.batch = atoi ( optarg ); break;
+			case 'w': cfg.poll_delay_ms = atoi ( optarg ); break;
+			case 'l':
+				if ( parse_latency ( optarg ) == -1 ) {
+					fprintf ( stderr, "bad latency: %s\n", optarg );
+					return EXIT_FAILURE;
+				}
+				break;
+			case 'r': cfg.rate_429 = atof ( optarg ); break;
+			case 'a': cfg.retry_after = atoi ( optarg ); break;
+			case 'x': cfg.rate_drop = atof ( optarg ); break;
+			case 'f': cfg.file_size = atoll ( optarg ); break;
+			default:
+				fprintf ( stderr, "usage: %s [-p port] [-b batch] [-w poll_ms] [-l latency] "
+						"[-r rate_429] [-a retry_after] [-x rate_drop] [-f file_size]\n", argv[0] );
+				return EXIT_FAILURE;
+		}
+	}
+
+	struct sigaction sa = { 0 };
+	sa.sa_handler = on_signal;
+	sigaction ( SIGINT, &sa, NULL );
+	sigaction ( SIGTERM, &sa, NULL );
+	signal ( SIGPIPE, SIG_IGN );
+
+	int fd = socket ( AF_INET, SOCK_STREAM, 0 );
+	if ( fd == -1 ) {
+		perror ( "socket" );
+		return EXIT_FAILURE;
+	}
+
+	int one = 1;
+	setsockopt ( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof ( one ) );
+
+	struct sockaddr_in addr = { 0 };
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons ( cfg.port );
+	addr.sin_addr.s_addr = htonl ( INADDR_LOOPBACK );
+
+	if ( bind ( fd, ( struct sockaddr * ) &addr, sizeof ( addr ) ) == -1 || listen ( fd, 1024 ) == -1 ) {
+		perror ( "bind" );
+		return EXIT_FAILURE;
+	}
+
+	printf ( "mock api on http://127.0.0.1:%d\n", cfg.port );
+	fflush ( stdout );
+
+	while ( !is_stop ) {
+		int client = accept ( fd, NULL, NULL );
+		if ( client == -1 ) continue;
+
+		setsockopt ( client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof ( one ) );
+
+		pthread_t t;
+		if ( pthread_create ( &t, NULL, connection, ( void * ) ( long ) client ) ) {
+			close ( client );
+			continue;
+		}
+		pthread_detach ( t );
+	}
+
+	printf ( "requests: %lld updates: %lld 429: %lld dropped: %lld\n", atomic_load ( &requests ),
+			atomic_load ( &updates ), atomic_load ( &answered_429 ), atomic_load ( &dropped ) );
+
+	close ( fd );
+
+	return 0;
+}
@@ -20,6 +20,7 @@
 #ifndef __TEBOT__
 #define __TEBOT__
 
+#include <stdarg.h>
 #include <curl/curl.h>
 
 #ifdef __cplusplus
@@ -48,9 +49,9 @@ typedef struct tebot_location {
 	double longitude;
 	double latitude;
 	double horizontal_accuracy;
-	long live_period;
-	long heading;
-	long proximity_alert_radius;
+	long long int live_period;
+	long long int heading;
+	long long int proximity_alert_radius;
 } tebot_location_t;
 
 typedef struct tebot_inline_query {
@@ -550,6 +551,16 @@ typedef struct tebot_chat_member_updated {
 	tebot_chat_invite_link_t *invite_link;
 } tebot_chat_member_updated_t;
 
+/*
+ * real time in microseconds, filled only when update timing is on.
+ */
+typedef struct tebot_update_timing {
+	long long int received;
+	long long int parsed;
+	long long int dispatched;
+	long long int finished;
+} tebot_update_timing_t;
+
 typedef struct tebot_update {
 	long long int update_id;
 	tebot_message_t *message;
@@ -565,6 +576,7 @@ typedef struct tebot_update {
 	tebot_poll_answer_t *poll_answer;
 	tebot_chat_member_updated_t *my_chat_member;
 	tebot_chat_member_updated_t *chat_member;
+	tebot_update_timing_t timing;
 } tebot_update_t;
 
 typedef struct tebot_result_updated {
@@ -575,6 +587,67 @@ typedef struct tebot_result_updated {
 struct _creqhttp;
 typedef struct _creqhttp creqhttp;
 
+typedef struct tebot_dedup tebot_dedup_t;
+typedef struct tebot_offset_store tebot_offset_store_t;
+typedef struct tebot_journal tebot_journal_t;
+typedef struct tebot_logger tebot_logger_t;
+typedef struct tebot_metrics tebot_metrics_t;
+typedef struct tebot_arena tebot_arena_t;
+struct tebot_lazy;
+struct tebot_fields;
+struct json_tokener;
+struct tebot_handler;
+
+#define TEBOT_PARAM_STRING                 0
+#define TEBOT_PARAM_ARRAY                  1
+#define TEBOT_PARAM_FILE                   2
+
+/*
+ * value of file param is path of file to upload, array ends with NULL.
+ */
+typedef struct tebot_param {
+	int type;
+	char *name;
+	char *value;
+	char **array;
+} tebot_param_t;
+
+/*
+ * method is name of bot api method or downloadFile for file by path.
+ */
+typedef struct tebot_request {
+	const char *method;
+	const char *url;
+	const tebot_param_t *params;
+	int size_params;
+} tebot_request_t;
+
+/*
+ * send starts the call, receive waits for answer and returns http status
+ * or -1 if there is no answer. body of answer is streamed in parts to
+ * tebot_transport_body from send or receive. handler without transport
+ * uses curl.
+ */
+typedef struct tebot_transport {
+	int (*send) ( struct tebot_handler *h, void *data, const tebot_request_t *req );
+	long (*receive) ( struct tebot_handler *h, void *data );
+	void (*free) ( void *data );
+	void *data;
+} tebot_transport_t;
+
+/*
+ * data is given to every call. calloc and free_sized may be NULL, then
+ * malloc with memset and free are used.
+ */
+typedef struct tebot_allocator {
+	void *(*malloc) ( void *data, size_t size );
+	void *(*calloc) ( void *data, size_t n, size_t size );
+	void *(*realloc) ( void *data, void *p, size_t size );
+	void (*free) ( void *data, void *p );
+	void (*free_sized) ( void *data, void *p, size_t size );
+	void *data;
+} tebot_allocator_t;
+
 typedef struct tebot_handler {
 	CURL *curl;
 	int show_debug;
@@ -584,9 +657,24 @@ typedef struct tebot_handler {
 	char *current_buf;
 	long long int offset;
 	tebot_result_updated_t *res;
-	void **for_free;
-	int size_for_free;
+	tebot_arena_t *arena;
+	struct tebot_lazy *lazy;
+	int parse_depth;
+	struct tebot_fields *fields;
+	const struct tebot_fields *mask;
+	struct json_tokener *tokener;
 	creqhttp *cq;
+	tebot_dedup_t *dedup;
+	tebot_offset_store_t *offsets;
+	tebot_journal_t *journal;
+	tebot_logger_t *logger;
+	tebot_metrics_t *metrics;
+	int is_timing;
+	char **allowed_updates;
+	tebot_transport_t transport;
+	char *url_api;
+	char *url_api_get_file;
+	tebot_allocator_t allocator;
 } tebot_handler_t;
 
 
@@ -609,12 +697,162 @@ typedef enum tebot_reply_markup {
 } tebot_reply_markup_enum;
 
 tebot_handler_t *tebot_init ( const char *token, const tebot_show_debug_enum show_debug, const char *log_file );
+
+/*
+ * clone has own curl, arena and buffers and shares logger, metrics, dedup,
+ * journal and offsets with handler, so it can parse and send beside it in
+ * other thread.
+ */
+tebot_handler_t *tebot_handler_clone ( tebot_handler_t *h );
+void tebot_handler_clone_free ( tebot_handler_t *c );
+
+/*
+ * default is used by tebot_init and by objects made without handler, so it
+ * is set before any other call. allocator of handler is set right after
+ * tebot_init, memory given out to user by handler (getMe, markups) is
+ * freed by tebot_free with the same allocator. NULL allocator means default.
+ *
+ * returns -1 when curl was initialised before, then the allocator is used
+ * by library but curl stays on libc. once curl has the hooks, default can
+ * not be changed or reset to NULL and -1 is returned.
+ */
+int tebot_set_default_allocator ( const tebot_allocator_t *a );
+const tebot_allocator_t *tebot_default_allocator ( void );
+int tebot_set_allocator ( tebot_handler_t *h, const tebot_allocator_t *a );
+void *tebot_malloc ( const tebot_allocator_t *a, const size_t size );
+void *tebot_calloc ( const tebot_allocator_t *a, const size_t n, const size_t size );
+void *tebot_realloc ( const tebot_allocator_t *a, void *p, const size_t size );
+void tebot_free ( const tebot_allocator_t *a, void *p );
+void tebot_free_sized ( const tebot_allocator_t *a, void *p, const size_t size );
+char *tebot_strdup ( const tebot_allocator_t *a, const char *str );
+char *tebot_strndup ( const tebot_allocator_t *a, const char *str, const size_t length );
+
+/*
+ * NULL url_api gives back URL_API, NULL url_api_get_file is url_api with
+ * /file at the end.
+ */
+int tebot_set_api_url ( tebot_handler_t *h, const char *url_api, const char *url_api_get_file );
+void tebot_set_transport ( tebot_handler_t *h, const tebot_transport_t *t );
+size_t tebot_transport_body ( tebot_handler_t *h, const void *data, const size_t size );
+
+/*
+ * in-process bot api: methods are answered from canned bodies or by
+ * script, which streams body by tebot_transport_body and returns status.
+ * method "*" answers all methods without own answer, others get 404.
+ * calls with NULL method gives count of 404 answers.
+ */
+typedef struct tebot_loopback tebot_loopback_t;
+typedef long (*tebot_loopback_script_t) ( tebot_handler_t *h, const tebot_request_t *req, void *data );
+
+tebot_loopback_t *tebot_loopback_init ( void );
+int tebot_loopback_add ( tebot_loopback_t *l, const char *method, const long status, const char *body );
+int tebot_loopback_add_script ( tebot_loopback_t *l, const char *method, tebot_loopback_script_t script, void *data );
+void tebot_loopback_transport ( tebot_loopback_t *l, tebot_transport_t *t );
+long long int tebot_loopback_calls ( tebot_loopback_t *l, const char *method );
+void tebot_loopback_free ( tebot_loopback_t *l );
+
+void tebot_log ( tebot_handler_t *h, const tebot_log_level_enum log_level, const char *fmt, ... );
+void tebot_set_log_level ( tebot_handler_t *h, const tebot_log_level_enum max_level );
+void tebot_set_log_rate_limit ( tebot_handler_t *h, const int per_second );
+long long int tebot_log_dropped ( tebot_handler_t *h );
+
+#define TEBOT_METRICS_METHODS          32
+#define TEBOT_METRICS_BUCKETS          256
+#define TEBOT_METRICS_STATUS           12
+#define TEBOT_METRICS_CURL_ERRORS      128
+#define TEBOT_UPDATE_TYPES             13
+
+/*
+ * telegram stage is from date of update to receiving, so it has only
+ * precision of seconds. total is from date to finish.
+ */
+typedef enum tebot_lag_stage {
+	TEBOT_LAG_TELEGRAM,
+	TEBOT_LAG_PARSE,
+	TEBOT_LAG_QUEUE,
+	TEBOT_LAG_HANDLER,
+	TEBOT_LAG_TOTAL,
+	TEBOT_LAG_SIZE
+} tebot_lag_stage_enum;
+
+typedef enum tebot_metrics_phase {
+	TEBOT_PHASE_DNS,
+	TEBOT_PHASE_CONNECT,
+	TEBOT_PHASE_TLS,
+	TEBOT_PHASE_TTFB,
+	TEBOT_PHASE_TOTAL,
+	TEBOT_PHASE_SIZE
+} tebot_metrics_phase_enum;
+
+/*
+ * latency is in microseconds.
+ */
+typedef struct tebot_histogram {
+	unsigned long long int count;
+	unsigned long long int sum;
+	unsigned long long int buckets[TEBOT_METRICS_BUCKETS];
+} tebot_histogram_t;
+
+/*
+ * status[i] counts answers with tebot_metrics_status_code ( i ), index 0
+ * is other codes and requests without answer.
+ */
+typedef struct tebot_method_metrics {
+	const char *method;
+	unsigned long long int requests;
+	unsigned long long int status[TEBOT_METRICS_STATUS];
+	unsigned long long int curl_error[TEBOT_METRICS_CURL_ERRORS];
+	tebot_histogram_t latency[TEBOT_PHASE_SIZE];
+} tebot_method_metrics_t;
+
+typedef struct tebot_metrics_snapshot {
+	int size;
+	tebot_method_metrics_t methods[TEBOT_METRICS_METHODS];
+	unsigned long long int updates[TEBOT_UPDATE_TYPES];
+	tebot_histogram_t parse;
+	unsigned long long int allocations;
+	unsigned long long int webhook_requests;
+	unsigned long long int webhook_closed;
+	unsigned long long int webhook_rejected;
+	long long int startup_listen;
+	long long int startup_register;
+	tebot_histogram_t lag[TEBOT_UPDATE_TYPES][TEBOT_LAG_SIZE];
+} tebot_metrics_snapshot_t;
+
+int tebot_update_type ( tebot_update_t *u );
+long long int tebot_update_date ( tebot_update_t *u );
+size_t tebot_metrics_prometheus ( tebot_handler_t *h, char *buf, const size_t size );
+unsigned long long int tebot_histogram_bucket_upper ( const int index );
+unsigned long long int tebot_histogram_percentile ( const tebot_histogram_t *hg, const double percentile );
+int tebot_metrics_status_code ( const int index );
+
+/*
+ * snapshot is about half a megabyte, it is made on heap and freed by
+ * tebot_free_metrics.
+ */
+tebot_metrics_snapshot_t *tebot_get_metrics ( tebot_handler_t *h );
+void tebot_free_metrics ( tebot_handler_t *h, tebot_metrics_snapshot_t *s );
+
+void tebot_set_update_timing ( tebot_handler_t *h, const int is_timing );
+void tebot_update_dispatched ( tebot_handler_t *h, tebot_update_t *u );
+void tebot_update_finished ( tebot_handler_t *h, tebot_update_t *u );
+
+/*
+ * user, its first_name and username are freed by caller with allocator
+ * of handler.
+ */
 tebot_user_t *tebot_method_get_me ( tebot_handler_t *handler );
 tebot_result_updated_t *tebot_method_get_updates ( tebot_handler_t *handler, const long long int offset,
 		const int limit, const int timeout, char **allowed_updates );
 
 long long int tebot_method_get_file ( tebot_handler_t *h, const char *file_id, const char *out_file_name );
 
+int tebot_set_allowed_updates ( tebot_handler_t *h, char **allowed_updates );
+int tebot_set_offset_file ( tebot_handler_t *h, const char *path, const int commit_every );
+tebot_result_updated_t *tebot_poll_updates ( tebot_handler_t *h, const int limit, const int timeout, char **allowed_updates );
+int tebot_ack_update ( tebot_handler_t *h, const long long int update_id );
+int tebot_commit_offset ( tebot_handler_t *h );
+
 struct tebot_send_message_t {
 	long long int chat_id;
 	char *text;
@@ -907,11 +1145,53 @@ void tebot_method_copy_message ( tebot_handler_t *h, struct tebot_copy_message_t
 
 void tebot_free_update ( tebot_handler_t *h );
 
+/*
+ * in lazy mode nested objects and arrays of update (other than user and
+ * chat) are not made by parse and stay NULL. tebot_lazy makes the field on
+ * first access, TEBOT_LAZY gives it with type of field. fields live until
+ * tebot_free_update or next parse of handler.
+ */
+void tebot_set_lazy ( tebot_handler_t *h, const int is_lazy );
+void *tebot_lazy ( tebot_handler_t *h, void **field );
+#define TEBOT_LAZY(h, field) ( ( __typeof__ ( field ) ) tebot_lazy ( ( h ), ( void ** ) &( field ) ) )
+
+/*
+ * only listed paths of update are parsed, for example
+ * "message.text, message.chat.id, callback_query.data". path to object
+ * takes the whole object, "*" is any key. NULL parses everything.
+ */
+int tebot_set_fields ( tebot_handler_t *h, const char *fields );
+
 tebot_inline_keyboard_markup_t *tebot_init_inline_keyboard_markup ( const int size );
 tebot_reply_keyboard_markup_t *tebot_init_reply_keyboard_markup ( const int size );
 tebot_message_entity_t **tebot_init_message_entity ( const int size );
 
 
+/*
+ * listeners more than 1 start so many threads, each with own creqhttp on
+ * the same port and own handler given by tebot_webhook_handler in
+ * msg_handle. socket of every listener is bound with SO_REUSEPORT by
+ * library and given to creqhttp in listen_fd. process exits when not all
+ * of them start. pin_cpu binds listener i to cpu i. without route webhook
+ * is not registered in telegram.
+ *
+ * when metrics_route is set, GET requests to it are answered with metrics
+ * in prometheus text format and msg_handle is not called for them.
+ *
+ * allowed_updates ends with NULL. with secret_token requests without the
+ * same X-Telegram-Bot-Api-Secret-Token header get 403 before msg_handle,
+ * which then gets every request whole in one event. webhook with
+ * secret_token or update_handle is not started when all TEBOT_MAX_WEBHOOKS
+ * slots are taken.
+ *
+ * with update_handle instead of msg_handle http is read by library: the
+ * connection is kept alive, body split over reads is put together in
+ * slab of listener pool (pool_size slabs of slab_size, at least
+ * max_connections of them, bigger bodies up to max_body) and
+ * update_handle gets parsed updates with reply already begun, so its
+ * first send method is the answer. new connection gets 503 while all
+ * slabs hold bodies being read, non http input gets 400.
+ */
 struct tebot_setup_webhook {
 	unsigned short port;
 	int is_ssl;
@@ -919,10 +1199,109 @@ struct tebot_setup_webhook {
 	char *route;
 	char *cert_file;
 	char *private_key_file;
+	char *metrics_route;
+	int listeners;
+	int pin_cpu;
+	int max_connections;
+	char **allowed_updates;
+	int drop_pending_updates;
+	char *ip_address;
+	char *secret_token;
+	void (*update_handle) (tebot_handler_t *h, tebot_result_updated_t *t, creqhttp_epoll_event *v);
+	int pool_size;
+	size_t slab_size;
+	size_t max_body;
 };
 
+#ifndef TEBOT_WEBHOOK_ANSWER_SIZE
+#define TEBOT_WEBHOOK_ANSWER_SIZE          ( 64 * 1024 )
+#endif
+#define TEBOT_MAX_WEBHOOKS                 8
+
 void tebot_set_webhook (tebot_handler_t *h, struct tebot_setup_webhook *sw);
+tebot_handler_t *tebot_webhook_handler (void);
+
+/*
+ * between begin and end the first send method of handler called on the
+ * same thread is not sent, but written as answer to webhook request. end
+ * answers with empty 200 if no method was written and returns 1 if it was.
+ */
+void tebot_webhook_reply_begin (tebot_handler_t *h, creqhttp_epoll_event *v);
+int tebot_webhook_reply_end (tebot_handler_t *h, creqhttp_epoll_event *v);
 tebot_result_updated_t *tebot_get_data_from_webhook (tebot_handler_t *h, char *post_data);
+tebot_result_updated_t *tebot_get_data_from_webhook_len ( tebot_handler_t *h, const char *data, const size_t length );
+
+int tebot_set_dedup ( tebot_handler_t *h, const int window );
+
+struct tebot_setup_journal {
+	char *dir;
+	long long int segment_size;
+	long long int max_queue;
+};
+
+struct tebot_journal_range {
+	char *dir;
+	long long int from_update_id;
+	long long int to_update_id;
+	long long int from_date;
+	long long int to_date;
+};
+
+/*
+ * callback gets clone of handler made for replay, without journal, dedup
+ * and metrics, so replay can run beside live listeners.
+ */
+typedef void (*tebot_journal_replay_cb) ( tebot_handler_t *h, tebot_result_updated_t *t, void *userdata );
+
+long long int tebot_journal_replay ( tebot_handler_t *h, struct tebot_journal_range *r, tebot_journal_replay_cb cb, void *userdata );
+int tebot_set_journal ( tebot_handler_t *h, struct tebot_setup_journal *sj );
+
+#define TEBOT_SCANNER_CASE_INSENSITIVE     1
+
+typedef struct tebot_scanner tebot_scanner_t;
+
+typedef struct tebot_scanner_match {
+	int pattern_id;
+	long long int offset;
+	long long int length;
+	int update_index;
+	const char *field;
+	tebot_message_t *message;
+} tebot_scanner_match_t;
+
+/*
+ * return non zero from callback to stop scanning.
+ */
+typedef int (*tebot_scanner_cb) ( void *userdata, const tebot_scanner_match_t *m );
+
+tebot_scanner_t *tebot_scanner_init ( const char **patterns, const int size, const int flags );
+int tebot_scanner_reload ( tebot_scanner_t *s, const char **patterns, const int size, const int flags );
+long long int tebot_scanner_scan ( tebot_scanner_t *s, const char *text, const long long int length,
+		tebot_scanner_cb cb, void *userdata );
+long long int tebot_scanner_scan_update ( tebot_scanner_t *s, tebot_result_updated_t *t, tebot_scanner_cb cb, void *userdata );
+void tebot_scanner_free ( tebot_scanner_t *s );
+
+typedef struct tebot_state_store tebot_state_store_t;
+
+struct tebot_setup_state_store {
+	int value_size;
+	int shards;
+	long long int capacity;
+	long long int default_ttl;
+	char *snapshot_file;
+	long long int snapshot_interval;
+};
+
+tebot_state_store_t *tebot_state_store_init ( struct tebot_setup_state_store *ss );
+int tebot_state_get ( tebot_state_store_t *st, const long long int chat_id, const long long int user_id, void *value );
+int tebot_state_set ( tebot_state_store_t *st, const long long int chat_id, const long long int user_id,
+		const void *value, const long long int ttl );
+int tebot_state_delete ( tebot_state_store_t *st, const long long int chat_id, const long long int user_id );
+long long int tebot_state_size ( tebot_state_store_t *st );
+void tebot_state_tick ( tebot_state_store_t *st );
+int tebot_state_snapshot ( tebot_state_store_t *st, const char *path );
+int tebot_state_restore ( tebot_state_store_t *st, const char *path );
+void tebot_state_store_free ( tebot_state_store_t *st );
 
 #ifdef __cplusplus
 }
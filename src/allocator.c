@@ -0,0 +1,209 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <curl/curl.h>
+#include "tebot.h"
+
+static void *libc_malloc ( void *data, size_t size ) {
+	return malloc ( size );
+}
+
+static void *libc_calloc ( void *data, size_t n, size_t size ) {
+	return calloc ( n, size );
+}
+
+static void *libc_realloc ( void *data, void *p, size_t size ) {
+	return realloc ( p, size );
+}
+
+static void libc_free ( void *data, void *p ) {
+	free ( p );
+}
+
+static tebot_allocator_t default_allocator = {
+	.malloc = libc_malloc,
+	.calloc = libc_calloc,
+	.realloc = libc_realloc,
+	.free = libc_free
+};
+
+/*
+ * curl has only process wide hooks without data, they go to default.
+ */
+static void *mem_malloc ( size_t size ) {
+	return tebot_malloc ( NULL, size );
+}
+
+static void *mem_calloc ( size_t n, size_t size ) {
+	return tebot_calloc ( NULL, n, size );
+}
+
+static void *mem_realloc ( void *p, size_t size ) {
+	return tebot_realloc ( NULL, p, size );
+}
+
+static void mem_free ( void *p ) {
+	tebot_free ( NULL, p );
+}
+
+static char *mem_strdup ( const char *str ) {
+	return tebot_strdup ( NULL, str );
+}
+
+static int is_curl_hooked;
+
+/*
+ * curl_global_init_mem does nothing when curl is already initialised, so
+ * the only way to know the hooks are taken is to see them called.
+ */
+static tebot_allocator_t probe_allocator;
+static int is_probed;
+
+static void *probe_malloc ( void *data, size_t size ) {
+	is_probed = 1;
+	return tebot_malloc ( &probe_allocator, size );
+}
+
+static void *probe_calloc ( void *data, size_t n, size_t size ) {
+	is_probed = 1;
+	return tebot_calloc ( &probe_allocator, n, size );
+}
+
+static void *probe_realloc ( void *data, void *p, size_t size ) {
+	is_probed = 1;
+	return tebot_realloc ( &probe_allocator, p, size );
+}
+
+static void probe_free ( void *data, void *p ) {
+	tebot_free ( &probe_allocator, p );
+}
+
+static int curl_hook ( const tebot_allocator_t *a ) {
+	if ( curl_global_init_mem ( CURL_GLOBAL_DEFAULT, mem_malloc, mem_free, mem_realloc, mem_strdup, mem_calloc ) != CURLE_OK ) return -1;
+
+	probe_allocator = *a;
+	is_probed = 0;
+	default_allocator = ( tebot_allocator_t ) {
+		.malloc = probe_malloc,
+		.calloc = probe_calloc,
+		.realloc = probe_realloc,
+		.free = probe_free
+	};
+
+	char *escaped = curl_easy_escape ( NULL, "tebot", 5 );
+	curl_free ( escaped );
+
+	default_allocator = *a;
+
+	if ( !is_probed ) {
+		curl_global_cleanup ( );
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * json-c has no allocator hooks, its objects stay on libc. it lives only
+ * while a body is parsed, everything kept after is copied to arena.
+ *
+ * curl keeps its memory across calls, so once it has hooks the default can
+ * not change anymore: that memory would be freed by another allocator.
+ */
+int tebot_set_default_allocator ( const tebot_allocator_t *a ) {
+	if ( is_curl_hooked ) {
+		return a && !memcmp ( a, &default_allocator, sizeof ( tebot_allocator_t ) ) ? 0 : -1;
+	}
+
+	if ( !a ) {
+		default_allocator = ( tebot_allocator_t ) {
+			.malloc = libc_malloc,
+			.calloc = libc_calloc,
+			.realloc = libc_realloc,
+			.free = libc_free
+		};
+		return 0;
+	}
+
+	if ( curl_hook ( a ) == -1 ) return -1;
+
+	is_curl_hooked = 1;
+
+	return 0;
+}
+
+const tebot_allocator_t *tebot_default_allocator ( void ) {
+	return &default_allocator;
+}
+
+void *tebot_malloc ( const tebot_allocator_t *a, const size_t size ) {
+	if ( !a ) a = &default_allocator;
+
+	return a->malloc ( a->data, size );
+}
+
+void *tebot_calloc ( const tebot_allocator_t *a, const size_t n, const size_t size ) {
+	if ( !a ) a = &default_allocator;
+
+	if ( a->calloc ) return a->calloc ( a->data, n, size );
+
+	if ( size && n > ( size_t ) -1 / size ) return NULL;
+
+	void *p = a->malloc ( a->data, n * size );
+	if ( p ) memset ( p, 0, n * size );
+
+	return p;
+}
+
+void *tebot_realloc ( const tebot_allocator_t *a, void *p, const size_t size ) {
+	if ( !a ) a = &default_allocator;
+
+	return a->realloc ( a->data, p, size );
+}
+
+void tebot_free ( const tebot_allocator_t *a, void *p ) {
+	if ( !p ) return;
+	if ( !a ) a = &default_allocator;
+
+	a->free ( a->data, p );
+}
+
+void tebot_free_sized ( const tebot_allocator_t *a, void *p, const size_t size ) {
+	if ( !p ) return;
+	if ( !a ) a = &default_allocator;
+
+	if ( a->free_sized ) a->free_sized ( a->data, p, size );
+	else a->free ( a->data, p );
+}
+
+char *tebot_strndup ( const tebot_allocator_t *a, const char *str, const size_t length ) {
+	char *p = tebot_malloc ( a, length + 1 );
+	if ( !p ) return NULL;
+
+	memcpy ( p, str, length );
+	p[length] = 0;
+
+	return p;
+}
+
+char *tebot_strdup ( const tebot_allocator_t *a, const char *str ) {
+	return tebot_strndup ( a, str, strlen ( str ) );
+}
@@ -0,0 +1,136 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "tebot_private.h"
+
+#define ARENA_DEFAULT_CHUNK_SIZE          ( 64 * 1024 )
+#define ARENA_ALIGN                       16
+
+struct arena_chunk {
+	struct arena_chunk *next;
+	size_t size;
+	size_t used;
+	char data[];
+};
+
+/*
+ * chunks are kept after reset, so when updates have the same size as
+ * before no memory is asked from system.
+ */
+struct tebot_arena {
+	struct arena_chunk *head;
+	struct arena_chunk *current;
+	size_t chunk_size;
+	long long int allocs;
+	long long int chunks;
+	tebot_allocator_t allocator;
+};
+
+tebot_arena_t *tebot_arena_init ( const size_t chunk_size, const tebot_allocator_t *allocator ) {
+	if ( !allocator ) allocator = tebot_default_allocator ( );
+
+	tebot_arena_t *a = tebot_calloc ( allocator, 1, sizeof ( tebot_arena_t ) );
+	if ( !a ) return NULL;
+
+	a->allocator = *allocator;
+	a->chunk_size = chunk_size > 0 ? chunk_size : ARENA_DEFAULT_CHUNK_SIZE;
+
+	return a;
+}
+
+static struct arena_chunk *chunk_new ( tebot_arena_t *a, const size_t size ) {
+	const size_t size_chunk = size > a->chunk_size ? size : a->chunk_size;
+
+	struct arena_chunk *c = tebot_malloc ( &a->allocator, sizeof ( struct arena_chunk ) + size_chunk );
+	if ( !c ) return NULL;
+
+	c->next = NULL;
+	c->size = size_chunk;
+	c->used = 0;
+	a->chunks++;
+
+	return c;
+}
+
+void *tebot_arena_alloc ( tebot_arena_t *a, const size_t size ) {
+	const size_t size_aligned = ( size + ARENA_ALIGN - 1 ) & ~( size_t ) ( ARENA_ALIGN - 1 );
+
+	if ( !a->current ) {
+		if ( !a->head ) a->head = chunk_new ( a, size_aligned );
+		a->current = a->head;
+		if ( !a->current ) return NULL;
+	}
+
+	while ( a->current->used + size_aligned > a->current->size ) {
+		if ( !a->current->next ) {
+			a->current->next = chunk_new ( a, size_aligned );
+			if ( !a->current->next ) return NULL;
+		}
+
+		a->current = a->current->next;
+		a->current->used = 0;
+	}
+
+	void *p = &a->current->data[a->current->used];
+	a->current->used += size_aligned;
+	a->allocs++;
+
+	memset ( p, 0, size );
+
+	return p;
+}
+
+char *tebot_arena_strndup ( tebot_arena_t *a, const char *str, const size_t length ) {
+	char *p = tebot_arena_alloc ( a, length + 1 );
+	if ( !p ) return NULL;
+
+	memcpy ( p, str, length );
+
+	return p;
+}
+
+long long int tebot_arena_allocs ( tebot_arena_t *a ) {
+	return a->allocs;
+}
+
+long long int tebot_arena_chunks ( tebot_arena_t *a ) {
+	return a->chunks;
+}
+
+void tebot_arena_reset ( tebot_arena_t *a ) {
+	if ( a->head ) a->head->used = 0;
+	a->current = a->head;
+	a->allocs = 0;
+}
+
+void tebot_arena_free ( tebot_arena_t *a ) {
+	if ( !a ) return;
+
+	struct arena_chunk *c = a->head;
+	while ( c ) {
+		struct arena_chunk *next = c->next;
+		tebot_free_sized ( &a->allocator, c, sizeof ( struct arena_chunk ) + c->size );
+		c = next;
+	}
+
+	tebot_allocator_t allocator = a->allocator;
+	tebot_free_sized ( &allocator, a, sizeof ( tebot_arena_t ) );
+}
@@ -0,0 +1,147 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "tebot_private.h"
+
+#define DEDUP_DEFAULT_WINDOW      4096
+#define DEDUP_OLD_BITS            10
+
+/*
+ * bitmap covers [base, base + window). ids which are below the window
+ * come out of order and are remembered in the small direct mapped table.
+ */
+struct tebot_dedup {
+	pthread_mutex_t mutex;
+	long long int base;
+	int window;
+	int is_init;
+	uint64_t *bits;
+	long long int old[1 << DEDUP_OLD_BITS];
+};
+
+tebot_dedup_t *tebot_dedup_init ( const int window ) {
+	tebot_dedup_t *d = tebot_calloc ( NULL, 1, sizeof ( tebot_dedup_t ) );
+	if ( !d ) return NULL;
+
+	d->window = window > 0 ? ( window + 63 ) & ~63 : DEDUP_DEFAULT_WINDOW;
+	d->bits = tebot_calloc ( NULL, d->window / 64, sizeof ( uint64_t ) );
+	if ( !d->bits ) {
+		tebot_free ( NULL, d );
+		return NULL;
+	}
+
+	memset ( d->old, 0xff, sizeof ( d->old ) );
+	pthread_mutex_init ( &d->mutex, NULL );
+
+	return d;
+}
+
+static void slide ( tebot_dedup_t *d, const long long int base ) {
+	if ( base - d->base >= d->window ) {
+		memset ( d->bits, 0, d->window / 8 );
+	} else {
+		for ( long long int id = d->base; id < base; id++ ) {
+			const long long int bit = id % d->window;
+			d->bits[bit / 64] &= ~( 1ULL << ( bit % 64 ) );
+		}
+	}
+
+	d->base = base;
+}
+
+static long long int *old_slot ( tebot_dedup_t *d, const long long int update_id ) {
+	uint64_t x = ( uint64_t ) update_id * 0x9e3779b97f4a7c15ULL;
+
+	return &d->old[x >> ( 64 - DEDUP_OLD_BITS )];
+}
+
+static int check_old ( tebot_dedup_t *d, const long long int update_id ) {
+	long long int *slot = old_slot ( d, update_id );
+
+	if ( *slot == update_id ) return 1;
+	*slot = update_id;
+
+	return 0;
+}
+
+int tebot_dedup_check ( tebot_dedup_t *d, const long long int update_id ) {
+	if ( update_id < 0 ) return 0;
+
+	int ret = 0;
+
+	pthread_mutex_lock ( &d->mutex );
+
+	if ( !d->is_init ) {
+		d->base = update_id > d->window / 2 ? update_id - d->window / 2 : 0;
+		d->is_init = 1;
+	}
+
+	if ( update_id < d->base ) {
+		ret = check_old ( d, update_id );
+	} else {
+		if ( update_id >= d->base + d->window ) slide ( d, update_id - d->window + 1 );
+
+		const long long int bit = update_id % d->window;
+		const uint64_t mask = 1ULL << ( bit % 64 );
+
+		if ( d->bits[bit / 64] & mask ) ret = 1;
+		else d->bits[bit / 64] |= mask;
+	}
+
+	pthread_mutex_unlock ( &d->mutex );
+
+	return ret;
+}
+
+/*
+ * only looks at window, update is marked by tebot_dedup_check after it is
+ * parsed, so a body which failed to parse is taken again on retry.
+ */
+int tebot_dedup_seen ( tebot_dedup_t *d, const long long int update_id ) {
+	if ( update_id < 0 ) return 0;
+
+	int ret = 0;
+
+	pthread_mutex_lock ( &d->mutex );
+
+	if ( d->is_init ) {
+		if ( update_id < d->base ) {
+			ret = *old_slot ( d, update_id ) == update_id;
+		} else if ( update_id < d->base + d->window ) {
+			const long long int bit = update_id % d->window;
+			ret = ( d->bits[bit / 64] & ( 1ULL << ( bit % 64 ) ) ) != 0;
+		}
+	}
+
+	pthread_mutex_unlock ( &d->mutex );
+
+	return ret;
+}
+
+void tebot_dedup_free ( tebot_dedup_t *d ) {
+	if ( !d ) return;
+
+	pthread_mutex_destroy ( &d->mutex );
+	tebot_free ( NULL, d->bits );
+	tebot_free ( NULL, d );
+}
@@ -0,0 +1,447 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include <json-c/json.h>
+#include "tebot_private.h"
+
+#define JOURNAL_DEFAULT_SEGMENT_SIZE      ( 64 * 1024 * 1024 )
+#define JOURNAL_DEFAULT_MAX_QUEUE         ( 64 * 1024 * 1024 )
+#define JOURNAL_PREFIX                    "journal-"
+
+/*
+ * every record in .log is the json of one update with trailing zero, so
+ * replay gives pointer into mapped file straight to parser. .idx has one
+ * fixed entry for each record, update_id grows inside segment, so replay
+ * finds start of range by binary search.
+ */
+struct journal_index {
+	long long int update_id;
+	long long int date;
+	long long int received;
+	long long int offset;
+	long long int length;
+};
+
+struct journal_body {
+	struct journal_body *next;
+	long long int received;
+	size_t length;
+	char data[];
+};
+
+struct tebot_journal {
+	char *dir;
+	long long int segment_size;
+	long long int max_queue;
+
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int is_stop;
+	struct journal_body *head;
+	struct journal_body *tail;
+	long long int size_queue;
+	long long int dropped;
+
+	int fd_log;
+	int fd_idx;
+	long long int size_log;
+	long long int size_idx;
+	long long int last_update_id;
+};
+
+static int open_segment ( tebot_journal_t *j, const long long int first_update_id ) {
+	if ( j->fd_log != -1 ) close ( j->fd_log );
+	if ( j->fd_idx != -1 ) close ( j->fd_idx );
+	j->fd_log = -1;
+	j->fd_idx = -1;
+
+	const size_t size_path = strlen ( j->dir ) + 64;
+	char *path = tebot_calloc ( NULL, size_path, 1 );
+	if ( !path ) return -1;
+
+	/*
+	 * segment is never appended after it is closed, otherwise update_id
+	 * in it would not grow. name taken by earlier segment with the same
+	 * first update gets number after it.
+	 */
+	for ( int n = 0; n < 1000 && j->fd_idx == -1; n++ ) {
+		if ( n == 0 ) snprintf ( path, size_path, "%s/" JOURNAL_PREFIX "%020lld.idx", j->dir, first_update_id );
+		else snprintf ( path, size_path, "%s/" JOURNAL_PREFIX "%020lld-%03d.idx", j->dir, first_update_id, n );
+		j->fd_idx = open ( path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND, 0644 );
+		if ( j->fd_idx == -1 && errno != EEXIST ) break;
+	}
+
+	if ( j->fd_idx != -1 ) {
+		memcpy ( &path[strlen ( path ) - 4], ".log", 4 );
+		j->fd_log = open ( path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644 );
+	}
+
+	tebot_free ( NULL, path );
+
+	if ( j->fd_log == -1 || j->fd_idx == -1 ) return -1;
+
+	j->size_log = 0;
+	j->size_idx = 0;
+	j->last_update_id = first_update_id;
+
+	return 0;
+}
+
+static long long int get_date ( json_object *update ) {
+	const char *names[] = {
+		"message",
+		"edited_message",
+		"channel_post",
+		"edited_channel_post",
+		"my_chat_member",
+		"chat_member"
+	};
+
+	for ( int i = 0; i < sizeof ( names ) / sizeof ( char * ); i++ ) {
+		json_object *obj = json_object_object_get ( update, names[i] );
+		if ( !obj ) continue;
+
+		json_object *date = json_object_object_get ( obj, "date" );
+		if ( date ) return json_object_get_int64 ( date );
+	}
+
+	return 0;
+}
+
+static void write_update ( tebot_journal_t *j, json_object *update, const long long int received ) {
+	json_object *id = json_object_object_get ( update, "update_id" );
+	if ( !id ) return;
+
+	struct journal_index idx = {
+		.update_id = json_object_get_int64 ( id ),
+		.date = get_date ( update ),
+		.received = received
+	};
+
+	/*
+	 * the same update again is already in segment, older one starts new
+	 * segment, so index stays sorted.
+	 */
+	if ( j->fd_log != -1 && idx.update_id == j->last_update_id && j->size_idx > 0 ) return;
+
+	if ( j->fd_log == -1 || j->size_log >= j->segment_size || idx.update_id < j->last_update_id ) {
+		if ( open_segment ( j, idx.update_id ) == -1 ) return;
+	}
+
+	size_t length = 0;
+	const char *str = json_object_to_json_string_length ( update, JSON_C_TO_STRING_PLAIN, &length );
+
+	idx.offset = j->size_log;
+	idx.length = length;
+
+	if ( write ( j->fd_log, str, length + 1 ) != length + 1 ) goto write_update_error;
+	if ( write ( j->fd_idx, &idx, sizeof ( idx ) ) != sizeof ( idx ) ) goto write_update_error;
+
+	j->size_log += length + 1;
+	j->size_idx += sizeof ( idx );
+	j->last_update_id = idx.update_id;
+
+	return;
+
+write_update_error:
+	/*
+	 * record written only in part is cut from both files, so .log and
+	 * .idx stay in step. if it can not be cut, next update starts new
+	 * segment.
+	 */
+	if ( ftruncate ( j->fd_log, j->size_log ) == -1 || ftruncate ( j->fd_idx, j->size_idx ) == -1 ) {
+		close ( j->fd_log );
+		close ( j->fd_idx );
+		j->fd_log = -1;
+		j->fd_idx = -1;
+	}
+}
+
+static void write_body ( tebot_journal_t *j, struct journal_body *b ) {
+	json_object *root = json_tokener_parse ( b->data );
+	if ( !root ) return;
+
+	json_object *result = json_object_object_get ( root, "result" );
+
+	if ( result && json_object_get_type ( result ) == json_type_array ) {
+		const size_t size = json_object_array_length ( result );
+		for ( size_t i = 0; i < size; i++ ) {
+			write_update ( j, json_object_array_get_idx ( result, i ), b->received );
+		}
+	} else {
+		write_update ( j, root, b->received );
+	}
+
+	json_object_put ( root );
+}
+
+static void *journal_writer ( void *_data ) {
+	tebot_journal_t *j = ( tebot_journal_t * ) _data;
+
+	while ( 1 ) {
+		pthread_mutex_lock ( &j->mutex );
+		while ( !j->head && !j->is_stop ) pthread_cond_wait ( &j->cond, &j->mutex );
+
+		struct journal_body *b = j->head;
+		j->head = NULL;
+		j->tail = NULL;
+		j->size_queue = 0;
+		int is_stop = j->is_stop;
+		pthread_mutex_unlock ( &j->mutex );
+
+		while ( b ) {
+			struct journal_body *next = b->next;
+			write_body ( j, b );
+			tebot_free ( NULL, b );
+			b = next;
+		}
+
+		if ( is_stop ) break;
+	}
+
+	return NULL;
+}
+
+tebot_journal_t *tebot_journal_init ( struct tebot_setup_journal *sj ) {
+	tebot_journal_t *j = tebot_calloc ( NULL, 1, sizeof ( tebot_journal_t ) );
+	if ( !j ) return NULL;
+
+	j->dir = tebot_strdup ( NULL, sj->dir );
+	j->segment_size = sj->segment_size > 0 ? sj->segment_size : JOURNAL_DEFAULT_SEGMENT_SIZE;
+	j->max_queue = sj->max_queue > 0 ? sj->max_queue : JOURNAL_DEFAULT_MAX_QUEUE;
+	j->fd_log = -1;
+	j->fd_idx = -1;
+
+	mkdir ( j->dir, 0755 );
+
+	pthread_mutex_init ( &j->mutex, NULL );
+	pthread_cond_init ( &j->cond, NULL );
+
+	if ( pthread_create ( &j->thread, NULL, journal_writer, j ) ) {
+		pthread_mutex_destroy ( &j->mutex );
+		pthread_cond_destroy ( &j->cond );
+		tebot_free ( NULL, j->dir );
+		tebot_free ( NULL, j );
+		return NULL;
+	}
+
+	return j;
+}
+
+/*
+ * only copy of body is done on the calling thread.
+ */
+int tebot_journal_append ( tebot_journal_t *j, const char *data, const size_t length ) {
+	if ( !data ) return -1;
+
+	struct journal_body *b = tebot_malloc ( NULL, sizeof ( struct journal_body ) + length + 1 );
+	if ( !b ) {
+		pthread_mutex_lock ( &j->mutex );
+		j->dropped++;
+		pthread_mutex_unlock ( &j->mutex );
+		return -1;
+	}
+
+	b->next = NULL;
+	b->received = time ( NULL );
+	b->length = length;
+	memcpy ( b->data, data, length );
+	b->data[length] = 0;
+
+	/*
+	 * queue is counted only for body which is really in it.
+	 */
+	pthread_mutex_lock ( &j->mutex );
+	if ( j->size_queue + length > j->max_queue ) {
+		j->dropped++;
+		pthread_mutex_unlock ( &j->mutex );
+		tebot_free ( NULL, b );
+		return -1;
+	}
+	j->size_queue += length;
+	if ( j->tail ) j->tail->next = b;
+	else j->head = b;
+	j->tail = b;
+	pthread_cond_signal ( &j->cond );
+	pthread_mutex_unlock ( &j->mutex );
+
+	return 0;
+}
+
+long long int tebot_journal_dropped ( tebot_journal_t *j ) {
+	pthread_mutex_lock ( &j->mutex );
+	long long int dropped = j->dropped;
+	pthread_mutex_unlock ( &j->mutex );
+
+	return dropped;
+}
+
+long long int tebot_journal_queue_size ( tebot_journal_t *j ) {
+	pthread_mutex_lock ( &j->mutex );
+	long long int size_queue = j->size_queue;
+	pthread_mutex_unlock ( &j->mutex );
+
+	return size_queue;
+}
+
+void tebot_journal_free ( tebot_journal_t *j ) {
+	if ( !j ) return;
+
+	pthread_mutex_lock ( &j->mutex );
+	j->is_stop = 1;
+	pthread_cond_signal ( &j->cond );
+	pthread_mutex_unlock ( &j->mutex );
+
+	pthread_join ( j->thread, NULL );
+
+	if ( j->fd_log != -1 ) close ( j->fd_log );
+	if ( j->fd_idx != -1 ) close ( j->fd_idx );
+	pthread_mutex_destroy ( &j->mutex );
+	pthread_cond_destroy ( &j->cond );
+	tebot_free ( NULL, j->dir );
+	tebot_free ( NULL, j );
+}
+
+static int filter_segment ( const struct dirent *d ) {
+	const size_t length = strlen ( d->d_name );
+
+	return !strncmp ( d->d_name, JOURNAL_PREFIX, sizeof ( JOURNAL_PREFIX ) - 1 ) &&
+		length > 4 && !strcmp ( &d->d_name[length - 4], ".idx" );
+}
+
+static void *map_file ( const char *path, size_t *size ) {
+	int fd = open ( path, O_RDONLY );
+	if ( fd == -1 ) return NULL;
+
+	struct stat sb;
+	if ( fstat ( fd, &sb ) == -1 || sb.st_size == 0 ) {
+		close ( fd );
+		return NULL;
+	}
+
+	void *p = mmap ( NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close ( fd );
+	if ( p == MAP_FAILED ) return NULL;
+
+	*size = sb.st_size;
+
+	return p;
+}
+
+/*
+ * first entry with update_id not less than from_update_id.
+ */
+static size_t find_first ( const struct journal_index *idx, const size_t size, const long long int from_update_id ) {
+	size_t low = 0;
+	size_t high = size;
+
+	while ( low < high ) {
+		const size_t mid = low + ( high - low ) / 2;
+		if ( idx[mid].update_id < from_update_id ) low = mid + 1;
+		else high = mid;
+	}
+
+	return low;
+}
+
+long long int tebot_journal_replay ( tebot_handler_t *h, struct tebot_journal_range *r, tebot_journal_replay_cb cb, void *userdata ) {
+	struct dirent **list = NULL;
+	const int size_list = scandir ( r->dir, &list, filter_segment, alphasort );
+	if ( size_list < 0 ) return -1;
+
+	long long int count = 0;
+
+	/*
+	 * replay goes through own handler, so it does not share arena with
+	 * live listener, is not stored again, not skipped as redelivery and
+	 * not counted in live metrics.
+	 */
+	tebot_handler_t *c = tebot_handler_clone ( h );
+	if ( c ) {
+		c->journal = NULL;
+		c->dedup = NULL;
+		c->metrics = NULL;
+	}
+
+	const size_t size_path = strlen ( r->dir ) + 300;
+	char *path = tebot_calloc ( NULL, size_path, 1 );
+	if ( !c || !path ) count = -1;
+
+	for ( int n = 0; n < size_list && c && path; n++ ) {
+		size_t size_idx = 0;
+		size_t size_log = 0;
+
+		snprintf ( path, size_path, "%s/%s", r->dir, list[n]->d_name );
+		struct journal_index *idx = map_file ( path, &size_idx );
+		if ( !idx ) continue;
+
+		memcpy ( &path[strlen ( path ) - 4], ".log", 4 );
+		char *log = map_file ( path, &size_log );
+		if ( !log ) {
+			munmap ( idx, size_idx );
+			continue;
+		}
+
+		madvise ( log, size_log, MADV_SEQUENTIAL );
+
+		const size_t size = size_idx / sizeof ( struct journal_index );
+
+		for ( size_t i = find_first ( idx, size, r->from_update_id ); i < size; i++ ) {
+			struct journal_index *e = &idx[i];
+
+			if ( r->to_update_id && e->update_id > r->to_update_id ) break;
+			if ( r->from_date && e->date < r->from_date ) continue;
+			if ( r->to_date && e->date > r->to_date ) continue;
+			if ( e->offset + e->length >= size_log ) break;
+
+			tebot_result_updated_t *t = tebot_get_data_from_webhook_len ( c, &log[e->offset], e->length );
+			if ( !t ) continue;
+
+			count++;
+			cb ( c, t, userdata );
+			tebot_free_update ( c );
+		}
+
+		munmap ( log, size_log );
+		munmap ( idx, size_idx );
+	}
+
+	if ( c ) tebot_handler_clone_free ( c );
+
+	/*
+	 * list is made by scandir with libc.
+	 */
+	for ( int n = 0; n < size_list; n++ ) free ( list[n] );
+	free ( list );
+	tebot_free ( NULL, path );
+
+	return count;
+}
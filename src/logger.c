@@ -0,0 +1,298 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "tebot_private.h"
+
+#define LOG_LEVEL_CRITICAL_STRING          "[CRITICAL]: "
+#define LOG_LEVEL_NOTICE_STRING            "[NOTICE]: "
+#define LOG_LEVEL_BAD_REQUEST_STRING       "[BAD REQUEST]: "
+
+#define LOG_RING_SIZE                      1024
+#define LOG_RECORD_SIZE                    1024
+#define LOG_WRITE_BUF_SIZE                 ( 64 * 1024 )
+#define LOG_IDLE_NSEC                      ( 20 * 1000 * 1000 )
+
+#define LOG_RATE_BITS                      6
+#define LOG_DEFAULT_RATE_LIMIT             100
+
+struct log_record {
+	atomic_size_t seq;
+	int level;
+	time_t time;
+	int length;
+	char msg[LOG_RECORD_SIZE];
+};
+
+/*
+ * calls from one place of code (same fmt) are counted per second,
+ * records over the limit are suppressed.
+ */
+struct log_rate {
+	atomic_uintptr_t fmt;
+	atomic_llong second;
+	atomic_int count;
+};
+
+struct tebot_logger {
+	int fd;
+	int show_debug;
+	atomic_int max_level;
+	atomic_int rate_limit;
+
+	struct log_record *ring;
+	atomic_size_t enqueue_pos;
+	atomic_size_t dequeue_pos;
+
+	struct log_rate rate[1 << LOG_RATE_BITS];
+	atomic_llong dropped;
+	atomic_llong suppressed;
+	long long int reported_suppressed;
+
+	pthread_t thread;
+	atomic_int is_stop;
+
+	char out_file[LOG_WRITE_BUF_SIZE + LOG_RECORD_SIZE + 128];
+	char out_stderr[LOG_WRITE_BUF_SIZE + LOG_RECORD_SIZE + 128];
+};
+
+static __thread char thread_buf[LOG_RECORD_SIZE];
+
+static const char *level_string ( const int level ) {
+	switch ( level ) {
+		case LOG_LEVEL_CRITICAL: return LOG_LEVEL_CRITICAL_STRING;
+		case LOG_LEVEL_NOTICE: return LOG_LEVEL_NOTICE_STRING;
+		case LOG_LEVEL_BAD_REQUEST: return LOG_LEVEL_BAD_REQUEST_STRING;
+	}
+
+	return "";
+}
+
+static void write_all ( int fd, const char *buf, size_t size ) {
+	while ( size > 0 ) {
+		ssize_t ret = write ( fd, buf, size );
+		if ( ret <= 0 ) return;
+		buf += ret;
+		size -= ret;
+	}
+}
+
+static int drain ( tebot_logger_t *l ) {
+	size_t size_file = 0;
+	size_t size_stderr = 0;
+	size_t pos = atomic_load_explicit ( &l->dequeue_pos, memory_order_relaxed );
+	int count = 0;
+
+	while ( 1 ) {
+		struct log_record *r = &l->ring[pos & ( LOG_RING_SIZE - 1 )];
+		size_t seq = atomic_load_explicit ( &r->seq, memory_order_acquire );
+		if ( seq != pos + 1 ) break;
+
+		if ( l->fd != -1 ) {
+			char date[32];
+			struct tm tm;
+			localtime_r ( &r->time, &tm );
+			strftime ( date, sizeof ( date ), "%a %b %e %H:%M:%S %Y", &tm );
+			size_file += snprintf ( &l->out_file[size_file], sizeof ( l->out_file ) - size_file,
+					"%s%s: %.*s", level_string ( r->level ), date, r->length, r->msg );
+			if ( size_file > 0 && l->out_file[size_file - 1] != '\n' ) l->out_file[size_file++] = '\n';
+		}
+
+		if ( l->show_debug ) {
+			size_stderr += snprintf ( &l->out_stderr[size_stderr], sizeof ( l->out_stderr ) - size_stderr,
+					"%s%.*s", level_string ( r->level ), r->length, r->msg );
+		}
+
+		atomic_store_explicit ( &r->seq, pos + LOG_RING_SIZE, memory_order_release );
+		pos++;
+		atomic_store_explicit ( &l->dequeue_pos, pos, memory_order_relaxed );
+		count++;
+
+		if ( size_file >= LOG_WRITE_BUF_SIZE || size_stderr >= LOG_WRITE_BUF_SIZE ) {
+			if ( size_file ) write_all ( l->fd, l->out_file, size_file );
+			if ( size_stderr ) write_all ( STDERR_FILENO, l->out_stderr, size_stderr );
+			size_file = 0;
+			size_stderr = 0;
+		}
+	}
+
+	long long int suppressed = atomic_load ( &l->suppressed );
+	long long int dropped = atomic_load ( &l->dropped );
+	if ( suppressed != l->reported_suppressed && l->fd != -1 ) {
+		size_file += snprintf ( &l->out_file[size_file], sizeof ( l->out_file ) - size_file,
+				LOG_LEVEL_NOTICE_STRING "suppressed repeated records: %lld, dropped records: %lld\n",
+				suppressed - l->reported_suppressed, dropped );
+		l->reported_suppressed = suppressed;
+	}
+
+	if ( size_file ) write_all ( l->fd, l->out_file, size_file );
+	if ( size_stderr ) write_all ( STDERR_FILENO, l->out_stderr, size_stderr );
+
+	return count;
+}
+
+static void *logger_writer ( void *_data ) {
+	tebot_logger_t *l = ( tebot_logger_t * ) _data;
+	struct timespec idle = { 0, LOG_IDLE_NSEC };
+
+	while ( !atomic_load ( &l->is_stop ) ) {
+		if ( drain ( l ) == 0 ) nanosleep ( &idle, NULL );
+	}
+
+	drain ( l );
+
+	return NULL;
+}
+
+tebot_logger_t *tebot_logger_init ( const char *log_file, const int show_debug ) {
+	tebot_logger_t *l = tebot_calloc ( NULL, 1, sizeof ( tebot_logger_t ) );
+	if ( !l ) return NULL;
+
+	l->fd = -1;
+	l->show_debug = show_debug;
+	atomic_init ( &l->max_level, LOG_LEVEL_BAD_REQUEST );
+	atomic_init ( &l->rate_limit, LOG_DEFAULT_RATE_LIMIT );
+
+	if ( log_file ) {
+		l->fd = open ( log_file, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644 );
+		if ( l->fd == -1 ) {
+			tebot_free ( NULL, l );
+			return NULL;
+		}
+	}
+
+	l->ring = tebot_calloc ( NULL, LOG_RING_SIZE, sizeof ( struct log_record ) );
+	if ( !l->ring ) goto tebot_logger_init_error;
+
+	for ( size_t i = 0; i < LOG_RING_SIZE; i++ ) atomic_init ( &l->ring[i].seq, i );
+
+	if ( pthread_create ( &l->thread, NULL, logger_writer, l ) ) goto tebot_logger_init_error;
+
+	return l;
+
+tebot_logger_init_error:
+	if ( l->fd != -1 ) close ( l->fd );
+	tebot_free ( NULL, l->ring );
+	tebot_free ( NULL, l );
+	return NULL;
+}
+
+static int is_rate_limited ( tebot_logger_t *l, const char *fmt, const time_t now ) {
+	const int limit = atomic_load_explicit ( &l->rate_limit, memory_order_relaxed );
+	if ( limit <= 0 ) return 0;
+
+	uintptr_t key = ( uintptr_t ) fmt;
+	struct log_rate *r = &l->rate[( ( key >> 3 ) * 0x9e3779b97f4a7c15ULL ) >> ( 64 - LOG_RATE_BITS )];
+
+	if ( atomic_load_explicit ( &r->fmt, memory_order_relaxed ) != key ||
+			atomic_load_explicit ( &r->second, memory_order_relaxed ) != now ) {
+		atomic_store_explicit ( &r->fmt, key, memory_order_relaxed );
+		atomic_store_explicit ( &r->second, now, memory_order_relaxed );
+		atomic_store_explicit ( &r->count, 0, memory_order_relaxed );
+	}
+
+	return atomic_fetch_add_explicit ( &r->count, 1, memory_order_relaxed ) >= limit;
+}
+
+void tebot_logger_vwrite ( tebot_logger_t *l, const tebot_log_level_enum log_level, const char *fmt, va_list ap ) {
+	if ( log_level > atomic_load_explicit ( &l->max_level, memory_order_relaxed ) ) return;
+
+	const time_t now = time ( NULL );
+	if ( is_rate_limited ( l, fmt, now ) ) {
+		atomic_fetch_add_explicit ( &l->suppressed, 1, memory_order_relaxed );
+		return;
+	}
+
+	int length = vsnprintf ( thread_buf, LOG_RECORD_SIZE, fmt, ap );
+	if ( length < 0 ) return;
+	if ( length >= LOG_RECORD_SIZE ) length = LOG_RECORD_SIZE - 1;
+
+	size_t pos = atomic_load_explicit ( &l->enqueue_pos, memory_order_relaxed );
+	struct log_record *r;
+
+	while ( 1 ) {
+		r = &l->ring[pos & ( LOG_RING_SIZE - 1 )];
+		size_t seq = atomic_load_explicit ( &r->seq, memory_order_acquire );
+		intptr_t diff = ( intptr_t ) seq - ( intptr_t ) pos;
+
+		if ( diff == 0 ) {
+			if ( atomic_compare_exchange_weak_explicit ( &l->enqueue_pos, &pos, pos + 1,
+						memory_order_relaxed, memory_order_relaxed ) ) break;
+		} else if ( diff < 0 ) {
+			atomic_fetch_add_explicit ( &l->dropped, 1, memory_order_relaxed );
+			return;
+		} else {
+			pos = atomic_load_explicit ( &l->enqueue_pos, memory_order_relaxed );
+		}
+	}
+
+	r->level = log_level;
+	r->time = now;
+	r->length = length;
+	memcpy ( r->msg, thread_buf, length );
+
+	atomic_store_explicit ( &r->seq, pos + 1, memory_order_release );
+}
+
+void tebot_logger_write ( tebot_logger_t *l, const tebot_log_level_enum log_level, const char *fmt, ... ) {
+	va_list ap;
+
+	va_start ( ap, fmt );
+	tebot_logger_vwrite ( l, log_level, fmt, ap );
+	va_end ( ap );
+}
+
+void tebot_logger_set_level ( tebot_logger_t *l, const tebot_log_level_enum max_level ) {
+	atomic_store ( &l->max_level, max_level );
+}
+
+void tebot_logger_set_rate_limit ( tebot_logger_t *l, const int per_second ) {
+	atomic_store ( &l->rate_limit, per_second );
+}
+
+long long int tebot_logger_dropped ( tebot_logger_t *l ) {
+	return atomic_load ( &l->dropped );
+}
+
+long long int tebot_logger_depth ( tebot_logger_t *l ) {
+	size_t dequeue = atomic_load_explicit ( &l->dequeue_pos, memory_order_relaxed );
+	size_t enqueue = atomic_load_explicit ( &l->enqueue_pos, memory_order_relaxed );
+
+	return enqueue > dequeue ? enqueue - dequeue : 0;
+}
+
+void tebot_logger_free ( tebot_logger_t *l ) {
+	if ( !l ) return;
+
+	atomic_store ( &l->is_stop, 1 );
+	pthread_join ( l->thread, NULL );
+
+	if ( l->fd != -1 ) close ( l->fd );
+	tebot_free ( NULL, l->ring );
+	tebot_free ( NULL, l );
+}
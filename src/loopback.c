@@ -0,0 +1,165 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include "tebot.h"
+
+#define LOOPBACK_METHODS                   64
+#define LOOPBACK_NOT_FOUND                 "{\"ok\":false,\"error_code\":404,\"description\":\"Not Found\"}"
+
+struct loopback_answer {
+	char *method;
+	long status;
+	char *body;
+	size_t size_body;
+	tebot_loopback_script_t script;
+	void *data;
+	atomic_llong calls;
+};
+
+/*
+ * answers are added before handler uses transport and are not changed
+ * after, so calls from listeners of different threads need no lock.
+ */
+struct tebot_loopback {
+	struct loopback_answer answers[LOOPBACK_METHODS];
+	int size;
+	atomic_llong not_found;
+};
+
+static __thread long loopback_status;
+
+tebot_loopback_t *tebot_loopback_init ( void ) {
+	return tebot_calloc ( NULL, 1, sizeof ( tebot_loopback_t ) );
+}
+
+static struct loopback_answer *answer_new ( tebot_loopback_t *l, const char *method ) {
+	for ( int i = 0; i < l->size; i++ ) {
+		if ( !strcmp ( l->answers[i].method, method ) ) {
+			tebot_free ( NULL, l->answers[i].body );
+			l->answers[i].body = NULL;
+			l->answers[i].script = NULL;
+			return &l->answers[i];
+		}
+	}
+
+	if ( l->size == LOOPBACK_METHODS ) return NULL;
+
+	struct loopback_answer *a = &l->answers[l->size];
+	a->method = tebot_strdup ( NULL, method );
+	if ( !a->method ) return NULL;
+
+	l->size++;
+
+	return a;
+}
+
+int tebot_loopback_add ( tebot_loopback_t *l, const char *method, const long status, const char *body ) {
+	struct loopback_answer *a = answer_new ( l, method );
+	if ( !a ) return -1;
+
+	a->status = status;
+	a->body = tebot_strdup ( NULL, body ? body : "" );
+	if ( !a->body ) return -1;
+	a->size_body = strlen ( a->body );
+
+	return 0;
+}
+
+int tebot_loopback_add_script ( tebot_loopback_t *l, const char *method, tebot_loopback_script_t script, void *data ) {
+	struct loopback_answer *a = answer_new ( l, method );
+	if ( !a ) return -1;
+
+	a->script = script;
+	a->data = data;
+
+	return 0;
+}
+
+static struct loopback_answer *answer_find ( tebot_loopback_t *l, const char *method ) {
+	struct loopback_answer *any = NULL;
+
+	for ( int i = 0; i < l->size; i++ ) {
+		if ( !strcmp ( l->answers[i].method, method ) ) return &l->answers[i];
+		if ( !strcmp ( l->answers[i].method, "*" ) ) any = &l->answers[i];
+	}
+
+	return any;
+}
+
+/*
+ * whole answer is made in send, receive only gives its status.
+ */
+static int loopback_send ( tebot_handler_t *h, void *data, const tebot_request_t *req ) {
+	tebot_loopback_t *l = ( tebot_loopback_t * ) data;
+	struct loopback_answer *a = answer_find ( l, req->method );
+
+	if ( !a ) {
+		atomic_fetch_add_explicit ( &l->not_found, 1, memory_order_relaxed );
+		loopback_status = 404;
+		tebot_transport_body ( h, LOOPBACK_NOT_FOUND, sizeof ( LOOPBACK_NOT_FOUND ) - 1 );
+		return 0;
+	}
+
+	atomic_fetch_add_explicit ( &a->calls, 1, memory_order_relaxed );
+
+	if ( a->script ) {
+		loopback_status = a->script ( h, req, a->data );
+		return 0;
+	}
+
+	loopback_status = a->status;
+	if ( a->size_body ) tebot_transport_body ( h, a->body, a->size_body );
+
+	return 0;
+}
+
+static long loopback_receive ( tebot_handler_t *h, void *data ) {
+	return loopback_status;
+}
+
+void tebot_loopback_transport ( tebot_loopback_t *l, tebot_transport_t *t ) {
+	memset ( t, 0, sizeof ( tebot_transport_t ) );
+	t->send = loopback_send;
+	t->receive = loopback_receive;
+	t->data = l;
+}
+
+long long int tebot_loopback_calls ( tebot_loopback_t *l, const char *method ) {
+	if ( !method ) return atomic_load ( &l->not_found );
+
+	for ( int i = 0; i < l->size; i++ ) {
+		if ( !strcmp ( l->answers[i].method, method ) ) return atomic_load ( &l->answers[i].calls );
+	}
+
+	return 0;
+}
+
+void tebot_loopback_free ( tebot_loopback_t *l ) {
+	if ( !l ) return;
+
+	for ( int i = 0; i < l->size; i++ ) {
+		tebot_free ( NULL, l->answers[i].method );
+		tebot_free ( NULL, l->answers[i].body );
+	}
+
+	tebot_free ( NULL, l );
+}
@@ -0,0 +1,510 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include "tebot_private.h"
+
+#define HISTOGRAM_SUB_BITS        3
+#define HISTOGRAM_SUB_SIZE        ( 1 << HISTOGRAM_SUB_BITS )
+#define METRICS_TRUNCATED_SIZE    80
+
+static const char *methods[TEBOT_METRICS_METHODS] = {
+	"other",
+	"getMe",
+	"getUpdates",
+	"getFile",
+	"downloadFile",
+	"setWebhook",
+	"sendMessage",
+	"forwardMessage",
+	"copyMessage",
+	"sendPhoto",
+	"sendAudio",
+	"sendDocument",
+	"sendVideo",
+	"sendAnimation",
+	"sendVoice",
+	"sendVideoNote",
+	"sendLocation",
+	"sendVenue",
+	"sendContact",
+	"sendPoll",
+	"sendDice",
+	"sendChatAction"
+};
+
+static const char *update_types[TEBOT_UPDATE_TYPES] = {
+	"message",
+	"edited_message",
+	"channel_post",
+	"edited_channel_post",
+	"inline_query",
+	"chosen_inline_result",
+	"callback_query",
+	"shipping_query",
+	"pre_checkout_query",
+	"poll",
+	"poll_answer",
+	"my_chat_member",
+	"chat_member"
+};
+
+static const char *lag_stages[TEBOT_LAG_SIZE] = {
+	"telegram",
+	"parse",
+	"queue",
+	"handler",
+	"total"
+};
+
+static const char *phases[TEBOT_PHASE_SIZE] = {
+	"dns",
+	"connect",
+	"tls",
+	"ttfb",
+	"total"
+};
+
+struct histogram {
+	atomic_ullong count;
+	atomic_ullong sum;
+	atomic_ullong buckets[TEBOT_METRICS_BUCKETS];
+};
+
+struct method_metrics {
+	atomic_ullong requests;
+	atomic_ullong status[TEBOT_METRICS_STATUS];
+	atomic_ullong curl_error[TEBOT_METRICS_CURL_ERRORS];
+	struct histogram latency[TEBOT_PHASE_SIZE];
+};
+
+struct tebot_metrics {
+	struct method_metrics methods[TEBOT_METRICS_METHODS];
+	atomic_ullong updates[TEBOT_UPDATE_TYPES];
+	struct histogram parse;
+	atomic_ullong allocations;
+	atomic_ullong webhook_requests;
+	atomic_ullong webhook_closed;
+	atomic_ullong webhook_rejected;
+	atomic_ullong scrapes;
+	atomic_ullong truncated;
+	atomic_llong startup_listen;
+	atomic_llong startup_register;
+	struct histogram lag[TEBOT_UPDATE_TYPES][TEBOT_LAG_SIZE];
+};
+
+/*
+ * log-linear buckets as in hdr histogram: values below sub size are exact,
+ * above every power of two is split into sub size buckets.
+ */
+int tebot_histogram_bucket ( const unsigned long long int value ) {
+	if ( value < HISTOGRAM_SUB_SIZE ) return value;
+
+	const int msb = 63 - __builtin_clzll ( value );
+	const int index = ( msb - HISTOGRAM_SUB_BITS + 1 ) * HISTOGRAM_SUB_SIZE +
+		( ( value >> ( msb - HISTOGRAM_SUB_BITS ) ) & ( HISTOGRAM_SUB_SIZE - 1 ) );
+
+	return index < TEBOT_METRICS_BUCKETS ? index : TEBOT_METRICS_BUCKETS - 1;
+}
+
+unsigned long long int tebot_histogram_bucket_upper ( const int index ) {
+	if ( index < HISTOGRAM_SUB_SIZE ) return index;
+
+	const int msb = index / HISTOGRAM_SUB_SIZE + HISTOGRAM_SUB_BITS - 1;
+	const unsigned long long int sub = index % HISTOGRAM_SUB_SIZE;
+
+	return ( ( HISTOGRAM_SUB_SIZE + sub + 1 ) << ( msb - HISTOGRAM_SUB_BITS ) ) - 1;
+}
+
+unsigned long long int tebot_histogram_percentile ( const tebot_histogram_t *hg, const double percentile ) {
+	if ( hg->count == 0 ) return 0;
+
+	unsigned long long int rank = ( unsigned long long int ) ( hg->count * percentile / 100.0 );
+	if ( rank >= hg->count ) rank = hg->count - 1;
+
+	unsigned long long int seen = 0;
+	for ( int i = 0; i < TEBOT_METRICS_BUCKETS; i++ ) {
+		seen += hg->buckets[i];
+		if ( seen > rank ) return tebot_histogram_bucket_upper ( i );
+	}
+
+	return tebot_histogram_bucket_upper ( TEBOT_METRICS_BUCKETS - 1 );
+}
+
+tebot_metrics_t *tebot_metrics_init ( void ) {
+	return tebot_calloc ( NULL, 1, sizeof ( tebot_metrics_t ) );
+}
+
+void tebot_metrics_free ( tebot_metrics_t *m ) {
+	tebot_free ( NULL, m );
+}
+
+int tebot_metrics_method_index ( const char *method ) {
+	for ( int i = 1; i < TEBOT_METRICS_METHODS; i++ ) {
+		if ( methods[i] && !strcmp ( methods[i], method ) ) return i;
+	}
+
+	return 0;
+}
+
+static void histogram_add ( struct histogram *hg, const long long int value ) {
+	const unsigned long long int v = value > 0 ? value : 0;
+
+	atomic_fetch_add_explicit ( &hg->count, 1, memory_order_relaxed );
+	atomic_fetch_add_explicit ( &hg->sum, v, memory_order_relaxed );
+	atomic_fetch_add_explicit ( &hg->buckets[tebot_histogram_bucket ( v )], 1, memory_order_relaxed );
+}
+
+/*
+ * bot api answers only with a few codes, so they are counted in fixed
+ * slots. index 0 is every other code and request without answer.
+ */
+static const int status_codes[TEBOT_METRICS_STATUS] = {
+	0, 200, 400, 401, 403, 404, 409, 413, 429, 500, 502, 503
+};
+
+static int status_index ( const long status ) {
+	for ( int i = 1; i < TEBOT_METRICS_STATUS; i++ ) {
+		if ( status_codes[i] == status ) return i;
+	}
+
+	return 0;
+}
+
+int tebot_metrics_status_code ( const int index ) {
+	return index > 0 && index < TEBOT_METRICS_STATUS ? status_codes[index] : 0;
+}
+
+void tebot_metrics_record ( tebot_metrics_t *m, const int method, const long status, const CURLcode error, CURL *curl ) {
+	struct method_metrics *mm = &m->methods[method >= 0 && method < TEBOT_METRICS_METHODS ? method : 0];
+
+	atomic_fetch_add_explicit ( &mm->requests, 1, memory_order_relaxed );
+	atomic_fetch_add_explicit ( &mm->status[status_index ( status )], 1, memory_order_relaxed );
+	if ( error != CURLE_OK ) {
+		atomic_fetch_add_explicit ( &mm->curl_error[error < TEBOT_METRICS_CURL_ERRORS ? error : 0], 1, memory_order_relaxed );
+	}
+
+	if ( !curl ) return;
+
+	curl_off_t dns = 0;
+	curl_off_t connect = 0;
+	curl_off_t tls = 0;
+	curl_off_t ttfb = 0;
+	curl_off_t total = 0;
+
+	curl_easy_getinfo ( curl, CURLINFO_NAMELOOKUP_TIME_T, &dns );
+	curl_easy_getinfo ( curl, CURLINFO_CONNECT_TIME_T, &connect );
+	curl_easy_getinfo ( curl, CURLINFO_APPCONNECT_TIME_T, &tls );
+	curl_easy_getinfo ( curl, CURLINFO_STARTTRANSFER_TIME_T, &ttfb );
+	curl_easy_getinfo ( curl, CURLINFO_TOTAL_TIME_T, &total );
+
+	/*
+	 * curl gives time from the start for every phase, so take the difference.
+	 */
+	const curl_off_t connected = tls > 0 ? tls : connect;
+
+	histogram_add ( &mm->latency[TEBOT_PHASE_DNS], dns );
+	histogram_add ( &mm->latency[TEBOT_PHASE_CONNECT], connect > dns ? connect - dns : 0 );
+	histogram_add ( &mm->latency[TEBOT_PHASE_TLS], tls > connect ? tls - connect : 0 );
+	histogram_add ( &mm->latency[TEBOT_PHASE_TTFB], ttfb > connected ? ttfb - connected : 0 );
+	histogram_add ( &mm->latency[TEBOT_PHASE_TOTAL], total );
+}
+
+int tebot_update_type ( tebot_update_t *u ) {
+	const void *types[TEBOT_UPDATE_TYPES] = {
+		u->message,
+		u->edited_message,
+		u->channel_post,
+		u->edited_channel_post,
+		u->inline_query,
+		u->chosen_inline_result,
+		u->callback_query,
+		u->shipping_query,
+		u->pre_checkout_query,
+		u->poll,
+		u->poll_answer,
+		u->my_chat_member,
+		u->chat_member
+	};
+
+	for ( int n = 0; n < TEBOT_UPDATE_TYPES; n++ ) {
+		if ( types[n] ) return n;
+	}
+
+	return -1;
+}
+
+/*
+ * only messages and chat member updates have date, for others it is 0.
+ */
+long long int tebot_update_date ( tebot_update_t *u ) {
+	if ( u->message ) return u->message->date;
+	if ( u->edited_message ) return u->edited_message->date;
+	if ( u->channel_post ) return u->channel_post->date;
+	if ( u->edited_channel_post ) return u->edited_channel_post->date;
+	if ( u->my_chat_member ) return u->my_chat_member->date;
+	if ( u->chat_member ) return u->chat_member->date;
+
+	return 0;
+}
+
+void tebot_metrics_record_parse ( tebot_metrics_t *m, tebot_result_updated_t *t, const long long int usec, const int allocations ) {
+	histogram_add ( &m->parse, usec );
+	atomic_fetch_add_explicit ( &m->allocations, allocations, memory_order_relaxed );
+
+	if ( !t ) return;
+
+	for ( int i = 0; i < t->size; i++ ) {
+		if ( !t->update[i] ) continue;
+
+		const int type = tebot_update_type ( t->update[i] );
+		if ( type >= 0 ) atomic_fetch_add_explicit ( &m->updates[type], 1, memory_order_relaxed );
+	}
+}
+
+void tebot_metrics_record_lag ( tebot_metrics_t *m, tebot_update_t *u ) {
+	const int type = tebot_update_type ( u );
+	if ( type < 0 ) return;
+
+	struct histogram *lag = m->lag[type];
+	tebot_update_timing_t *tm = &u->timing;
+	const long long int date = tebot_update_date ( u ) * 1000000LL;
+	const long long int dispatched = tm->dispatched ? tm->dispatched : tm->parsed;
+
+	if ( date ) {
+		histogram_add ( &lag[TEBOT_LAG_TELEGRAM], tm->received - date );
+		histogram_add ( &lag[TEBOT_LAG_TOTAL], tm->finished - date );
+	}
+	histogram_add ( &lag[TEBOT_LAG_PARSE], tm->parsed - tm->received );
+	histogram_add ( &lag[TEBOT_LAG_QUEUE], dispatched - tm->parsed );
+	histogram_add ( &lag[TEBOT_LAG_HANDLER], tm->finished - dispatched );
+}
+
+void tebot_metrics_record_webhook ( tebot_metrics_t *m, const int is_disconnect ) {
+	atomic_fetch_add_explicit ( &m->webhook_requests, 1, memory_order_relaxed );
+	if ( is_disconnect ) atomic_fetch_add_explicit ( &m->webhook_closed, 1, memory_order_relaxed );
+}
+
+void tebot_metrics_record_rejected ( tebot_metrics_t *m ) {
+	atomic_fetch_add_explicit ( &m->webhook_rejected, 1, memory_order_relaxed );
+}
+
+void tebot_metrics_record_startup ( tebot_metrics_t *m, const long long int listen_usec, const long long int register_usec ) {
+	atomic_store_explicit ( &m->startup_listen, listen_usec, memory_order_relaxed );
+	atomic_store_explicit ( &m->startup_register, register_usec, memory_order_relaxed );
+}
+
+static void histogram_copy ( tebot_histogram_t *dst, struct histogram *src ) {
+	dst->count = atomic_load_explicit ( &src->count, memory_order_relaxed );
+	dst->sum = atomic_load_explicit ( &src->sum, memory_order_relaxed );
+	for ( int i = 0; i < TEBOT_METRICS_BUCKETS; i++ ) {
+		dst->buckets[i] = atomic_load_explicit ( &src->buckets[i], memory_order_relaxed );
+	}
+}
+
+void tebot_metrics_snapshot ( tebot_metrics_t *m, tebot_metrics_snapshot_t *s ) {
+	s->size = TEBOT_METRICS_METHODS;
+
+	for ( int n = 0; n < TEBOT_METRICS_METHODS; n++ ) {
+		struct method_metrics *mm = &m->methods[n];
+		tebot_method_metrics_t *out = &s->methods[n];
+
+		out->method = methods[n] ? methods[n] : "";
+		out->requests = atomic_load_explicit ( &mm->requests, memory_order_relaxed );
+
+		for ( int i = 0; i < TEBOT_METRICS_STATUS; i++ ) {
+			out->status[i] = atomic_load_explicit ( &mm->status[i], memory_order_relaxed );
+		}
+
+		for ( int i = 0; i < TEBOT_METRICS_CURL_ERRORS; i++ ) {
+			out->curl_error[i] = atomic_load_explicit ( &mm->curl_error[i], memory_order_relaxed );
+		}
+
+		for ( int i = 0; i < TEBOT_PHASE_SIZE; i++ ) {
+			histogram_copy ( &out->latency[i], &mm->latency[i] );
+		}
+	}
+
+	for ( int i = 0; i < TEBOT_UPDATE_TYPES; i++ ) {
+		s->updates[i] = atomic_load_explicit ( &m->updates[i], memory_order_relaxed );
+	}
+	histogram_copy ( &s->parse, &m->parse );
+	s->allocations = atomic_load_explicit ( &m->allocations, memory_order_relaxed );
+	s->webhook_requests = atomic_load_explicit ( &m->webhook_requests, memory_order_relaxed );
+	s->webhook_closed = atomic_load_explicit ( &m->webhook_closed, memory_order_relaxed );
+	s->webhook_rejected = atomic_load_explicit ( &m->webhook_rejected, memory_order_relaxed );
+	s->startup_listen = atomic_load_explicit ( &m->startup_listen, memory_order_relaxed );
+	s->startup_register = atomic_load_explicit ( &m->startup_register, memory_order_relaxed );
+
+	for ( int n = 0; n < TEBOT_UPDATE_TYPES; n++ ) {
+		for ( int i = 0; i < TEBOT_LAG_SIZE; i++ ) {
+			histogram_copy ( &s->lag[n][i], &m->lag[n][i] );
+		}
+	}
+}
+
+struct out {
+	char *buf;
+	size_t size;
+	size_t length;
+};
+
+static void out_printf ( struct out *o, const char *fmt, ... ) {
+	if ( o->length >= o->size ) return;
+
+	va_list ap;
+
+	va_start ( ap, fmt );
+	int ret = vsnprintf ( &o->buf[o->length], o->size - o->length, fmt, ap );
+	va_end ( ap );
+
+	if ( ret > 0 ) o->length += ret;
+	if ( o->length > o->size ) o->length = o->size;
+}
+
+static void out_summary ( struct out *o, const char *name, const char *labels, struct histogram *src ) {
+	tebot_histogram_t hg;
+	histogram_copy ( &hg, src );
+	if ( hg.count == 0 ) return;
+
+	const double quantiles[] = { 0.5, 0.9, 0.99 };
+	for ( int i = 0; i < sizeof ( quantiles ) / sizeof ( double ); i++ ) {
+		out_printf ( o, "%s{%s%squantile=\"%g\"} %llu\n", name, labels, *labels ? "," : "", quantiles[i],
+				tebot_histogram_percentile ( &hg, quantiles[i] * 100.0 ) );
+	}
+	if ( *labels ) {
+		out_printf ( o, "%s_sum{%s} %llu\n", name, labels, hg.sum );
+		out_printf ( o, "%s_count{%s} %llu\n", name, labels, hg.count );
+	} else {
+		out_printf ( o, "%s_sum %llu\n", name, hg.sum );
+		out_printf ( o, "%s_count %llu\n", name, hg.count );
+	}
+}
+
+/*
+ * reads only counters, so it is safe to call from any thread while
+ * updates are handled.
+ */
+size_t tebot_metrics_prometheus ( tebot_handler_t *h, char *buf, const size_t size ) {
+	tebot_metrics_t *m = h->metrics;
+	char labels[128];
+
+	if ( !m || size <= METRICS_TRUNCATED_SIZE ) return 0;
+
+	struct out o = { buf, size - METRICS_TRUNCATED_SIZE, 0 };
+
+	atomic_fetch_add_explicit ( &m->scrapes, 1, memory_order_relaxed );
+
+	/*
+	 * counters of fixed size go first, so only per method and per type
+	 * series can be cut when buffer is full. the cut is shown in
+	 * tebot_metrics_truncated, not hidden.
+	 */
+	out_printf ( &o, "# TYPE tebot_parse_allocations_total counter\n" );
+	out_printf ( &o, "tebot_parse_allocations_total %llu\n", atomic_load_explicit ( &m->allocations, memory_order_relaxed ) );
+
+	out_printf ( &o, "# TYPE tebot_queue_depth gauge\n" );
+	if ( h->logger ) out_printf ( &o, "tebot_queue_depth{queue=\"log\"} %lld\n", tebot_logger_depth ( h->logger ) );
+	if ( h->journal ) out_printf ( &o, "tebot_queue_depth{queue=\"journal_bytes\"} %lld\n", tebot_journal_queue_size ( h->journal ) );
+	if ( h->offsets ) out_printf ( &o, "tebot_queue_depth{queue=\"not_acked\"} %lld\n", tebot_offset_store_pending ( h->offsets ) );
+
+	out_printf ( &o, "# TYPE tebot_log_dropped_total counter\n" );
+	out_printf ( &o, "tebot_log_dropped_total %lld\n", h->logger ? tebot_logger_dropped ( h->logger ) : 0 );
+
+	out_printf ( &o, "# TYPE tebot_webhook_requests_total counter\n" );
+	out_printf ( &o, "tebot_webhook_requests_total %llu\n", atomic_load_explicit ( &m->webhook_requests, memory_order_relaxed ) );
+	out_printf ( &o, "# TYPE tebot_webhook_connections_closed_total counter\n" );
+	out_printf ( &o, "tebot_webhook_connections_closed_total %llu\n", atomic_load_explicit ( &m->webhook_closed, memory_order_relaxed ) );
+	out_printf ( &o, "# TYPE tebot_webhook_rejected_total counter\n" );
+	out_printf ( &o, "tebot_webhook_rejected_total %llu\n", atomic_load_explicit ( &m->webhook_rejected, memory_order_relaxed ) );
+	out_printf ( &o, "# TYPE tebot_webhook_startup_microseconds gauge\n" );
+	out_printf ( &o, "tebot_webhook_startup_microseconds{stage=\"listen\"} %lld\n",
+			atomic_load_explicit ( &m->startup_listen, memory_order_relaxed ) );
+	out_printf ( &o, "tebot_webhook_startup_microseconds{stage=\"register\"} %lld\n",
+			atomic_load_explicit ( &m->startup_register, memory_order_relaxed ) );
+	out_printf ( &o, "# TYPE tebot_metrics_scrapes_total counter\n" );
+	out_printf ( &o, "tebot_metrics_scrapes_total %llu\n", atomic_load_explicit ( &m->scrapes, memory_order_relaxed ) );
+	out_printf ( &o, "# TYPE tebot_metrics_truncated_total counter\n" );
+	out_printf ( &o, "tebot_metrics_truncated_total %llu\n", atomic_load_explicit ( &m->truncated, memory_order_relaxed ) );
+
+	out_printf ( &o, "# TYPE tebot_updates_received_total counter\n" );
+	for ( int i = 0; i < TEBOT_UPDATE_TYPES; i++ ) {
+		out_printf ( &o, "tebot_updates_received_total{type=\"%s\"} %llu\n", update_types[i],
+				atomic_load_explicit ( &m->updates[i], memory_order_relaxed ) );
+	}
+
+	out_printf ( &o, "# TYPE tebot_requests_total counter\n" );
+	for ( int n = 0; n < TEBOT_METRICS_METHODS; n++ ) {
+		if ( !methods[n] ) continue;
+		for ( int i = 0; i < TEBOT_METRICS_STATUS; i++ ) {
+			unsigned long long int v = atomic_load_explicit ( &m->methods[n].status[i], memory_order_relaxed );
+			if ( !v ) continue;
+			if ( i == 0 ) out_printf ( &o, "tebot_requests_total{method=\"%s\",code=\"other\"} %llu\n", methods[n], v );
+			else out_printf ( &o, "tebot_requests_total{method=\"%s\",code=\"%d\"} %llu\n", methods[n], status_codes[i], v );
+		}
+	}
+
+	out_printf ( &o, "# TYPE tebot_request_errors_total counter\n" );
+	for ( int n = 0; n < TEBOT_METRICS_METHODS; n++ ) {
+		if ( !methods[n] ) continue;
+		for ( int i = 0; i < TEBOT_METRICS_CURL_ERRORS; i++ ) {
+			unsigned long long int v = atomic_load_explicit ( &m->methods[n].curl_error[i], memory_order_relaxed );
+			if ( v ) out_printf ( &o, "tebot_request_errors_total{method=\"%s\",error=\"%d\"} %llu\n", methods[n], i, v );
+		}
+	}
+
+	out_printf ( &o, "# TYPE tebot_request_duration_microseconds summary\n" );
+	for ( int n = 0; n < TEBOT_METRICS_METHODS; n++ ) {
+		if ( !methods[n] || !atomic_load_explicit ( &m->methods[n].requests, memory_order_relaxed ) ) continue;
+		for ( int i = 0; i < TEBOT_PHASE_SIZE; i++ ) {
+			snprintf ( labels, sizeof ( labels ), "method=\"%s\",phase=\"%s\"", methods[n], phases[i] );
+			out_summary ( &o, "tebot_request_duration_microseconds", labels, &m->methods[n].latency[i] );
+		}
+	}
+
+	out_printf ( &o, "# TYPE tebot_update_lag_microseconds summary\n" );
+	for ( int n = 0; n < TEBOT_UPDATE_TYPES; n++ ) {
+		for ( int i = 0; i < TEBOT_LAG_SIZE; i++ ) {
+			snprintf ( labels, sizeof ( labels ), "type=\"%s\",stage=\"%s\"", update_types[n], lag_stages[i] );
+			out_summary ( &o, "tebot_update_lag_microseconds", labels, &m->lag[n][i] );
+		}
+	}
+
+	out_printf ( &o, "# TYPE tebot_parse_duration_microseconds summary\n" );
+	out_summary ( &o, "tebot_parse_duration_microseconds", "", &m->parse );
+
+	int is_truncated = 0;
+	size_t length = o.length;
+	if ( length >= o.size - 1 ) {
+		is_truncated = 1;
+		length = o.size - 1;
+		while ( length > 0 && buf[length - 1] != '\n' ) length--;
+		atomic_fetch_add_explicit ( &m->truncated, 1, memory_order_relaxed );
+	}
+
+	int ret = snprintf ( &buf[length], size - length, "# TYPE tebot_metrics_truncated gauge\n"
+			"tebot_metrics_truncated %d\n", is_truncated );
+	if ( ret > 0 && length + ret < size ) length += ret;
+
+	return length;
+}
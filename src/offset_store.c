@@ -0,0 +1,204 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include "tebot_private.h"
+
+#define OFFSET_MAGIC              "TEBOTOF1"
+
+struct offset_record {
+	char magic[8];
+	long long int committed;
+};
+
+struct pending {
+	long long int update_id;
+	int is_acked;
+};
+
+/*
+ * updates are kept in the order they were given to application. committed
+ * moves while the head of queue is acked, so gaps in update_id don't stop it.
+ */
+struct tebot_offset_store {
+	pthread_mutex_t mutex;
+	int fd;
+	int commit_every;
+	int not_flushed;
+	long long int committed;
+	long long int flushed;
+	long long int dispatched;
+	struct pending *queue;
+	int head;
+	int size;
+	int capacity;
+};
+
+tebot_offset_store_t *tebot_offset_store_init ( const char *path, const int commit_every ) {
+	tebot_offset_store_t *os = tebot_calloc ( NULL, 1, sizeof ( tebot_offset_store_t ) );
+	if ( !os ) return NULL;
+
+	os->commit_every = commit_every > 0 ? commit_every : 1;
+	os->fd = -1;
+
+	if ( path ) {
+		os->fd = open ( path, O_RDWR | O_CREAT, 0644 );
+		if ( os->fd == -1 ) {
+			tebot_free ( NULL, os );
+			return NULL;
+		}
+
+		struct offset_record r;
+		if ( pread ( os->fd, &r, sizeof ( r ), 0 ) == sizeof ( r ) &&
+				!memcmp ( r.magic, OFFSET_MAGIC, sizeof ( r.magic ) ) ) {
+			os->committed = r.committed;
+		}
+	}
+
+	os->flushed = os->committed;
+	os->dispatched = os->committed;
+	pthread_mutex_init ( &os->mutex, NULL );
+
+	return os;
+}
+
+static int flush ( tebot_offset_store_t *os ) {
+	os->not_flushed = 0;
+	if ( os->fd == -1 || os->flushed == os->committed ) return 0;
+
+	struct offset_record r;
+	memcpy ( r.magic, OFFSET_MAGIC, sizeof ( r.magic ) );
+	r.committed = os->committed;
+
+	if ( pwrite ( os->fd, &r, sizeof ( r ), 0 ) != sizeof ( r ) ) return -1;
+	if ( fdatasync ( os->fd ) == -1 ) return -1;
+
+	os->flushed = r.committed;
+
+	return 0;
+}
+
+int tebot_offset_store_flush ( tebot_offset_store_t *os ) {
+	pthread_mutex_lock ( &os->mutex );
+	int ret = flush ( os );
+	pthread_mutex_unlock ( &os->mutex );
+
+	return ret;
+}
+
+long long int tebot_offset_store_committed ( tebot_offset_store_t *os ) {
+	pthread_mutex_lock ( &os->mutex );
+	long long int committed = os->committed;
+	pthread_mutex_unlock ( &os->mutex );
+
+	return committed;
+}
+
+long long int tebot_offset_store_pending ( tebot_offset_store_t *os ) {
+	pthread_mutex_lock ( &os->mutex );
+	long long int size = os->size;
+	pthread_mutex_unlock ( &os->mutex );
+
+	return size;
+}
+
+/*
+ * returns 1 if update was already given to application and must be
+ * skipped, -1 if it could not be queued and was not given out.
+ */
+int tebot_offset_store_dispatch ( tebot_offset_store_t *os, const long long int update_id ) {
+	int ret = 0;
+
+	pthread_mutex_lock ( &os->mutex );
+
+	if ( update_id <= os->dispatched ) {
+		ret = 1;
+		goto tebot_offset_store_dispatch_exit;
+	}
+
+	if ( os->size == os->capacity ) {
+		int capacity = os->capacity ? os->capacity * 2 : 128;
+		struct pending *queue = tebot_calloc ( NULL, capacity, sizeof ( struct pending ) );
+		if ( !queue ) {
+			ret = -1;
+			goto tebot_offset_store_dispatch_exit;
+		}
+
+		for ( int i = 0; i < os->size; i++ ) {
+			queue[i] = os->queue[( os->head + i ) % os->capacity];
+		}
+
+		tebot_free ( NULL, os->queue );
+		os->queue = queue;
+		os->capacity = capacity;
+		os->head = 0;
+	}
+
+	struct pending *p = &os->queue[( os->head + os->size ) % os->capacity];
+	p->update_id = update_id;
+	p->is_acked = 0;
+	os->size++;
+	os->dispatched = update_id;
+
+tebot_offset_store_dispatch_exit:
+	pthread_mutex_unlock ( &os->mutex );
+
+	return ret;
+}
+
+int tebot_offset_store_ack ( tebot_offset_store_t *os, const long long int update_id ) {
+	int ret = 0;
+
+	pthread_mutex_lock ( &os->mutex );
+
+	for ( int i = 0; i < os->size; i++ ) {
+		struct pending *p = &os->queue[( os->head + i ) % os->capacity];
+		if ( p->update_id == update_id ) {
+			p->is_acked = 1;
+			break;
+		}
+	}
+
+	while ( os->size > 0 && os->queue[os->head].is_acked ) {
+		os->committed = os->queue[os->head].update_id;
+		os->head = ( os->head + 1 ) % os->capacity;
+		os->size--;
+		os->not_flushed++;
+	}
+
+	if ( os->not_flushed >= os->commit_every ) ret = flush ( os );
+
+	pthread_mutex_unlock ( &os->mutex );
+
+	return ret;
+}
+
+void tebot_offset_store_free ( tebot_offset_store_t *os ) {
+	if ( !os ) return;
+
+	flush ( os );
+	if ( os->fd != -1 ) close ( os->fd );
+	pthread_mutex_destroy ( &os->mutex );
+	tebot_free ( NULL, os->queue );
+	tebot_free ( NULL, os );
+}
@@ -0,0 +1,381 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "tebot.h"
+
+/*
+ * upper bit of transition marks the state which has any output,
+ * so the scan loop touches only delta for the most of bytes.
+ */
+#define MATCH_BIT                 ( ( int32_t ) 0x40000000 )
+
+/*
+ * automaton is immutable after compile. scanners hold a reference while
+ * scanning, so reload only swaps the pointer and the old one is freed
+ * by the last reader.
+ */
+struct automaton {
+	int flags;
+	int size_classes;
+	int size_states;
+	uint16_t classes[256];
+	int32_t *delta;
+	int32_t *out;
+	int32_t *dict;
+	int32_t *pattern_next;
+	long long int *pattern_length;
+	int size_patterns;
+	int refs;
+};
+
+struct tebot_scanner {
+	pthread_mutex_t mutex;
+	struct automaton *am;
+};
+
+static unsigned int fold_codepoint ( unsigned int cp ) {
+	if ( cp >= 'A' && cp <= 'Z' ) return cp + 0x20;
+	if ( cp >= 0xc0 && cp <= 0xde && cp != 0xd7 ) return cp + 0x20;
+	if ( cp >= 0x391 && cp <= 0x3a9 && cp != 0x3a2 ) return cp + 0x20;
+	if ( cp >= 0x400 && cp <= 0x40f ) return cp + 0x50;
+	if ( cp >= 0x410 && cp <= 0x42f ) return cp + 0x20;
+
+	return cp;
+}
+
+/*
+ * every fold above keeps the length of utf-8 sequence, so offsets
+ * in the folded text are the same as in the original one.
+ */
+static int fold_utf8 ( const unsigned char *src, const long long int length, long long int i, unsigned char *dst ) {
+	unsigned char c = src[i];
+
+	if ( c < 0x80 ) {
+		dst[0] = fold_codepoint ( c );
+		return 1;
+	}
+
+	if ( ( c & 0xe0 ) == 0xc0 && i + 1 < length && ( src[i + 1] & 0xc0 ) == 0x80 ) {
+		unsigned int cp = ( ( c & 0x1f ) << 6 ) | ( src[i + 1] & 0x3f );
+		cp = fold_codepoint ( cp );
+		dst[0] = 0xc0 | ( cp >> 6 );
+		dst[1] = 0x80 | ( cp & 0x3f );
+		return 2;
+	}
+
+	dst[0] = c;
+	return 1;
+}
+
+static void automaton_free ( struct automaton *am ) {
+	if ( !am ) return;
+
+	tebot_free ( NULL, am->delta );
+	tebot_free ( NULL, am->out );
+	tebot_free ( NULL, am->dict );
+	tebot_free ( NULL, am->pattern_next );
+	tebot_free ( NULL, am->pattern_length );
+	tebot_free ( NULL, am );
+}
+
+static struct automaton *automaton_compile ( const char **patterns, const int size, const int flags ) {
+	struct automaton *am = tebot_calloc ( NULL, 1, sizeof ( struct automaton ) );
+	if ( !am ) return NULL;
+
+	am->flags = flags;
+	am->size_patterns = size;
+
+	unsigned char **folded = tebot_calloc ( NULL, size + 1, sizeof ( unsigned char * ) );
+	am->pattern_next = tebot_malloc ( NULL, sizeof ( int32_t ) * ( size + 1 ) );
+	am->pattern_length = tebot_calloc ( NULL, size + 1, sizeof ( long long int ) );
+	if ( !folded || !am->pattern_next || !am->pattern_length ) goto automaton_compile_error;
+
+	long long int max_states = 1;
+
+	for ( int i = 0; i < size; i++ ) {
+		const unsigned char *p = ( const unsigned char * ) patterns[i];
+		const long long int length = strlen ( patterns[i] );
+
+		folded[i] = tebot_malloc ( NULL, length + 1 );
+		if ( !folded[i] ) goto automaton_compile_error;
+
+		if ( flags & TEBOT_SCANNER_CASE_INSENSITIVE ) {
+			for ( long long int n = 0; n < length; ) {
+				n += fold_utf8 ( p, length, n, &folded[i][n] );
+			}
+		} else {
+			memcpy ( folded[i], p, length );
+		}
+		folded[i][length] = 0;
+
+		am->pattern_length[i] = length;
+		max_states += length;
+
+		for ( long long int n = 0; n < length; n++ ) {
+			if ( !am->classes[folded[i][n]] ) am->classes[folded[i][n]] = ++am->size_classes;
+		}
+	}
+
+	am->size_classes++;
+	if ( max_states > MATCH_BIT / am->size_classes ) goto automaton_compile_error;
+
+	am->delta = tebot_malloc ( NULL, sizeof ( int32_t ) * max_states * am->size_classes );
+	am->out = tebot_malloc ( NULL, sizeof ( int32_t ) * max_states );
+	am->dict = tebot_malloc ( NULL, sizeof ( int32_t ) * max_states );
+	if ( !am->delta || !am->out || !am->dict ) goto automaton_compile_error;
+
+	memset ( am->delta, 0xff, sizeof ( int32_t ) * max_states * am->size_classes );
+	memset ( am->out, 0xff, sizeof ( int32_t ) * max_states );
+	memset ( am->dict, 0xff, sizeof ( int32_t ) * max_states );
+	am->size_states = 1;
+
+	const int n = am->size_classes;
+
+	for ( int i = 0; i < size; i++ ) {
+		int32_t s = 0;
+		if ( am->pattern_length[i] == 0 ) {
+			am->pattern_next[i] = -1;
+			continue;
+		}
+
+		for ( long long int c = 0; c < am->pattern_length[i]; c++ ) {
+			int32_t *next = &am->delta[s * n + am->classes[folded[i][c]]];
+			if ( *next < 0 ) *next = am->size_states++;
+			s = *next;
+		}
+
+		am->pattern_next[i] = am->out[s];
+		am->out[s] = i;
+	}
+
+	int32_t *fail = tebot_malloc ( NULL, sizeof ( int32_t ) * am->size_states );
+	int32_t *queue = tebot_malloc ( NULL, sizeof ( int32_t ) * am->size_states );
+	if ( !fail || !queue ) {
+		tebot_free ( NULL, fail );
+		tebot_free ( NULL, queue );
+		goto automaton_compile_error;
+	}
+
+	int head = 0;
+	int tail = 0;
+	fail[0] = 0;
+	queue[tail++] = 0;
+
+	while ( head < tail ) {
+		int32_t r = queue[head++];
+
+		for ( int a = 0; a < n; a++ ) {
+			int32_t u = am->delta[r * n + a];
+			if ( u < 0 ) {
+				am->delta[r * n + a] = r == 0 ? 0 : am->delta[fail[r] * n + a];
+				continue;
+			}
+
+			fail[u] = r == 0 ? 0 : am->delta[fail[r] * n + a];
+			am->dict[u] = am->out[fail[u]] >= 0 ? fail[u] : am->dict[fail[u]];
+			queue[tail++] = u;
+		}
+	}
+
+	tebot_free ( NULL, fail );
+	tebot_free ( NULL, queue );
+
+	for ( long long int i = 0; i < ( long long int ) am->size_states * n; i++ ) {
+		int32_t u = am->delta[i];
+		if ( am->out[u] >= 0 || am->dict[u] >= 0 ) am->delta[i] = u | MATCH_BIT;
+	}
+
+	int32_t *delta = tebot_realloc ( NULL, am->delta, sizeof ( int32_t ) * am->size_states * n );
+	if ( delta ) am->delta = delta;
+
+	for ( int i = 0; i < size; i++ ) tebot_free ( NULL, folded[i] );
+	tebot_free ( NULL, folded );
+
+	return am;
+
+automaton_compile_error:
+	if ( folded ) {
+		for ( int i = 0; i < size; i++ ) tebot_free ( NULL, folded[i] );
+		tebot_free ( NULL, folded );
+	}
+	automaton_free ( am );
+	return NULL;
+}
+
+static struct automaton *acquire ( tebot_scanner_t *s ) {
+	pthread_mutex_lock ( &s->mutex );
+	struct automaton *am = s->am;
+	am->refs++;
+	pthread_mutex_unlock ( &s->mutex );
+
+	return am;
+}
+
+static void release ( tebot_scanner_t *s, struct automaton *am ) {
+	pthread_mutex_lock ( &s->mutex );
+	int refs = --am->refs;
+	pthread_mutex_unlock ( &s->mutex );
+
+	if ( refs == 0 ) automaton_free ( am );
+}
+
+static long long int automaton_scan ( struct automaton *am, const char *text, const long long int length,
+		tebot_scanner_match_t *m, tebot_scanner_cb cb, void *userdata, int *stop ) {
+
+	const unsigned char *p = ( const unsigned char * ) text;
+	const int n = am->size_classes;
+	const int fold = am->flags & TEBOT_SCANNER_CASE_INSENSITIVE;
+	long long int count = 0;
+	int32_t s = 0;
+
+	for ( long long int i = 0; i < length; ) {
+		unsigned char buf[2];
+		int size_buf = 1;
+
+		if ( fold ) size_buf = fold_utf8 ( p, length, i, buf );
+		else buf[0] = p[i];
+
+		for ( int b = 0; b < size_buf; b++ ) {
+			int32_t next = am->delta[s * n + am->classes[buf[b]]];
+			s = next & ~MATCH_BIT;
+			if ( !( next & MATCH_BIT ) ) continue;
+
+			int32_t t = am->out[s] >= 0 ? s : am->dict[s];
+			while ( t > 0 ) {
+				for ( int32_t pid = am->out[t]; pid >= 0; pid = am->pattern_next[pid] ) {
+					count++;
+					if ( !cb ) continue;
+
+					m->pattern_id = pid;
+					m->length = am->pattern_length[pid];
+					m->offset = i + b + 1 - m->length;
+					if ( cb ( userdata, m ) ) {
+						*stop = 1;
+						return count;
+					}
+				}
+				t = am->dict[t];
+			}
+		}
+
+		i += size_buf;
+	}
+
+	return count;
+}
+
+tebot_scanner_t *tebot_scanner_init ( const char **patterns, const int size, const int flags ) {
+	tebot_scanner_t *s = tebot_calloc ( NULL, 1, sizeof ( tebot_scanner_t ) );
+	if ( !s ) return NULL;
+
+	s->am = automaton_compile ( patterns, size, flags );
+	if ( !s->am ) {
+		tebot_free ( NULL, s );
+		return NULL;
+	}
+	s->am->refs = 1;
+
+	pthread_mutex_init ( &s->mutex, NULL );
+
+	return s;
+}
+
+int tebot_scanner_reload ( tebot_scanner_t *s, const char **patterns, const int size, const int flags ) {
+	struct automaton *am = automaton_compile ( patterns, size, flags );
+	if ( !am ) return -1;
+	am->refs = 1;
+
+	pthread_mutex_lock ( &s->mutex );
+	struct automaton *old = s->am;
+	s->am = am;
+	pthread_mutex_unlock ( &s->mutex );
+
+	release ( s, old );
+
+	return 0;
+}
+
+long long int tebot_scanner_scan ( tebot_scanner_t *s, const char *text, const long long int length,
+		tebot_scanner_cb cb, void *userdata ) {
+
+	if ( !text ) return 0;
+
+	tebot_scanner_match_t m = { .update_index = -1 };
+	int stop = 0;
+
+	struct automaton *am = acquire ( s );
+	long long int count = automaton_scan ( am, text, length < 0 ? strlen ( text ) : length, &m, cb, userdata, &stop );
+	release ( s, am );
+
+	return count;
+}
+
+long long int tebot_scanner_scan_update ( tebot_scanner_t *s, tebot_result_updated_t *t, tebot_scanner_cb cb, void *userdata ) {
+	if ( !t ) return 0;
+
+	long long int count = 0;
+	int stop = 0;
+
+	struct automaton *am = acquire ( s );
+
+	for ( int i = 0; i < t->size && !stop; i++ ) {
+		tebot_update_t *u = t->update[i];
+		if ( !u ) continue;
+
+		tebot_message_t *messages[] = {
+			u->message,
+			u->edited_message,
+			u->channel_post,
+			u->edited_channel_post
+		};
+
+		for ( int k = 0; k < sizeof ( messages ) / sizeof ( tebot_message_t * ) && !stop; k++ ) {
+			tebot_message_t *msg = messages[k];
+			if ( !msg ) continue;
+
+			tebot_scanner_match_t m = { .update_index = i, .message = msg };
+
+			if ( msg->text ) {
+				m.field = "text";
+				count += automaton_scan ( am, msg->text, strlen ( msg->text ), &m, cb, userdata, &stop );
+			}
+
+			if ( msg->caption && !stop ) {
+				m.field = "caption";
+				count += automaton_scan ( am, msg->caption, strlen ( msg->caption ), &m, cb, userdata, &stop );
+			}
+		}
+	}
+
+	release ( s, am );
+
+	return count;
+}
+
+void tebot_scanner_free ( tebot_scanner_t *s ) {
+	if ( !s ) return;
+
+	automaton_free ( s->am );
+	pthread_mutex_destroy ( &s->mutex );
+	tebot_free ( NULL, s );
+}
@@ -0,0 +1,588 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
+#include "tebot.h"
+
+#define SLOT_EMPTY                0
+#define SLOT_USED                 1
+#define SLOT_DELETED              2
+
+#define WHEEL_SIZE                1024
+
+#define SNAPSHOT_MAGIC            "TEBOTSS1"
+#define SNAPSHOT_BUF_SIZE         ( 1024 * 1024 )
+
+struct slot {
+	long long int chat_id;
+	long long int user_id;
+	long long int expire;
+	long long int timer;
+	int state;
+};
+
+struct timer {
+	long long int chat_id;
+	long long int user_id;
+	long long int at;
+};
+
+struct wheel_slot {
+	struct timer *timers;
+	int size;
+	int capacity;
+};
+
+struct shard {
+	pthread_rwlock_t lock;
+	struct slot *slots;
+	unsigned char *values;
+	long long int capacity;
+	long long int used;
+	long long int deleted;
+	struct wheel_slot wheel[WHEEL_SIZE];
+	long long int last_tick;
+};
+
+struct tebot_state_store {
+	int value_size;
+	int size_shards;
+	int shard_bits;
+	long long int default_ttl;
+	char *snapshot_file;
+	long long int snapshot_interval;
+	long long int last_snapshot;
+	struct shard *shards;
+};
+
+/*
+ * record in snapshot file is fixed size, so file can be mapped and read
+ * without parsing.
+ */
+struct snapshot_header {
+	char magic[8];
+	int value_size;
+	int reserved;
+	long long int count;
+};
+
+struct snapshot_record {
+	long long int chat_id;
+	long long int user_id;
+	long long int expire;
+};
+
+static inline uint64_t hash_key ( const long long int chat_id, const long long int user_id ) {
+	uint64_t x = ( uint64_t ) chat_id * 0x9e3779b97f4a7c15ULL ^ ( uint64_t ) user_id;
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+
+	return x;
+}
+
+static inline struct shard *get_shard ( tebot_state_store_t *st, const uint64_t hash ) {
+	if ( st->shard_bits == 0 ) return &st->shards[0];
+	return &st->shards[hash >> ( 64 - st->shard_bits )];
+}
+
+static long long int find_slot ( struct shard *sh, const uint64_t hash, const long long int chat_id, const long long int user_id ) {
+	const long long int mask = sh->capacity - 1;
+
+	for ( long long int i = hash & mask, n = 0; n < sh->capacity; i = ( i + 1 ) & mask, n++ ) {
+		struct slot *s = &sh->slots[i];
+		if ( s->state == SLOT_EMPTY ) return -1;
+		if ( s->state == SLOT_USED && s->chat_id == chat_id && s->user_id == user_id ) return i;
+	}
+
+	return -1;
+}
+
+static int shard_alloc ( struct shard *sh, const long long int capacity, const int value_size ) {
+	sh->slots = tebot_calloc ( NULL, capacity, sizeof ( struct slot ) );
+	sh->values = tebot_calloc ( NULL, capacity, value_size );
+	if ( !sh->slots || !sh->values ) {
+		tebot_free ( NULL, sh->slots );
+		tebot_free ( NULL, sh->values );
+		return -1;
+	}
+
+	sh->capacity = capacity;
+	sh->used = 0;
+	sh->deleted = 0;
+
+	return 0;
+}
+
+static int shard_rehash ( struct shard *sh, const long long int capacity, const int value_size ) {
+	struct slot *slots = sh->slots;
+	unsigned char *values = sh->values;
+	const long long int old_capacity = sh->capacity;
+
+	if ( shard_alloc ( sh, capacity, value_size ) == -1 ) {
+		sh->slots = slots;
+		sh->values = values;
+		sh->capacity = old_capacity;
+		return -1;
+	}
+
+	const long long int mask = capacity - 1;
+
+	for ( long long int i = 0; i < old_capacity; i++ ) {
+		if ( slots[i].state != SLOT_USED ) continue;
+
+		long long int n = hash_key ( slots[i].chat_id, slots[i].user_id ) & mask;
+		while ( sh->slots[n].state == SLOT_USED ) n = ( n + 1 ) & mask;
+
+		sh->slots[n] = slots[i];
+		memcpy ( &sh->values[n * value_size], &values[i * value_size], value_size );
+		sh->used++;
+	}
+
+	tebot_free ( NULL, slots );
+	tebot_free ( NULL, values );
+
+	return 0;
+}
+
+/*
+ * slot keeps tick of its timer, so the timer is found again on delete and
+ * timers left from older entries of the key are skipped when they fire.
+ */
+static int wheel_add ( struct shard *sh, struct slot *s, const long long int expire, const long long int now ) {
+	long long int at = expire - now < WHEEL_SIZE ? expire : now + WHEEL_SIZE - 1;
+	struct wheel_slot *ws = &sh->wheel[at % WHEEL_SIZE];
+
+	if ( ws->size == ws->capacity ) {
+		int capacity = ws->capacity ? ws->capacity * 2 : 16;
+		struct timer *timers = tebot_realloc ( NULL, ws->timers, sizeof ( struct timer ) * capacity );
+		if ( !timers ) return -1;
+		ws->timers = timers;
+		ws->capacity = capacity;
+	}
+
+	ws->timers[ws->size].chat_id = s->chat_id;
+	ws->timers[ws->size].user_id = s->user_id;
+	ws->timers[ws->size].at = at;
+	ws->size++;
+	s->timer = at;
+
+	return 0;
+}
+
+static void wheel_remove ( struct shard *sh, const struct slot *s, const long long int at ) {
+	if ( at == 0 ) return;
+
+	struct wheel_slot *ws = &sh->wheel[at % WHEEL_SIZE];
+	for ( int k = 0; k < ws->size; k++ ) {
+		struct timer *t = &ws->timers[k];
+		if ( t->at == at && t->chat_id == s->chat_id && t->user_id == s->user_id ) {
+			ws->timers[k] = ws->timers[--ws->size];
+			break;
+		}
+	}
+}
+
+static void shard_remove ( struct shard *sh, const long long int i ) {
+	wheel_remove ( sh, &sh->slots[i], sh->slots[i].timer );
+	sh->slots[i].timer = 0;
+	sh->slots[i].state = SLOT_DELETED;
+	sh->used--;
+	sh->deleted++;
+}
+
+/*
+ * caller holds write lock of the shard.
+ */
+static int shard_put ( tebot_state_store_t *st, struct shard *sh, const uint64_t hash,
+		const long long int chat_id, const long long int user_id, const void *value,
+		const long long int expire, const long long int now ) {
+
+	long long int i = find_slot ( sh, hash, chat_id, user_id );
+	const int is_new = i == -1;
+
+	if ( i == -1 ) {
+		if ( ( sh->used + sh->deleted + 1 ) * 4 > sh->capacity * 3 ) {
+			long long int capacity = ( sh->used + 1 ) * 2 > sh->capacity ? sh->capacity * 2 : sh->capacity;
+			if ( shard_rehash ( sh, capacity, st->value_size ) == -1 ) return -1;
+		}
+
+		const long long int mask = sh->capacity - 1;
+		i = hash & mask;
+		while ( sh->slots[i].state == SLOT_USED ) i = ( i + 1 ) & mask;
+
+		if ( sh->slots[i].state == SLOT_DELETED ) sh->deleted--;
+		sh->slots[i].chat_id = chat_id;
+		sh->slots[i].user_id = user_id;
+		sh->slots[i].state = SLOT_USED;
+		sh->slots[i].expire = 0;
+		sh->slots[i].timer = 0;
+		sh->used++;
+	}
+
+	/*
+	 * timer is added only when entry expires earlier than its timer. later
+	 * expire is caught by the old timer and moved to the new place.
+	 */
+	if ( expire && ( sh->slots[i].timer == 0 || expire < sh->slots[i].timer ) ) {
+		const long long int old = sh->slots[i].timer;
+		if ( wheel_add ( sh, &sh->slots[i], expire, now ) == -1 ) {
+			if ( is_new ) shard_remove ( sh, i );
+			return -1;
+		}
+		wheel_remove ( sh, &sh->slots[i], old );
+	}
+	sh->slots[i].expire = expire;
+
+	if ( value ) memcpy ( &sh->values[i * st->value_size], value, st->value_size );
+	else memset ( &sh->values[i * st->value_size], 0, st->value_size );
+
+	return 0;
+}
+
+static void shard_expire ( struct shard *sh, const long long int now ) {
+	long long int from = sh->last_tick + 1;
+	if ( now - from >= WHEEL_SIZE ) from = now - WHEEL_SIZE + 1;
+
+	for ( long long int t = from; t <= now; t++ ) {
+		struct wheel_slot *ws = &sh->wheel[t % WHEEL_SIZE];
+		struct timer *timers = ws->timers;
+		int size = ws->size;
+
+		ws->timers = NULL;
+		ws->size = 0;
+		ws->capacity = 0;
+
+		for ( int k = 0; k < size; k++ ) {
+			uint64_t hash = hash_key ( timers[k].chat_id, timers[k].user_id );
+			long long int i = find_slot ( sh, hash, timers[k].chat_id, timers[k].user_id );
+			if ( i == -1 || sh->slots[i].timer != timers[k].at ) continue;
+
+			sh->slots[i].timer = 0;
+			if ( sh->slots[i].expire == 0 ) continue;
+
+			/*
+			 * when timer can not be moved, get still hides entry after
+			 * expire and next set of the key adds timer again.
+			 */
+			if ( sh->slots[i].expire <= now ) shard_remove ( sh, i );
+			else wheel_add ( sh, &sh->slots[i], sh->slots[i].expire, now );
+		}
+
+		tebot_free ( NULL, timers );
+	}
+
+	sh->last_tick = now;
+}
+
+tebot_state_store_t *tebot_state_store_init ( struct tebot_setup_state_store *ss ) {
+	tebot_state_store_t *st = tebot_calloc ( NULL, 1, sizeof ( tebot_state_store_t ) );
+	if ( !st ) return NULL;
+
+	st->value_size = ss->value_size > 0 ? ss->value_size : sizeof ( long long int );
+	st->default_ttl = ss->default_ttl;
+	st->snapshot_interval = ss->snapshot_interval;
+	st->last_snapshot = time ( NULL );
+
+	int shards = ss->shards > 0 ? ss->shards : 16;
+	while ( ( 1 << st->shard_bits ) < shards ) st->shard_bits++;
+	st->size_shards = 1 << st->shard_bits;
+
+	long long int capacity = 16;
+	long long int per_shard = ss->capacity / st->size_shards * 4 / 3 + 1;
+	while ( capacity < per_shard ) capacity *= 2;
+
+	st->shards = tebot_calloc ( NULL, st->size_shards, sizeof ( struct shard ) );
+	if ( !st->shards ) goto tebot_state_store_init_error;
+
+	for ( int i = 0; i < st->size_shards; i++ ) {
+		pthread_rwlock_init ( &st->shards[i].lock, NULL );
+		st->shards[i].last_tick = st->last_snapshot - 1;
+		if ( shard_alloc ( &st->shards[i], capacity, st->value_size ) == -1 ) goto tebot_state_store_init_error;
+	}
+
+	if ( ss->snapshot_file ) {
+		st->snapshot_file = tebot_strdup ( NULL, ss->snapshot_file );
+		if ( access ( st->snapshot_file, F_OK ) == 0 ) tebot_state_restore ( st, st->snapshot_file );
+	}
+
+	return st;
+
+tebot_state_store_init_error:
+	tebot_state_store_free ( st );
+	return NULL;
+}
+
+int tebot_state_get ( tebot_state_store_t *st, const long long int chat_id, const long long int user_id, void *value ) {
+	const uint64_t hash = hash_key ( chat_id, user_id );
+	struct shard *sh = get_shard ( st, hash );
+	int ret = -1;
+
+	pthread_rwlock_rdlock ( &sh->lock );
+
+	long long int i = find_slot ( sh, hash, chat_id, user_id );
+	if ( i != -1 && ( sh->slots[i].expire == 0 || sh->slots[i].expire > time ( NULL ) ) ) {
+		if ( value ) memcpy ( value, &sh->values[i * st->value_size], st->value_size );
+		ret = 0;
+	}
+
+	pthread_rwlock_unlock ( &sh->lock );
+
+	return ret;
+}
+
+int tebot_state_set ( tebot_state_store_t *st, const long long int chat_id, const long long int user_id,
+		const void *value, const long long int ttl ) {
+
+	const uint64_t hash = hash_key ( chat_id, user_id );
+	struct shard *sh = get_shard ( st, hash );
+	const long long int now = time ( NULL );
+	const long long int t = ttl ? ttl : st->default_ttl;
+	const long long int expire = t > 0 ? now + t : 0;
+
+	pthread_rwlock_wrlock ( &sh->lock );
+	int ret = shard_put ( st, sh, hash, chat_id, user_id, value, expire, now );
+	pthread_rwlock_unlock ( &sh->lock );
+
+	return ret;
+}
+
+int tebot_state_delete ( tebot_state_store_t *st, const long long int chat_id, const long long int user_id ) {
+	const uint64_t hash = hash_key ( chat_id, user_id );
+	struct shard *sh = get_shard ( st, hash );
+
+	pthread_rwlock_wrlock ( &sh->lock );
+
+	long long int i = find_slot ( sh, hash, chat_id, user_id );
+	if ( i != -1 ) shard_remove ( sh, i );
+
+	pthread_rwlock_unlock ( &sh->lock );
+
+	return i == -1 ? -1 : 0;
+}
+
+long long int tebot_state_size ( tebot_state_store_t *st ) {
+	long long int size = 0;
+
+	for ( int i = 0; i < st->size_shards; i++ ) {
+		pthread_rwlock_rdlock ( &st->shards[i].lock );
+		size += st->shards[i].used;
+		pthread_rwlock_unlock ( &st->shards[i].lock );
+	}
+
+	return size;
+}
+
+void tebot_state_tick ( tebot_state_store_t *st ) {
+	const long long int now = time ( NULL );
+
+	for ( int i = 0; i < st->size_shards; i++ ) {
+		pthread_rwlock_wrlock ( &st->shards[i].lock );
+		shard_expire ( &st->shards[i], now );
+		pthread_rwlock_unlock ( &st->shards[i].lock );
+	}
+
+	if ( st->snapshot_file && st->snapshot_interval > 0 && now - st->last_snapshot >= st->snapshot_interval ) {
+		st->last_snapshot = now;
+		tebot_state_snapshot ( st, st->snapshot_file );
+	}
+}
+
+static int write_all ( int fd, const void *buf, size_t size ) {
+	const char *p = buf;
+
+	while ( size > 0 ) {
+		ssize_t ret = write ( fd, p, size );
+		if ( ret <= 0 ) return -1;
+		p += ret;
+		size -= ret;
+	}
+
+	return 0;
+}
+
+int tebot_state_snapshot ( tebot_state_store_t *st, const char *path ) {
+	const size_t size_record = sizeof ( struct snapshot_record ) + st->value_size;
+	const long long int now = time ( NULL );
+
+	char *tmp = tebot_calloc ( NULL, strlen ( path ) + 5, 1 );
+	char *buf = tebot_malloc ( NULL, SNAPSHOT_BUF_SIZE + size_record );
+	if ( !tmp || !buf ) {
+		tebot_free ( NULL, tmp );
+		tebot_free ( NULL, buf );
+		return -1;
+	}
+	sprintf ( tmp, "%s.tmp", path );
+
+	int fd = open ( tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+	if ( fd == -1 ) goto tebot_state_snapshot_error;
+
+	struct snapshot_header header;
+	memset ( &header, 0, sizeof ( header ) );
+	memcpy ( header.magic, SNAPSHOT_MAGIC, sizeof ( header.magic ) );
+	header.value_size = st->value_size;
+
+	if ( write_all ( fd, &header, sizeof ( header ) ) == -1 ) goto tebot_state_snapshot_error;
+
+	size_t offset = 0;
+
+	for ( int n = 0; n < st->size_shards; n++ ) {
+		struct shard *sh = &st->shards[n];
+
+		pthread_rwlock_rdlock ( &sh->lock );
+		for ( long long int i = 0; i < sh->capacity; i++ ) {
+			struct slot *s = &sh->slots[i];
+			if ( s->state != SLOT_USED ) continue;
+			if ( s->expire && s->expire <= now ) continue;
+
+			struct snapshot_record *r = ( struct snapshot_record * ) &buf[offset];
+			r->chat_id = s->chat_id;
+			r->user_id = s->user_id;
+			r->expire = s->expire;
+			memcpy ( &buf[offset + sizeof ( struct snapshot_record )], &sh->values[i * st->value_size], st->value_size );
+			offset += size_record;
+			header.count++;
+
+			if ( offset >= SNAPSHOT_BUF_SIZE ) {
+				if ( write_all ( fd, buf, offset ) == -1 ) {
+					pthread_rwlock_unlock ( &sh->lock );
+					goto tebot_state_snapshot_error;
+				}
+				offset = 0;
+			}
+		}
+		pthread_rwlock_unlock ( &sh->lock );
+	}
+
+	if ( offset > 0 && write_all ( fd, buf, offset ) == -1 ) goto tebot_state_snapshot_error;
+
+	if ( pwrite ( fd, &header, sizeof ( header ), 0 ) != sizeof ( header ) ) goto tebot_state_snapshot_error;
+	if ( fsync ( fd ) == -1 ) goto tebot_state_snapshot_error;
+	close ( fd );
+
+	int ret = rename ( tmp, path );
+
+	tebot_free ( NULL, tmp );
+	tebot_free ( NULL, buf );
+
+	return ret;
+
+tebot_state_snapshot_error:
+	if ( fd != -1 ) {
+		close ( fd );
+		unlink ( tmp );
+	}
+	tebot_free ( NULL, tmp );
+	tebot_free ( NULL, buf );
+	return -1;
+}
+
+int tebot_state_restore ( tebot_state_store_t *st, const char *path ) {
+	int fd = open ( path, O_RDONLY );
+	if ( fd == -1 ) return -1;
+
+	struct stat sb;
+	if ( fstat ( fd, &sb ) == -1 || sb.st_size < sizeof ( struct snapshot_header ) ) {
+		close ( fd );
+		return -1;
+	}
+
+	unsigned char *p = mmap ( NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0 );
+	close ( fd );
+	if ( p == MAP_FAILED ) return -1;
+
+	struct snapshot_header *header = ( struct snapshot_header * ) p;
+	const size_t size_record = sizeof ( struct snapshot_record ) + st->value_size;
+
+	if ( memcmp ( header->magic, SNAPSHOT_MAGIC, sizeof ( header->magic ) ) ||
+			header->value_size != st->value_size ||
+			header->count < 0 ||
+			( sb.st_size - sizeof ( struct snapshot_header ) ) / size_record < header->count ) {
+		munmap ( p, sb.st_size );
+		return -1;
+	}
+
+	madvise ( p, sb.st_size, MADV_SEQUENTIAL );
+
+	/*
+	 * grow every shard once before insert so restore doesn't rehash.
+	 */
+	const long long int per_shard = header->count / st->size_shards * 4 / 3 + 1;
+
+	for ( int n = 0; n < st->size_shards; n++ ) {
+		struct shard *sh = &st->shards[n];
+		pthread_rwlock_wrlock ( &sh->lock );
+
+		long long int capacity = sh->capacity;
+		while ( capacity < per_shard + sh->used ) capacity *= 2;
+		if ( capacity != sh->capacity ) shard_rehash ( sh, capacity, st->value_size );
+
+		pthread_rwlock_unlock ( &sh->lock );
+	}
+
+	const long long int now = time ( NULL );
+	const unsigned char *r = p + sizeof ( struct snapshot_header );
+
+	for ( long long int i = 0; i < header->count; i++, r += size_record ) {
+		const struct snapshot_record *rec = ( const struct snapshot_record * ) r;
+		if ( rec->expire && rec->expire <= now ) continue;
+
+		const uint64_t hash = hash_key ( rec->chat_id, rec->user_id );
+		struct shard *sh = get_shard ( st, hash );
+
+		pthread_rwlock_wrlock ( &sh->lock );
+		shard_put ( st, sh, hash, rec->chat_id, rec->user_id, r + sizeof ( struct snapshot_record ), rec->expire, now );
+		pthread_rwlock_unlock ( &sh->lock );
+	}
+
+	munmap ( p, sb.st_size );
+
+	return 0;
+}
+
+void tebot_state_store_free ( tebot_state_store_t *st ) {
+	if ( !st ) return;
+
+	if ( st->shards ) {
+		for ( int i = 0; i < st->size_shards; i++ ) {
+			struct shard *sh = &st->shards[i];
+			if ( !sh->slots ) continue;
+
+			for ( int w = 0; w < WHEEL_SIZE; w++ ) tebot_free ( NULL, sh->wheel[w].timers );
+			tebot_free ( NULL, sh->slots );
+			tebot_free ( NULL, sh->values );
+			pthread_rwlock_destroy ( &sh->lock );
+		}
+	}
+
+	tebot_free ( NULL, st->shards );
+	tebot_free ( NULL, st->snapshot_file );
+	tebot_free ( NULL, st );
+}
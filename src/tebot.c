@@ -17,30 +17,30 @@
  * along with this program. If not, see <http://www.gnu.org/licenses/>.
  * -------------------------------------------------------------------/
  */
+#define _GNU_SOURCE
 #include <stdlib.h>
 #include <stdarg.h>
+#include <stddef.h>
 #include <time.h>
 #include <string.h>
+#include <strings.h>
 #include <unistd.h>
 #include <json-c/json.h>
 #include <pthread.h>
-#include "tebot.h"
+#include <sched.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include "tebot_private.h"
 
 #define LOG_LEVEL_CRITICAL_STRING          "[CRITICAL]: "
 #define LOG_LEVEL_NOTICE_STRING            "[NOTICE]: "
 #define LOG_LEVEL_BAD_REQUEST_STRING       "[BAD REQUEST]: "
 
-#define MIMES_TYPE_PARAM                   0
-#define MIMES_TYPE_ARRAY                   1
-#define MIMES_TYPE_FILE                    2
+#define MIMES_TYPE_PARAM                   TEBOT_PARAM_STRING
+#define MIMES_TYPE_ARRAY                   TEBOT_PARAM_ARRAY
+#define MIMES_TYPE_FILE                    TEBOT_PARAM_FILE
 #define MIMES_TYPE_OUT_FILE                3
 #define MIMES_TYPE_GET_FILE                4
-struct mimes {
-	int type;
-	char *name;
-	char *value;
-	char **array;
-};
 struct data_of_types {
 	char *name;
 	void **ptr;
@@ -48,10 +48,62 @@ struct data_of_types {
 	void (*set_links_for_object_and_get_data) ( tebot_handler_t *h, void *ptr, json_object *param );
 };
 
+/*
+ * key of generated parser, value is stored by type_of_param of schema and
+ * not by type of json value.
+ */
+struct field_of_type {
+	char *name;
+	int type_of_param;
+	size_t offset;
+	int size;
+	void (*set_links_for_object_and_get_data) ( tebot_handler_t *h, void *ptr, json_object *param );
+};
+
+/*
+ * in lazy mode fields of nested objects other than user and chat keep only
+ * their json node, which stays alive with root until tebot_free_update.
+ * table is open addressing by address of field, in arena of handler.
+ */
+struct lazy_field {
+	void **ptr;
+	json_object *param;
+	struct data_of_types dot;
+	const struct tebot_fields *mask;
+};
+
+/*
+ * fields selected by tebot_set_fields, a tree by path. node without
+ * children takes whole object below it, "*" matches any key. bits has
+ * one bit for every entry of fields_of_* of type the node met last, so
+ * generated parser tests bit instead of comparing names.
+ */
+#define FIELDS_BITS                     2
+
+struct tebot_fields {
+	char *name;
+	size_t length;
+	struct tebot_fields **children;
+	int size;
+	int is_all;
+	const struct field_of_type *bits_of;
+	unsigned long long int bits[FIELDS_BITS];
+};
+
+#define FIELD_SELECTED( bits, n )       ( !( bits ) || ( ( bits )[( n ) / 64] >> ( ( n ) % 64 ) & 1 ) )
+
+struct tebot_lazy {
+	struct lazy_field *fields;
+	int capacity;
+	int size;
+	json_object *root;
+};
+
 #define TYPE_OF_PARAM_PTR_STRING        0
 #define TYPE_OF_PARAM_BOOLEAN           1
 #define TYPE_OF_PARAM_INT               2
 #define TYPE_OF_PARAM_FLOAT             3
+#define TYPE_OF_PARAM_OBJECT            4
 
 struct info_of_params {
 	int type;
@@ -69,8 +121,16 @@ static void handler_message_entity ( tebot_handler_t *h, void *data, json_object
 static void handler_location ( tebot_handler_t *h, void *data, json_object *ob );
 static void handler_order_info ( tebot_handler_t *h, void *data, json_object *ob );
 static void handler_shipping_address ( tebot_handler_t *h, void *data, json_object *ob );
+static void handler_chat ( tebot_handler_t *h, void *data, json_object *ob );
+static void lazy_reset ( tebot_handler_t *h );
+static void fields_free ( const tebot_allocator_t *a, struct tebot_fields *f );
+static struct tebot_fields *fields_copy ( const tebot_allocator_t *a, const struct tebot_fields *f );
+void *strdup_printf ( const tebot_allocator_t *a, char *fmt, ... );
 
-static void log_time ( const tebot_log_level_enum log_level, const char *log_file, const int show_debug, const char *fmt, ... ) {
+/*
+ * used only before handler and its logger exist.
+ */
+static void log_time_sync ( const tebot_log_level_enum log_level, const char *log_file, const int show_debug, const char *fmt, ... ) {
 	FILE *fp = NULL;
 
 	if ( log_file ) {
@@ -93,7 +153,7 @@ static void log_time ( const tebot_log_level_enum log_level, const char *log_fil
 	}
 
 	size++;
-	p = calloc ( size, 1 );
+	p = tebot_calloc ( NULL, size, 1 );
 	if ( !p ) {
 		fclose ( fp );
 		return;
@@ -104,7 +164,7 @@ static void log_time ( const tebot_log_level_enum log_level, const char *log_fil
 	va_end ( ap );
 
 	if ( size < 0 ) {
-		free ( p );
+		tebot_free ( NULL, p );
 		fclose ( fp );
 		return;
 	}
@@ -141,224 +201,500 @@ static void log_time ( const tebot_log_level_enum log_level, const char *log_fil
 		}
 	}
 
-	free ( p );
+	tebot_free ( NULL, p );
 	if ( log_file ) fclose ( fp );
 }
 
+static void log_time ( tebot_handler_t *h, const tebot_log_level_enum log_level, const char *fmt, ... ) {
+	if ( !h->logger ) return;
+
+	va_list ap;
+
+	va_start ( ap, fmt );
+	tebot_logger_vwrite ( h->logger, log_level, fmt, ap );
+	va_end ( ap );
+}
+
+/*
+ * snapshot is too big for stack of a thread, so it is given on heap.
+ */
+tebot_metrics_snapshot_t *tebot_get_metrics ( tebot_handler_t *h ) {
+	if ( !h->metrics ) return NULL;
+
+	tebot_metrics_snapshot_t *s = tebot_malloc ( &h->allocator, sizeof ( tebot_metrics_snapshot_t ) );
+	if ( !s ) return NULL;
+
+	tebot_metrics_snapshot ( h->metrics, s );
+
+	return s;
+}
+
+void tebot_free_metrics ( tebot_handler_t *h, tebot_metrics_snapshot_t *s ) {
+	tebot_free_sized ( &h->allocator, s, sizeof ( tebot_metrics_snapshot_t ) );
+}
+
+void tebot_log ( tebot_handler_t *h, const tebot_log_level_enum log_level, const char *fmt, ... ) {
+	if ( !h->logger ) return;
+
+	va_list ap;
+
+	va_start ( ap, fmt );
+	tebot_logger_vwrite ( h->logger, log_level, fmt, ap );
+	va_end ( ap );
+}
+
+void tebot_set_log_level ( tebot_handler_t *h, const tebot_log_level_enum max_level ) {
+	if ( h->logger ) tebot_logger_set_level ( h->logger, max_level );
+}
+
+void tebot_set_log_rate_limit ( tebot_handler_t *h, const int per_second ) {
+	if ( h->logger ) tebot_logger_set_rate_limit ( h->logger, per_second );
+}
+
+long long int tebot_log_dropped ( tebot_handler_t *h ) {
+	return h->logger ? tebot_logger_dropped ( h->logger ) : 0;
+}
+
 tebot_handler_t *tebot_init ( const char *token, tebot_show_debug_enum show_debug, const char *log_file ) {
 
-	tebot_handler_t *h = calloc ( 1, sizeof ( tebot_handler_t ) );
+	tebot_handler_t *h = tebot_calloc ( NULL, 1, sizeof ( tebot_handler_t ) );
 	if ( !h ) {
 		if ( log_file ) {
-			log_time ( LOG_LEVEL_CRITICAL, log_file, show_debug, "Not enought memory for alloc to tebot handler.\n" );
+			log_time_sync ( LOG_LEVEL_CRITICAL, log_file, show_debug, "Not enought memory for alloc to tebot handler.\n" );
 		}
 		return NULL;
 	}
 
-	h->url_get = calloc ( 4097, 1 );
+	h->url_get = tebot_calloc ( NULL, 4097, 1 );
 	if ( !h->url_get ) {
 		if ( log_file ) {
-			log_time ( LOG_LEVEL_CRITICAL, log_file, show_debug, "Not enought memory for alloc to tebot url get.\n" );
+			log_time_sync ( LOG_LEVEL_CRITICAL, log_file, show_debug, "Not enought memory for alloc to tebot url get.\n" );
 		}
-		free ( h );
+		tebot_free ( NULL, h );
 		return NULL;
 	}
 
-	h->current_buf = calloc ( 4097, 1 );
+	h->current_buf = tebot_calloc ( NULL, 4097, 1 );
 	if ( !h->current_buf ) {
 		if ( log_file ) {
-			log_time ( LOG_LEVEL_CRITICAL, log_file, show_debug, "Not enought memory for alloc to tebot current buf.\n" );
+			log_time_sync ( LOG_LEVEL_CRITICAL, log_file, show_debug, "Not enought memory for alloc to tebot current buf.\n" );
 		}
-		free ( h->url_get );
-		free ( h );
+		tebot_free ( NULL, h->url_get );
+		tebot_free ( NULL, h );
 		return NULL;
 	}
 
 	const int size_of_token = strlen ( token );
-	h->token = calloc ( size_of_token + 1, 1 );
+	h->token = tebot_calloc ( NULL, size_of_token + 1, 1 );
 	if ( !h->token ) {
 		if ( log_file ) {
-			log_time ( LOG_LEVEL_CRITICAL, log_file, show_debug, "Not enought memory for alloc to tebot token.\n" );
+			log_time_sync ( LOG_LEVEL_CRITICAL, log_file, show_debug, "Not enought memory for alloc to tebot token.\n" );
 		}
-		free ( h->current_buf );
-		free ( h->url_get );
-		free ( h );
+		tebot_free ( NULL, h->current_buf );
+		tebot_free ( NULL, h->url_get );
+		tebot_free ( NULL, h );
 		return NULL;
 	}
 	strncpy ( h->token, token, size_of_token );
 
 	h->show_debug = show_debug;
+	h->log_file = log_file;
+	h->allocator = *tebot_default_allocator ( );
+	h->metrics = tebot_metrics_init ( );
+	h->arena = tebot_arena_init ( 0, &h->allocator );
+
+	if ( log_file || show_debug ) {
+		h->logger = tebot_logger_init ( log_file, show_debug );
+		if ( !h->logger ) {
+			log_time_sync ( LOG_LEVEL_CRITICAL, log_file, show_debug, "failed to open log file.\n" );
+		}
+	}
 
 	h->curl = curl_easy_init ( );
 
 	return h;
 }
 
-static size_t write_data_cb ( void *data, size_t size, size_t nmemb, void *st ) {
-	tebot_handler_t *h = ( tebot_handler_t * ) st;
-
-	size_t size_of_data = size * nmemb;
-	char *current_buf = ( char * ) realloc ( h->current_buf, h->offset + size_of_data + 1 );
+/*
+ * body of answer is kept in current_buf of handler, offset is its size.
+ */
+size_t tebot_transport_body ( tebot_handler_t *h, const void *data, const size_t size ) {
+	char *current_buf = ( char * ) tebot_realloc ( &h->allocator, h->current_buf, h->offset + size + 1 );
 	if ( !current_buf ) {
-		log_time ( LOG_LEVEL_CRITICAL, h->log_file, h->show_debug, "failed to allocate memory for size: %u\n", size_of_data );
+		log_time ( h, LOG_LEVEL_CRITICAL, "failed to allocate memory for size: %u\n", size );
 		return 0;
 	}
 
-	memcpy ( &current_buf [ h->offset ], data, size_of_data );
+	memcpy ( &current_buf [ h->offset ], data, size );
 	h->current_buf = current_buf;
-	h->offset += size_of_data;
+	h->offset += size;
 	h->current_buf [ h->offset ] = 0;
 
-	return size_of_data;
+	return size;
 }
 
-static unsigned char *tebot_request_get ( tebot_handler_t *h, const char *method, struct mimes *mimes, const int size_mimes ) {
+int tebot_set_api_url ( tebot_handler_t *h, const char *url_api, const char *url_api_get_file ) {
+	char *api = NULL;
+	char *get_file = NULL;
 
-	snprintf ( h->url_get, 4097, "%s/bot%s/%s", 
-			mimes[0].type == MIMES_TYPE_GET_FILE ? URL_API_GET_FILE : URL_API, 
-			h->token, 
-			mimes[0].type == MIMES_TYPE_GET_FILE ? mimes[0].value : method );
+	if ( url_api ) {
+		api = tebot_strdup ( &h->allocator, url_api );
+		get_file = url_api_get_file ? tebot_strdup ( &h->allocator, url_api_get_file ) : strdup_printf ( &h->allocator, "%s/file", url_api );
+		if ( !api || !get_file ) {
+			log_time ( h, LOG_LEVEL_CRITICAL, "failed to allocate memory for api url.\n" );
+			tebot_free ( &h->allocator, api );
+			tebot_free ( &h->allocator, get_file );
+			return -1;
+		}
+	}
 
-	h->curl = curl_easy_init ( );
-	h->offset = 0;
-	
-	curl_easy_setopt ( h->curl, CURLOPT_URL, h->url_get );
+	tebot_free ( &h->allocator, h->url_api );
+	tebot_free ( &h->allocator, h->url_api_get_file );
+	h->url_api = api;
+	h->url_api_get_file = get_file;
+
+	return 0;
+}
+
+/*
+ * buffers made by tebot_init and setters are moved to the new allocator and
+ * freed by the old one. parsed update is given back, as its arena goes.
+ */
+int tebot_set_allocator ( tebot_handler_t *h, const tebot_allocator_t *a ) {
+	if ( !a ) a = tebot_default_allocator ( );
+
+	const tebot_allocator_t old = h->allocator;
+	const size_t size_buf = h->offset + 1 > 4097 ? h->offset + 1 : 4097;
+
+	char *url_get = tebot_calloc ( a, 4097, 1 );
+	char *current_buf = tebot_calloc ( a, size_buf, 1 );
+	char *token = tebot_strdup ( a, h->token );
+	tebot_arena_t *arena = tebot_arena_init ( 0, a );
+
+	if ( !url_get || !current_buf || !token || !arena ) {
+		log_time ( h, LOG_LEVEL_CRITICAL, "failed to allocate memory for new allocator.\n" );
+		tebot_free ( a, url_get );
+		tebot_free ( a, current_buf );
+		tebot_free ( a, token );
+		tebot_arena_free ( arena );
+		return -1;
+	}
+
+	memcpy ( current_buf, h->current_buf, h->offset + 1 );
+
+	char *url_api = h->url_api;
+	char *url_api_get_file = h->url_api_get_file;
+	char **allowed_updates = h->allowed_updates;
+
+	h->url_api = NULL;
+	h->url_api_get_file = NULL;
+	h->allowed_updates = NULL;
+	h->allocator = *a;
+
+	int ret = 0;
+	if ( url_api && tebot_set_api_url ( h, url_api, url_api_get_file ) == -1 ) ret = -1;
+	if ( allowed_updates && tebot_set_allowed_updates ( h, allowed_updates ) == -1 ) ret = -1;
+
+	tebot_free ( &old, url_api );
+	tebot_free ( &old, url_api_get_file );
+	if ( allowed_updates ) {
+		for ( int i = 0; allowed_updates[i]; i++ ) tebot_free ( &old, allowed_updates[i] );
+		tebot_free ( &old, allowed_updates );
+	}
+
+	tebot_free ( &old, h->url_get );
+	tebot_free ( &old, h->current_buf );
+	tebot_free ( &old, h->token );
+	tebot_arena_free ( h->arena );
+
+	if ( h->lazy ) {
+		lazy_reset ( h );
+		tebot_free ( &old, h->lazy );
+		h->lazy = tebot_calloc ( a, 1, sizeof ( struct tebot_lazy ) );
+	}
+
+	if ( h->fields ) {
+		struct tebot_fields *fields = fields_copy ( a, h->fields );
+		fields_free ( &old, h->fields );
+		h->fields = fields;
+		if ( !fields ) ret = -1;
+	}
+
+	h->url_get = url_get;
+	h->current_buf = current_buf;
+	h->token = token;
+	h->arena = arena;
+	h->res = NULL;
+
+	return ret;
+}
+
+void tebot_set_transport ( tebot_handler_t *h, const tebot_transport_t *t ) {
+	if ( h->transport.free ) h->transport.free ( h->transport.data );
+
+	if ( t ) h->transport = *t;
+	else memset ( &h->transport, 0, sizeof ( tebot_transport_t ) );
+}
+
+static size_t write_data_cb ( void *data, size_t size, size_t nmemb, void *st ) {
+	return tebot_transport_body ( ( tebot_handler_t * ) st, data, size * nmemb );
+}
+
+/*
+ * array parameters are sent as json array in string.
+ */
+static char *json_string_array ( const tebot_allocator_t *a, char **array ) {
+	json_object *root = json_object_new_array ( );
+	for ( int i = 0; array[i]; i++ ) {
+		json_object_array_add ( root, json_object_new_string ( array[i] ) );
+	}
+
+	char *str = tebot_strdup ( a, json_object_to_json_string_ext ( root, JSON_C_TO_STRING_PLAIN ) );
+	json_object_put ( root );
+
+	return str;
+}
+
+/*
+ * mime and method live from send to receive of the same thread.
+ */
+static __thread curl_mime *curl_current_mime;
+static __thread int curl_current_method;
+
+static int curl_send ( tebot_handler_t *h, void *data, const tebot_request_t *req ) {
+	/*
+	 * handle is kept between requests, so connection to api stays open.
+	 */
+	if ( h->curl ) curl_easy_reset ( h->curl );
+	else h->curl = curl_easy_init ( );
+
+	curl_easy_setopt ( h->curl, CURLOPT_URL, req->url );
 	curl_easy_setopt ( h->curl, CURLOPT_WRITEFUNCTION, write_data_cb );
 	curl_easy_setopt ( h->curl, CURLOPT_WRITEDATA, h );
 
-	curl_mime *mime = NULL;
-	if ( mimes[0].type != MIMES_TYPE_GET_FILE ) {
-
-	if ( mimes != NULL && size_mimes > 0 ) {
-		mime = curl_mime_init ( h->curl );
-		
-		for ( int i = 0; i < size_mimes; i++ ) {
-			curl_mimepart *part = curl_mime_addpart ( mime );
-			if ( !part ) {
-				log_time ( LOG_LEVEL_CRITICAL, h->log_file, h->show_debug, "failed to create mime part.\n" );
-				goto tebot_request_get_error;
-			}
+	curl_current_method = tebot_metrics_method_index ( req->method );
+	curl_current_mime = NULL;
 
-			curl_mime_name ( part, mimes[i].name );
-			if ( mimes[i].type == MIMES_TYPE_FILE ) {
-				curl_mime_filedata ( part, mimes[i].value );
-			} else {
-				curl_mime_data ( part, mimes[i].value, CURL_ZERO_TERMINATED );
-			}
+	if ( req->params == NULL || req->size_params <= 0 ) return 0;
+
+	curl_mime *mime = curl_mime_init ( h->curl );
+
+	for ( int i = 0; i < req->size_params; i++ ) {
+		const tebot_param_t *param = &req->params[i];
+		if ( param->type == TEBOT_PARAM_ARRAY && !param->array ) continue;
+
+		curl_mimepart *part = curl_mime_addpart ( mime );
+		if ( !part ) {
+			log_time ( h, LOG_LEVEL_CRITICAL, "failed to create mime part.\n" );
+			curl_mime_free ( mime );
+			return -1;
 		}
-	
-		curl_easy_setopt ( h->curl, CURLOPT_MIMEPOST, mime );
-	}
 
+		curl_mime_name ( part, param->name );
+		if ( param->type == TEBOT_PARAM_FILE ) {
+			curl_mime_filedata ( part, param->value );
+		} else if ( param->type == TEBOT_PARAM_ARRAY ) {
+			char *value = json_string_array ( &h->allocator, param->array );
+			curl_mime_data ( part, value, CURL_ZERO_TERMINATED );
+			tebot_free ( &h->allocator, value );
+		} else {
+			curl_mime_data ( part, param->value, CURL_ZERO_TERMINATED );
+		}
 	}
 
-	CURLcode res;
-	res = curl_easy_perform ( h->curl );
+	curl_easy_setopt ( h->curl, CURLOPT_MIMEPOST, mime );
+	curl_current_mime = mime;
+
+	return 0;
+}
+
+static long curl_receive ( tebot_handler_t *h, void *data ) {
+	CURLcode res = curl_easy_perform ( h->curl );
 	if ( res != CURLE_OK ) {
-		log_time ( LOG_LEVEL_BAD_REQUEST, h->log_file, h->show_debug, "failed to request get - %s (%d)\n", curl_easy_strerror ( res ), res );
+		log_time ( h, LOG_LEVEL_BAD_REQUEST, "failed to request get - %s (%d)\n", curl_easy_strerror ( res ), res );
 	}
 
 	long response_code = 0L;
 	curl_easy_getinfo ( h->curl, CURLINFO_RESPONSE_CODE, &response_code );
+
+	if ( h->metrics ) tebot_metrics_record ( h->metrics, curl_current_method, response_code, res, h->curl );
+
+	if ( curl_current_mime ) curl_mime_free ( curl_current_mime );
+	curl_current_mime = NULL;
+
+	return res == CURLE_OK ? response_code : -1;
+}
+
+static const tebot_transport_t curl_transport = {
+	.send = curl_send,
+	.receive = curl_receive
+};
+
+/*
+ * reply is armed by the thread which handles webhook request and only for
+ * handler given to begin, send methods of other threads go as usual.
+ */
+static __thread creqhttp_epoll_event *reply_event;
+static __thread tebot_handler_t *reply_handler;
+
+static int webhook_reply_inline ( const char *method, tebot_param_t *mimes, const int size_mimes );
+
+static unsigned char *tebot_request_get ( tebot_handler_t *h, const char *method, tebot_param_t *mimes, const int size_mimes ) {
+
+	if ( reply_event && reply_handler == h && webhook_reply_inline ( method, mimes, size_mimes ) == 0 ) return NULL;
+
+	const int is_get_file = mimes && size_mimes > 0 && mimes[0].type == MIMES_TYPE_GET_FILE;
+
+	const char *url_api = h->url_api ? h->url_api : URL_API;
+	const char *url_api_get_file = h->url_api_get_file ? h->url_api_get_file : URL_API_GET_FILE;
+
+	snprintf ( h->url_get, 4097, "%s/bot%s/%s", 
+			is_get_file ? url_api_get_file : url_api, 
+			h->token, 
+			is_get_file ? mimes[0].value : method );
+
+	const tebot_transport_t *t = h->transport.send ? &h->transport : &curl_transport;
+	tebot_request_t req = {
+		.method = is_get_file ? "downloadFile" : method,
+		.url = h->url_get,
+		.params = is_get_file ? NULL : mimes,
+		.size_params = is_get_file ? 0 : size_mimes
+	};
+
+	h->offset = 0;
+	h->current_buf[0] = 0;
+
+	if ( t->send ( h, t->data, &req ) == -1 ) return NULL;
+
+	const long response_code = t->receive ( h, t->data );
 	if ( response_code != 200L ) {
-		log_time ( LOG_LEVEL_NOTICE, h->log_file, h->show_debug, "answer from server: %d\n", response_code );
+		log_time ( h, LOG_LEVEL_NOTICE, "answer from server: %d\n", response_code );
 	}
 
-	if ( mime ) curl_mime_free ( mime );
-	curl_easy_cleanup ( h->curl );
+	if ( h->metrics && t != &curl_transport ) {
+		tebot_metrics_record ( h->metrics, tebot_metrics_method_index ( req.method ),
+				response_code > 0 ? response_code : 0, CURLE_OK, NULL );
+	}
 
 	return h->current_buf;
+}
 
-tebot_request_get_error:
-	curl_mime_free ( mime );
-	curl_easy_cleanup ( h->curl );
+/*
+ * everything of parsed update is taken from arena of handler and is given
+ * back at once by tebot_free_update.
+ */
+static tebot_arena_t *parse_arena ( tebot_handler_t *h ) {
+	if ( !h->arena ) h->arena = tebot_arena_init ( 0, &h->allocator );
 
-	return NULL;
+	return h->arena;
 }
 
-void parse_current_object ( tebot_handler_t *h, json_object *json_result, struct data_of_types dot[], const int i ) {
-	json_object *param = NULL;
-	json_object_iter iter;
+static void *parse_alloc ( tebot_handler_t *h, const size_t size ) {
+	tebot_arena_t *a = parse_arena ( h );
+	if ( !a ) return NULL;
 
-	param = json_object_object_get ( json_result, dot[i].name );
-	if ( !param ) {
-		return;
+	return tebot_arena_alloc ( a, size );
+}
+
+static unsigned int lazy_slot ( void **ptr, const int capacity ) {
+	return ( unsigned int ) ( ( ( uintptr_t ) ptr >> 3 ) * 2654435761u ) & ( capacity - 1 );
+}
+
+static int lazy_add ( tebot_handler_t *h, json_object *param, struct data_of_types *dot ) {
+	struct tebot_lazy *l = h->lazy;
+
+	if ( l->size * 2 >= l->capacity ) {
+		const int capacity = l->capacity ? l->capacity * 2 : 64;
+		struct lazy_field *fields = parse_alloc ( h, capacity * sizeof ( struct lazy_field ) );
+		if ( !fields ) return -1;
+
+		for ( int i = 0; i < l->capacity; i++ ) {
+			if ( !l->fields[i].ptr ) continue;
+			unsigned int n = lazy_slot ( l->fields[i].ptr, capacity );
+			while ( fields[n].ptr ) n = ( n + 1 ) & ( capacity - 1 );
+			fields[n] = l->fields[i];
+		}
+
+		l->fields = fields;
+		l->capacity = capacity;
 	}
 
+	unsigned int n = lazy_slot ( dot->ptr, l->capacity );
+	while ( l->fields[n].ptr ) n = ( n + 1 ) & ( l->capacity - 1 );
+
+	l->fields[n].ptr = dot->ptr;
+	l->fields[n].param = param;
+	l->fields[n].dot = *dot;
+	l->fields[n].mask = h->mask;
+	l->size++;
+
+	return 0;
+}
+
+static int is_lazy_field ( tebot_handler_t *h, struct data_of_types *dot, const json_type type ) {
+	if ( !h->lazy || h->parse_depth == 0 ) return 0;
+	if ( type == json_type_object && ( dot->set_links_for_object_and_get_data == handler_user ||
+				dot->set_links_for_object_and_get_data == handler_chat ) ) return 0;
+
+	return 1;
+}
+
+static void parse_value ( tebot_handler_t *h, json_object *param, struct data_of_types *dot ) {
 	json_type type = json_object_get_type ( param );
 	switch ( type ) {
 		case json_type_null:
-			*dot[i].ptr = NULL;
+			*dot->ptr = NULL;
 			break;
 		case json_type_object: {
-			if ( dot[i].size <= 0 ) break;
-			*( dot[i].ptr ) = calloc ( 1, dot[i].size );
-			if ( !*( dot[i].ptr ) ) {
-				log_time ( LOG_LEVEL_CRITICAL, h->log_file, h->show_debug, "failed to calloc json object." );
+			if ( dot->size <= 0 ) break;
+			if ( is_lazy_field ( h, dot, type ) && lazy_add ( h, param, dot ) == 0 ) break;
+			*( dot->ptr ) = parse_alloc ( h, dot->size );
+			if ( !*( dot->ptr ) ) {
+				log_time ( h, LOG_LEVEL_CRITICAL, "failed to calloc json object." );
 				break;
 			}	
 					
-			void **temp = realloc ( h->for_free, sizeof ( void * ) * h->size_for_free + 1 );
-			if ( temp ) {
-				h->for_free = temp;
-				h->for_free[h->size_for_free] = *( dot[i].ptr );
-				h->size_for_free++;
-			}
-			dot[i].set_links_for_object_and_get_data ( h, *dot[i].ptr, param );
+			h->parse_depth++;
+			dot->set_links_for_object_and_get_data ( h, *dot->ptr, param );
+			h->parse_depth--;
 			}
 			break;
 		case json_type_array: {
-			if ( dot[i].size <= 0 ) break;
+			if ( dot->size <= 0 ) break;
+			if ( is_lazy_field ( h, dot, type ) && lazy_add ( h, param, dot ) == 0 ) break;
 			const int count = json_object_array_length ( param );
 			void **p = NULL;
 
-			p = calloc ( count + 1, sizeof ( void * ) );
+			p = parse_alloc ( h, ( count + 1 ) * sizeof ( void * ) );
 			if ( !p ) {
-				log_time ( LOG_LEVEL_CRITICAL, h->log_file, h->show_debug, "failed to calloc json object." );
+				log_time ( h, LOG_LEVEL_CRITICAL, "failed to calloc json object." );
 				break;
 			}	
-			void **temp = realloc ( h->for_free, sizeof ( void * ) * h->size_for_free + 1 );
-			if ( temp ) {
-				h->for_free = temp;
-				h->for_free[h->size_for_free] = p;
-				h->size_for_free++;
-			}
-			*dot[i].ptr = p;
+			*dot->ptr = p;
+			h->parse_depth++;
 			for ( int index = 0; index < count + 1; index++ ) {
-				p[index] = calloc ( 1, dot[i].size );
-				void **temp = realloc ( h->for_free, sizeof ( void * ) * h->size_for_free + 1 );
-				if ( temp ) {
-					h->for_free = temp;
-					h->for_free[h->size_for_free] = p[index];
-					h->size_for_free++;
-				}
+				p[index] = parse_alloc ( h, dot->size );
+				if ( !p[index] ) break;
 				if ( index == count ) break;
 				json_object *item = json_object_array_get_idx ( param, index );
-				dot[i].set_links_for_object_and_get_data ( h, p[index], item );
+				dot->set_links_for_object_and_get_data ( h, p[index], item );
 			}
+			h->parse_depth--;
 
 			}
 			break;
 		case json_type_boolean:
-			*( ( unsigned char * ) dot[i].ptr ) = 1;
+			*( ( unsigned char * ) dot->ptr ) = json_object_get_boolean ( param );
 			break;
 		case json_type_int:
-			*( ( long long int * ) dot[i].ptr ) = json_object_get_int64 ( param );
+			*( ( long long int * ) dot->ptr ) = json_object_get_int64 ( param );
 			break;
 		case json_type_double:
-			*( ( double * ) dot[i].ptr ) = json_object_get_double ( param );
+			*( ( double * ) dot->ptr ) = json_object_get_double ( param );
 			break;
 		case json_type_string: {
 			const char *str = json_object_get_string ( param );
-			const int length = strlen ( str );
-			*dot[i].ptr = ( char * ) calloc ( length + 1, 1 );
-			void **temp = realloc ( h->for_free, sizeof ( void * ) * h->size_for_free + 1 );
-			if ( temp ) {
-				h->for_free = temp;
-				h->for_free[h->size_for_free] = *( dot[i].ptr );
-				h->size_for_free++;
-			}
-			strncpy ( *dot[i].ptr, str, length );
+			*dot->ptr = tebot_arena_strndup ( parse_arena ( h ), str, json_object_get_string_len ( param ) );
 	 		}
 			break;
 		default:
@@ -366,1673 +702,491 @@ void parse_current_object ( tebot_handler_t *h, json_object *json_result, struct
 	}
 }
 
-static int parse_data ( tebot_handler_t *h, char *data, struct data_of_types dot[], const int size, const int index_of_array ) {
+static const struct tebot_fields *fields_child ( const struct tebot_fields *f, const char *name ) {
+	const struct tebot_fields *any = NULL;
+	const size_t length = strlen ( name );
 
-	json_object *root = NULL;
-	json_object *ok = NULL;
-	json_object *json_result = NULL;
+	for ( int i = 0; i < f->size; i++ ) {
+		const struct tebot_fields *c = f->children[i];
+		if ( c->length == length && !memcmp ( c->name, name, length ) ) return c;
+		if ( c->length == 1 && c->name[0] == '*' ) any = c;
+	}
 
-	root = json_tokener_parse ( data );
-	if ( !root ) return -1;
+	return any;
+}
 
-	ok = json_object_object_get ( root, "ok" );
-	json_type type = json_object_get_type ( ok );
-	if ( type != json_type_boolean ) goto parse_data_error;
-	json_bool ok_bool = json_object_get_boolean ( ok );
-	if ( ok_bool != 1 ) goto parse_data_error;
+/*
+ * node of mask belongs to tree of handler and is used by one thread, so
+ * bits are made on the first parse of type under it. "*" above node can
+ * give it several types, then bits are made again when type changes.
+ */
+static const unsigned long long int *fields_bits ( const struct tebot_fields *mask, const struct field_of_type *fields, const int size ) {
+	struct tebot_fields *f = ( struct tebot_fields * ) mask;
 
-	json_result = json_object_object_get ( root, "result" );
-	if ( !json_result ) {
-		goto parse_data_error;
+	if ( f->bits_of == fields ) return f->bits;
+
+	memset ( f->bits, 0, sizeof ( f->bits ) );
+	for ( int i = 0; i < size && i < FIELDS_BITS * 64; i++ ) {
+		if ( fields_child ( f, fields[i].name ) ) f->bits[i / 64] |= 1ULL << ( i % 64 );
 	}
-	type = json_object_get_type ( json_result );
-	if ( type != json_type_object && type != json_type_array ) goto parse_data_error;
+	f->bits_of = fields;
 
-	if ( type == json_type_array ) {
-		size_t array_length = json_object_array_length ( json_result );
-		if ( index_of_array >= array_length ) return 1;
+	return f->bits;
+}
 
-		if ( index_of_array >= 0 && index_of_array < array_length ) {
-			json_object *obj = json_object_array_get_idx ( json_result, index_of_array );
-			for ( int i = 0; i < size; i++ ) {
-				parse_current_object ( h, obj, dot, i );
-			}
-		} else {
-			for ( int index = 0; index < array_length; index++ ) {
-				json_object *obj = json_object_array_get_idx ( json_result, index );
+/*
+ * keys not in mask are skipped before json lookup, so they cost only
+ * compare of length with selected names.
+ */
+void parse_current_object ( tebot_handler_t *h, json_object *json_result, struct data_of_types dot[], const int i ) {
+	const struct tebot_fields *mask = h->mask;
+	const struct tebot_fields *child = NULL;
 
-				for ( int i = 0; i < size; i++ ) {
-					parse_current_object ( h, json_result, dot, i );
-				}
-			}
-		}
+	if ( mask ) {
+		child = fields_child ( mask, dot[i].name );
+		if ( !child ) return;
+	}
 
-	} else if ( type == json_type_object ) {
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, json_result, dot, i );
-		}
+	json_object *param = json_object_object_get ( json_result, dot[i].name );
+	if ( !param ) {
+		return;
 	}
 
+	h->mask = child && child->size && !child->is_all ? child : NULL;
+	parse_value ( h, param, &dot[i] );
+	h->mask = mask;
+}
 
-	json_object_put ( root );
+/*
+ * generated parsers already have value of key and tested bit of mask, node
+ * of mask below is looked up only for objects.
+ */
+static void parse_field ( tebot_handler_t *h, json_object *param, void *data, const struct field_of_type *f ) {
+	const struct tebot_fields *mask = h->mask;
 
-	return 0;
-parse_data_error:
-	if ( root ) json_object_put ( root );
-	return -1;
+	void *ptr = ( char * ) data + f->offset;
+
+	switch ( f->type_of_param ) {
+		case TYPE_OF_PARAM_INT:
+			*( ( long long int * ) ptr ) = json_object_get_int64 ( param );
+			break;
+		case TYPE_OF_PARAM_FLOAT:
+			*( ( double * ) ptr ) = json_object_get_double ( param );
+			break;
+		case TYPE_OF_PARAM_BOOLEAN:
+			*( ( char * ) ptr ) = json_object_get_boolean ( param );
+			break;
+		default: {
+			struct data_of_types dot = { f->name, ptr, f->size, f->set_links_for_object_and_get_data };
+			const struct tebot_fields *child = mask ? fields_child ( mask, f->name ) : NULL;
+			h->mask = child && child->size && !child->is_all ? child : NULL;
+			parse_value ( h, param, &dot );
+			h->mask = mask;
+			}
+			break;
+	}
 }
 
-static int parse_data_webhook ( tebot_handler_t *h, char *data, struct data_of_types dot[], const int size, const int index_of_array ) {
+static void fields_free ( const tebot_allocator_t *a, struct tebot_fields *f ) {
+	if ( !f ) return;
 
-	json_object *root = NULL;
-	json_object *json_result = NULL;
+	for ( int i = 0; i < f->size; i++ ) fields_free ( a, f->children[i] );
+	tebot_free ( a, f->children );
+	tebot_free ( a, f->name );
+	tebot_free ( a, f );
+}
 
-	root = json_tokener_parse ( data );
-	if ( !root ) return -1;
+static struct tebot_fields *fields_copy ( const tebot_allocator_t *a, const struct tebot_fields *f ) {
+	struct tebot_fields *c = tebot_calloc ( a, 1, sizeof ( struct tebot_fields ) );
+	if ( !c ) return NULL;
 
-	for ( int i = 0; i < size; i++ ) {
-		parse_current_object ( h, root, dot, i );
+	c->length = f->length;
+	c->is_all = f->is_all;
+	c->name = f->name ? tebot_strndup ( a, f->name, f->length ) : NULL;
+	c->children = f->size ? tebot_calloc ( a, f->size, sizeof ( struct tebot_fields * ) ) : NULL;
+	if ( ( f->name && !c->name ) || ( f->size && !c->children ) ) {
+		fields_free ( a, c );
+		return NULL;
 	}
 
-	json_object_put ( root );
+	for ( c->size = 0; c->size < f->size; c->size++ ) {
+		c->children[c->size] = fields_copy ( a, f->children[c->size] );
+		if ( !c->children[c->size] ) {
+			fields_free ( a, c );
+			return NULL;
+		}
+	}
 
-	return 0;
-parse_data_error:
-	if ( root ) json_object_put ( root );
-	return -1;
+	return c;
 }
 
-tebot_user_t *tebot_method_get_me ( tebot_handler_t *h ) {
+static struct tebot_fields *fields_add ( tebot_handler_t *h, struct tebot_fields *f, const char *name, const size_t length ) {
+	for ( int i = 0; i < f->size; i++ ) {
+		if ( f->children[i]->length == length && !memcmp ( f->children[i]->name, name, length ) ) return f->children[i];
+	}
 
-	char *data = tebot_request_get ( h, "getMe", NULL, 0 );
+	struct tebot_fields **children = tebot_realloc ( &h->allocator, f->children, ( f->size + 1 ) * sizeof ( struct tebot_fields * ) );
+	if ( !children ) return NULL;
+	f->children = children;
 
-	tebot_user_t *user = calloc ( 1, sizeof ( tebot_user_t ) );
+	struct tebot_fields *c = tebot_calloc ( &h->allocator, 1, sizeof ( struct tebot_fields ) );
+	if ( !c ) return NULL;
 
-	struct data_of_types dot[] = {
-		{ "id", (void **) &user->id },
-		{ "is_bot", (void **) &user->is_bot },
-		{ "first_name", (void **) &user->first_name },
-		{ "username", (void **) &user->username },
-		{ "can_join_groups", (void **) &user->can_join_groups },
-		{ "can_read_all_group_messages", (void **) &user->can_read_all_group_messages },
-		{ "supports_inline_queries", (void **) &user->supports_inline_queries }
-	};
-
-	int ret = parse_data ( h, data, dot, 7, -1 );
-	if ( ret == -1 ) {
-		log_time ( LOG_LEVEL_NOTICE, h->log_file, h->show_debug, "failed to parse data: %s\n", data );
-	}
-
-	return user;
-}
-
-void *strdup_printf ( char *fmt, ... ) {
-	va_list ap;
-	char *p;
-	int size = 0;
-
-	va_start ( ap, fmt );
-	size = vsnprintf ( p, size, fmt, ap );
-	va_end ( ap );
-
-	if ( size < 0 ) return NULL;
-
-	size++;
-	p = calloc ( size, 1 );
-	if ( !p ) return NULL; 
-
-	va_start ( ap, fmt );
-	size = vsnprintf ( p, size, fmt, ap );
-	va_end ( ap );
-
-	if ( size < 0 ) {
-		free ( p );
+	c->name = tebot_strndup ( &h->allocator, name, length );
+	if ( !c->name ) {
+		tebot_free ( &h->allocator, c );
 		return NULL;
 	}
+	c->length = length;
 
-	return p;
-}
-
-#if 0
-static void handler_template ( tebot_handler_t *h, void *data, json_object *obj ) {
-	tebot_template_t *ob = ( tebot_template_t * ) data;
-
-	json_type type = json_object_get_type ( obj );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "id", (void **) &ob->id },
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, obj, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-#endif
-
-static void handler_inline_query ( tebot_handler_t *h, void *data, json_object *obj ) {
-	tebot_inline_query_t *ob = ( tebot_inline_query_t * ) data;
-
-	json_type type = json_object_get_type ( obj );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "id", (void **) &ob->id },
-			{ "from", (void **) &ob->from, sizeof ( tebot_user_t ), handler_user },
-			{ "location", (void **) &ob->location, sizeof ( tebot_location_t ), handler_location },
-			{ "query", (void **) &ob->query },
-			{ "offset", (void **) &ob->offset }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, obj, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_chosen_inline_result ( tebot_handler_t *h, void *data, json_object *obj ) {
-	tebot_chosen_inline_result_t *ob = ( tebot_chosen_inline_result_t * ) data;
-
-	json_type type = json_object_get_type ( obj );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "result_id", (void **) &ob->result_id },
-			{ "from", (void **) &ob->from, sizeof ( tebot_user_t ), handler_user },
-			{ "location", (void **) &ob->location, sizeof ( tebot_location_t ), handler_location },
-			{ "inline_message_id", (void **) &ob->inline_message_id },
-			{ "query", (void **) &ob->query }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, obj, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_callback_query ( tebot_handler_t *h, void *data, json_object *obj ) {
-	tebot_callback_query_t *ob = ( tebot_callback_query_t * ) data;
-
-	json_type type = json_object_get_type ( obj );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "id", (void **) &ob->id },
-			{ "from", (void **) &ob->from, sizeof ( tebot_user_t ), handler_user },
-			{ "message", (void **) &ob->message, sizeof ( tebot_message_t ), handler_message },
-			{ "inline_message_id", (void **) &ob->inline_message_id },
-			{ "chat_instance", (void **) &ob->chat_instance },
-			{ "data", (void **) &ob->data },
-			{ "game_short_name", (void **) ob->game_short_name }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, obj, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
+	f->children[f->size++] = c;
 
-		return;
-	}
+	return c;
 }
 
-static void handler_shipping_query ( tebot_handler_t *h, void *data, json_object *obj ) {
-	tebot_shipping_query_t *ob = ( tebot_shipping_query_t * ) data;
-
-	json_type type = json_object_get_type ( obj );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "id", (void **) &ob->id },
-			{ "from", (void **) &ob->from, sizeof ( tebot_user_t ), handler_user },
-			{ "invoice_payload", (void **) &ob->invoice_payload },
-			{ "shipping_address", (void **) &ob->shipping_address, sizeof ( tebot_shipping_address_t ),
-				handler_shipping_address }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
+/*
+ * paths are split by comma, keys of path by dot. update_id is always
+ * taken, offsets and dedup need it.
+ */
+int tebot_set_fields ( tebot_handler_t *h, const char *fields ) {
+	struct tebot_fields *root = NULL;
 
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, obj, dot, i );
-		}
+	if ( fields ) {
+		root = tebot_calloc ( &h->allocator, 1, sizeof ( struct tebot_fields ) );
+		if ( !root || !fields_add ( h, root, "update_id", 9 ) ) goto tebot_set_fields_error;
 
-		return;
-	}
+		const char *p = fields;
+		while ( *p ) {
+			struct tebot_fields *f = root;
+			int is_key = 0;
 
-	if ( type == json_type_array ) {
+			while ( *p && *p != ',' ) {
+				while ( *p == ' ' || *p == '\t' || *p == '\n' ) p++;
 
-		return;
-	}
-}
+				const char *key = p;
+				while ( *p && *p != '.' && *p != ',' && *p != ' ' && *p != '\t' && *p != '\n' ) p++;
+				const size_t length = p - key;
+				while ( *p == ' ' || *p == '\t' || *p == '\n' ) p++;
 
-static void handler_pre_checkout_query ( tebot_handler_t *h, void *data, json_object *obj ) {
-	tebot_pre_checkout_query_t *ob = ( tebot_pre_checkout_query_t * ) data;
+				if ( length == 0 ) {
+					log_time ( h, LOG_LEVEL_CRITICAL, "empty key in fields: %s\n", fields );
+					goto tebot_set_fields_error;
+				}
 
-	json_type type = json_object_get_type ( obj );
+				f = fields_add ( h, f, key, length );
+				if ( !f ) goto tebot_set_fields_error;
+				is_key = 1;
 
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "id", (void **) &ob->id },
-			{ "from", (void **) &ob->from, sizeof ( tebot_user_t ), handler_user },
-			{ "currency", (void **) &ob->currency },
-			{ "total_amount", (void **) &ob->total_amount },
-			{ "invoice_payload", (void **) &ob->invoice_payload },
-			{ "shipping_option_id", (void **) &ob->shipping_option_id },
-			{ "order_info", (void **) &ob->order_info, sizeof ( tebot_order_info_t ), handler_order_info }
-		};
+				if ( *p == '.' ) p++;
+			}
 
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
+			if ( is_key ) f->is_all = 1;
 
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, obj, dot, i );
+			if ( !is_key && *p == ',' ) {
+				log_time ( h, LOG_LEVEL_CRITICAL, "empty path in fields: %s\n", fields );
+				goto tebot_set_fields_error;
+			}
+			if ( *p == ',' ) p++;
 		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
 	}
-}
-
-static void handler_poll_answer ( tebot_handler_t *h, void *data, json_object *obj ) {
-	tebot_poll_answer_t *ob = ( tebot_poll_answer_t * ) data;
-
-	json_type type = json_object_get_type ( obj );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "poll_id", (void **) &ob->poll_id },
-			{ "user", (void **) &ob->user, sizeof ( tebot_user_t ), handler_user },
-			{ "option_ids", (void **) &ob->option_ids }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
 
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, obj, dot, i );
-		}
-
-		return;
-	}
+	fields_free ( &h->allocator, h->fields );
+	h->fields = root;
 
-	if ( type == json_type_array ) {
+	return 0;
 
-		return;
-	}
+tebot_set_fields_error:
+	fields_free ( &h->allocator, root );
+	return -1;
 }
 
-static void handler_login_url ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_login_url_t *obj = ( tebot_login_url_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "url", (void **) &obj->url },
-			{ "forward_text", (void **) &obj->forward_text },
-			{ "bot_username", (void **) &obj->bot_username },
-			{ "request_write_access", (void **) &obj->request_write_access }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
+/*
+ * root of the previous parse and its lazy fields are given back when
+ * next parse starts or by tebot_free_update.
+ */
+static void lazy_reset ( tebot_handler_t *h ) {
+	if ( !h->lazy ) return;
 
-		return;
-	}
+	if ( h->lazy->root ) json_object_put ( h->lazy->root );
+	memset ( h->lazy, 0, sizeof ( struct tebot_lazy ) );
 }
 
-static void handler_callback_game ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_callback_game_t *obj = ( tebot_callback_game_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-#if 0
-		struct data_of_types dot[] = {
-			{ "id", (void **) &obj->id },
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, obj, dot, i );
-		}
-#endif
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
+static void lazy_keep ( tebot_handler_t *h, json_object *root ) {
+	if ( h->lazy && h->lazy->size > 0 ) h->lazy->root = root;
+	else json_object_put ( root );
 }
 
-static void handler_inline_keyboard_button ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_inline_keyboard_button_t *obj = ( tebot_inline_keyboard_button_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "text", (void **) &obj->text },
-			{ "url", (void **) &obj->url },
-			{ "login_url", (void **) &obj->login_url, sizeof ( tebot_login_url_t ), handler_login_url },
-			{ "callback_data", (void **) &obj->callback_data },
-			{ "switch_inline_query", (void **) &obj->switch_inline_query },
-			{ "switch_inline_query_current_chat", (void **) &obj->switch_inline_query_current_chat },
-			{ "callback_game", (void **) &obj->callback_game, sizeof ( tebot_callback_game_t ), 
-				handler_callback_game },
-			{ "pay", (void **) &obj->pay }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
+void tebot_set_lazy ( tebot_handler_t *h, const int is_lazy ) {
+	if ( !is_lazy ) {
+		lazy_reset ( h );
+		tebot_free ( &h->allocator, h->lazy );
+		h->lazy = NULL;
 		return;
 	}
 
-	if ( type == json_type_array ) {
-
-		return;
-	}
+	if ( !h->lazy ) h->lazy = tebot_calloc ( &h->allocator, 1, sizeof ( struct tebot_lazy ) );
 }
 
-static void handler_inline_keyboard_markup ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_inline_keyboard_markup_t *obj = ( tebot_inline_keyboard_markup_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
+void *tebot_lazy ( tebot_handler_t *h, void **field ) {
+	struct tebot_lazy *l = h->lazy;
+	if ( !l || !l->size || *field ) return *field;
 
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "inline_keyboard", (void **) &obj->inline_keyboard, sizeof ( tebot_inline_keyboard_button_t ),
-		       		handler_inline_keyboard_button	},
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
+	unsigned int n = lazy_slot ( field, l->capacity );
+	while ( l->fields[n].ptr && l->fields[n].ptr != field ) n = ( n + 1 ) & ( l->capacity - 1 );
 
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
+	struct lazy_field *lf = &l->fields[n];
+	if ( !lf->ptr || !lf->param ) return *field;
 
-		return;
-	}
+	json_object *param = lf->param;
+	struct data_of_types dot = lf->dot;
+	lf->param = NULL;
 
-	if ( type == json_type_array ) {
+	h->parse_depth = 1;
+	h->mask = lf->mask;
+	parse_value ( h, param, &dot );
+	h->mask = NULL;
+	h->parse_depth = 0;
 
-		return;
-	}
+	return *field;
 }
 
-static void handler_voice_chat_participants_invited ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_voice_chat_participants_invited_t *obj = ( tebot_voice_chat_participants_invited_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "users", (void **) &obj->users, sizeof ( tebot_user_t ), handler_user }
-		};
+/*
+ * root is parsed answer of api, index_of_array is item of result to fill
+ * dot from. 1 is returned when there is no such item.
+ */
+static int parse_result ( tebot_handler_t *h, json_object *root, struct data_of_types dot[], const int size, const int index_of_array ) {
 
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
+	json_object *ok = NULL;
+	json_object *json_result = NULL;
 
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
+	ok = json_object_object_get ( root, "ok" );
+	json_type type = json_object_get_type ( ok );
+	if ( type != json_type_boolean ) return -1;
+	json_bool ok_bool = json_object_get_boolean ( ok );
+	if ( ok_bool != 1 ) return -1;
 
-		return;
+	json_result = json_object_object_get ( root, "result" );
+	if ( !json_result ) {
+		return -1;
 	}
+	type = json_object_get_type ( json_result );
+	if ( type != json_type_object && type != json_type_array ) return -1;
 
 	if ( type == json_type_array ) {
+		size_t array_length = json_object_array_length ( json_result );
+		if ( index_of_array >= array_length ) return 1;
 
-		return;
-	}
-}
-
-static void handler_voice_chat_ended ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_voice_chat_ended_t *obj = ( tebot_voice_chat_ended_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "duration", (void **) &obj->duration }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
+		if ( index_of_array >= 0 && index_of_array < array_length ) {
+			json_object *obj = json_object_array_get_idx ( json_result, index_of_array );
+			for ( int i = 0; i < size; i++ ) {
+				parse_current_object ( h, obj, dot, i );
+			}
+		} else {
+			for ( int index = 0; index < array_length; index++ ) {
+				json_object *obj = json_object_array_get_idx ( json_result, index );
 
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_voice_chat_started ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_voice_chat_started_t *obj = ( tebot_voice_chat_started_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-#if 0
-		struct data_of_types dot[] = {
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, obj, dot, i );
-		}
-
-#endif
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_proximity_alert_triggered ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_proximity_alert_triggered_t *obj = ( tebot_proximity_alert_triggered_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "traveler", (void **) &obj->traveler, sizeof ( tebot_user_t ), handler_user },
-			{ "watcher", (void **) &obj->watcher, sizeof ( tebot_user_t ), handler_user },
-			{ "distance", (void **) &obj->distance }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_encrypted_credentials ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_encrypted_credentials_t *obj = ( tebot_encrypted_credentials_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "data", (void **) &obj->data },
-			{ "hash", (void **) &obj->hash },
-			{ "secret", (void **) &obj->secret }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_passport_file ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_passport_file_t *obj = ( tebot_passport_file_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "file_id", (void **) &obj->file_id },
-			{ "file_unique_id", (void **) &obj->file_unique_id },
-			{ "file_size", (void **) &obj->file_size },
-			{ "file_date", (void **) &obj->file_date }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_encrypted_passport_element ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_encrypted_passport_element_t *obj = ( tebot_encrypted_passport_element_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "type", (void **) &obj->type },
-			{ "data", (void **) &obj->data },
-			{ "phone_number", (void **) &obj->phone_number },
-			{ "email", (void **) &obj->email },
-			{ "files", (void **) &obj->files, sizeof ( tebot_passport_file_t ), handler_passport_file },
-			{ "front_side", (void **) &obj->front_side, sizeof ( tebot_passport_file_t ), handler_passport_file },
-			{ "reverse_side", (void **) &obj->reverse_side, sizeof ( tebot_passport_file_t ), handler_passport_file },
-			{ "selfie", (void **) &obj->selfie, sizeof ( tebot_passport_file_t ), handler_passport_file },
-			{ "translation", (void **) &obj->translation, sizeof ( tebot_passport_file_t ), handler_passport_file },
-			{ "hash", (void **) &obj->hash }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_passport_data ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_passport_data_t *obj = ( tebot_passport_data_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "data", (void **) &obj->data, sizeof ( tebot_encrypted_passport_element_t ), 
-		       		handler_encrypted_passport_element	},
-			{ "credentials", (void **) &obj->credentials, sizeof ( tebot_encrypted_credentials_t ),
-				handler_encrypted_credentials }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_shipping_address ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_shipping_address_t *obj = ( tebot_shipping_address_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "country_code", (void **) &obj->country_code },
-			{ "state", (void **) &obj->state },
-			{ "city", (void **) &obj->city },
-			{ "street_line1", (void **) &obj->street_line1 },
-			{ "street_line2", (void **) &obj->street_line2 },
-			{ "post_code", (void **) &obj->post_code }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_order_info ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_order_info_t *obj = ( tebot_order_info_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "name", (void **) &obj->name },
-			{ "phone_number", (void **) &obj->phone_number },
-			{ "email", (void **) &obj->email },
-			{ "shipping_address", (void **) &obj->shipping_address, sizeof ( tebot_shipping_address_t ),
-				handler_shipping_address }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_successful_payment ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_successful_payment_t *obj = ( tebot_successful_payment_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "currency", (void **) &obj->currency },
-			{ "total_amount", (void **) &obj->total_amount },
-			{ "invoice_payload", (void **) &obj->invoice_payload },
-			{ "shipping_option_id", (void **) &obj->shipping_option_id },
-			{ "order_info", (void **) &obj->order_info, sizeof ( tebot_order_info_t ), handler_order_info },
-			{ "telegram_payment_charge_id", (void **) &obj->telegram_payment_charge_id },
-			{ "provider_payment_charge_id", (void **) &obj->provider_payment_charge_id }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_invoice ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_invoice_t *obj = ( tebot_invoice_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "title", (void **) &obj->title },
-			{ "descpription", (void **) &obj->description },
-			{ "start_parameter", (void **) &obj->start_parameter },
-			{ "currency", (void **) &obj->currency },
-			{ "total_amount", (void **) &obj->total_amount }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_message_auto_delete_timer_changed ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_message_auto_delete_timer_changed_t *obj = ( tebot_message_auto_delete_timer_changed_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "message_auto_delete_time", (void **) &obj->message_auto_delete_time }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_venue ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_venue_t *obj = ( tebot_venue_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "location", (void **) &obj->location, sizeof ( tebot_location_t ), handler_location },
-			{ "title", (void **) &obj->title },
-			{ "address", (void **) &obj->address },
-			{ "foursquare_id", (void **) &obj->foursquare_id },
-			{ "foursquare_type", (void **) &obj->foursquare_type },
-			{ "google_place_id", (void **) &obj->google_place_id },
-			{ "google_place_type", (void **) &obj->google_place_type }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_poll_option ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_poll_option_t *obj = ( tebot_poll_option_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "text", (void **) &obj->text },
-			{ "voter_count", (void **) &obj->voter_count }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_poll ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_poll_t *obj = ( tebot_poll_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "id", (void **) &obj->id },
-			{ "question", (void **) &obj->question },
-			{ "options", (void **) &obj->options, sizeof ( tebot_poll_option_t ), handler_poll_option },
-			{ "total_voter_count", (void **) &obj->total_voter_count },
-			{ "is_closed", (void **) &obj->is_closed },
-			{ "is_anonymous", (void **) &obj->is_anonymous },
-			{ "type", (void **) &obj->type },
-			{ "allows_multiple_answers", (void **) &obj->allows_multiple_answers },
-			{ "correct_option_id", (void **) &obj->correct_option_id },
-			{ "explanation", (void **) &obj->explanation },
-			{ "explanation_entities", (void **) &obj->explanation_entities, sizeof ( tebot_message_entity_t ),
-				handler_message_entity },
-			{ "open_period", (void **) &obj->open_period },
-			{ "close_date", (void **) &obj->close_date }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_game ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_game_t *obj = ( tebot_game_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "title", (void **) &obj->title },
-			{ "description", (void **) &obj->description },
-			{ "photo", (void **) &obj->photo, sizeof ( tebot_photo_size_t ), handler_photo_size },
-			{ "text", (void **) &obj->text },
-			{ "text_entities", (void **) &obj->text_entities, sizeof ( tebot_message_entity_t ), handler_message_entity },
-			{ "animation", (void **) &obj->animation, sizeof ( tebot_animation_t ), handler_animation }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_dice ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_dice_t *obj = ( tebot_dice_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "emoji", (void **) &obj->emoji },
-			{ "value", (void **) &obj->value }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_contact ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_contact_t *obj = ( tebot_contact_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "phone_number", (void **) &obj->phone_number },
-			{ "first_name", (void **) &obj->first_name },
-			{ "last_name", (void **) &obj->last_name },
-			{ "user_id", (void **) &obj->user_id },
-			{ "vcard", (void **) &obj->vcard }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_voice ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_voice_t *obj = ( tebot_voice_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "file_id", (void **) &obj->file_id },
-			{ "file_unique_id", (void **) &obj->file_unique_id },
-			{ "duration", (void **) &obj->duration },
-			{ "mime_type", (void **) &obj->mime_type },
-			{ "file_size", (void **) &obj->file_size }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-static void handler_video_note ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_video_note_t *obj = ( tebot_video_note_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "file_id", (void **) &obj->file_id },
-			{ "file_unique_id", (void **) &obj->file_unique_id },
-			{ "length", (void **) &obj->length },
-			{ "duration", (void **) &obj->duration },
-			{ "thumb", (void **) &obj->thumb, sizeof ( tebot_photo_size_t ), handler_photo_size },
-			{ "file_size", (void **) &obj->file_size }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-static void handler_video ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_video_t *obj = ( tebot_video_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "file_id", (void **) &obj->file_id },
-			{ "file_unique_id", (void **) &obj->file_unique_id },
-			{ "width", (void **) &obj->width },
-			{ "height", (void **) &obj->height },
-			{ "duration", (void **) &obj->duration },
-			{ "thumb", (void **) &obj->thumb, sizeof ( tebot_photo_size_t ), handler_photo_size },
-			{ "file_name", (void **) &obj->file_name },
-			{ "mime_type", (void **) &obj->mime_type },
-			{ "file_size", (void **) &obj->file_size }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_mask_position ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_mask_position_t *obj = ( tebot_mask_position_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "point", (void **) &obj->point },
-			{ "x_shift", (void **) &obj->x_shift },
-			{ "y_shift", (void **) &obj->y_shift },
-			{ "scale", (void **) &obj->scale }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_sticker ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_sticker_t *sticker = ( tebot_sticker_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "file_id", (void **) &sticker->file_id },
-			{ "file_unique_id", (void **) &sticker->file_unique_id },
-			{ "width", (void **) &sticker->width },
-			{ "height", (void **) &sticker->height },
-			{ "is_animated", (void **) &sticker->is_animated },
-			{ "thumb", (void **) &sticker->thumb, sizeof ( tebot_photo_size_t ), handler_photo_size },
-			{ "emoji", (void **) &sticker->emoji },
-			{ "set_name", (void **) &sticker->set_name },
-			{ "mask_position", (void **) &sticker->mask_position, sizeof ( tebot_mask_position_t ), handler_mask_position },
-			{ "file_size", (void **) &sticker->file_size }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_document ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_document_t *document = ( tebot_document_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "file_id", (void **) &document->file_id },
-			{ "file_unique_id", (void **) &document->file_unique_id },
-			{ "thumb", (void **) &document->thumb, sizeof ( tebot_photo_size_t ), handler_photo_size },
-			{ "file_name", (void **) &document->file_name },
-			{ "mime_type", (void **) &document->mime_type },
-			{ "file_size", (void **) &document->file_size }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_audio ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_audio_t *audio = ( tebot_audio_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "file_id", (void **) &audio->file_id },
-			{ "file_unique_id", (void **) &audio->file_unique_id },
-			{ "duration", (void **) &audio->duration },
-			{ "performer", (void **) &audio->performer },
-			{ "title", (void **) &audio->title },
-			{ "file_name", (void **) &audio->file_name },
-			{ "mime_type", (void **) &audio->mime_type },
-			{ "file_size", (void **) &audio->file_size },
-			{ "thumb", (void **) &audio->thumb, sizeof ( tebot_photo_size_t ), handler_photo_size }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-static void handler_photo_size ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_photo_size_t *photo_size = ( tebot_photo_size_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "file_id", (void **) &photo_size->file_id },
-			{ "file_unique_id", (void **) &photo_size->file_unique_id },
-			{ "width", (void **) &photo_size->width },
-			{ "height", (void **) &photo_size->height },
-			{ "file_size", (void **) &photo_size->file_size }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_animation ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_animation_t *animation = ( tebot_animation_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "file_id", (void **) &animation->file_id },
-			{ "file_unique_id", (void **) &animation->file_unique_id },
-			{ "width", (void **) &animation->width },
-			{ "height", (void **) &animation->height },
-			{ "duration", (void **) &animation->duration },
-			{ "thumb", (void **) &animation->thumb, sizeof ( tebot_photo_size_t ), handler_photo_size },
-			{ "file_name", (void **) &animation->file_name },
-			{ "mime_type", (void **) &animation->mime_type },
-			{ "file_size", (void **) &animation->file_size }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_message_entity ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_message_entity_t *message_entity = ( tebot_message_entity_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "type", (void **) &message_entity->type },
-			{ "offset", (void **) &message_entity->offset },
-			{ "length", (void **) &message_entity->length },
-			{ "url", (void **) &message_entity->url },
-			{ "user", (void **) &message_entity->user, sizeof ( tebot_user_t ), handler_user },
-			{ "language", (void **) &message_entity->language }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_location ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_location_t *location = ( tebot_location_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "longitude", (void **) &location->longitude },
-			{ "latitude", (void **) &location->latitude },
-			{ "horizontal_accuracy", (void **) &location->horizontal_accuracy },
-			{ "live_period", (void **) &location->live_period },
-			{ "heading", (void **) &location->heading },
-			{ "proximity_alert_radius", (void **) &location->proximity_alert_radius }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_chat_location ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_chat_location_t *chat_location = ( tebot_chat_location_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "location", (void **) &chat_location->location, sizeof ( tebot_location_t ),
-		       			handler_location	},
-			{ "address", (void **) &chat_location->address }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_chat_permissions ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_chat_permissions_t *chat_permissions = ( tebot_chat_permissions_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "can_send_messages", (void **) &chat_permissions->can_send_messages },
-			{ "can_send_media_messages", (void **) &chat_permissions->can_send_media_messages },
-			{ "can_send_polls", (void **) &chat_permissions->can_send_polls },
-			{ "can_add_web_page_previews", (void **) &chat_permissions->can_add_web_page_previews },
-			{ "can_change_info", (void **) &chat_permissions->can_change_info },
-			{ "can_invite_users", (void **) &chat_permissions->can_invite_users },
-			{ "can_pin_messages", (void **) &chat_permissions->can_pin_messages }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
-
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
-
-		return;
-	}
-
-	if ( type == json_type_array ) {
-
-		return;
-	}
-}
-
-static void handler_chat_photo ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_chat_photo_t *chat_photo = ( tebot_chat_photo_t * ) data;
-
-	json_type type = json_object_get_type ( ob );
-
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "small_file_id", (void **) &chat_photo->small_file_id },
-			{ "small_file_unique_id", (void **) &chat_photo->small_file_unique_id },
-			{ "big_file_id", (void **) &chat_photo->big_file_id },
-			{ "big_file_unique_id", (void **) &chat_photo->big_file_unique_id }
-		};
-
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
+				for ( int i = 0; i < size; i++ ) {
+					parse_current_object ( h, json_result, dot, i );
+				}
+			}
+		}
 
+	} else if ( type == json_type_object ) {
 		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
+			parse_current_object ( h, json_result, dot, i );
 		}
-
-		return;
 	}
 
-	if ( type == json_type_array ) {
-
-		return;
-	}
+	return 0;
 }
 
-static void handler_chat ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_chat_t *chat = ( tebot_chat_t * ) data;
+static int parse_data ( tebot_handler_t *h, char *data, struct data_of_types dot[], const int size, const int index_of_array ) {
+	json_object *root = json_tokener_parse ( data );
+	if ( !root ) return -1;
 
-	json_type type = json_object_get_type ( ob );
+	const int ret = parse_result ( h, root, dot, size, index_of_array );
 
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "id", (void **) &chat->id },
-			{ "type", (void **) &chat->type },
-			{ "title", (void **) &chat->title },
-			{ "username", (void **) &chat->username },
-			{ "first_name", (void **) &chat->first_name },
-			{ "last_name", (void **) &chat->last_name },
-			{ "photo", (void **) &chat->photo, sizeof ( tebot_chat_photo_t ), handler_chat_photo },
-			{ "bio", (void **) &chat->bio },
-			{ "description", (void **) &chat->description },
-			{ "invite_link", (void **) &chat->invite_link },
-			{ "pinned_message", (void **) &chat->pinned_message, sizeof ( tebot_message_t ), handler_message },
-			{ "permissions", (void **) &chat->permissions, sizeof ( tebot_chat_permissions_t ), handler_chat_permissions },
-			{ "slow_mode_delay", (void **) &chat->slow_mode_delay },
-			{ "message_auto_delete_time", (void **) &chat->message_auto_delete_time },
-			{ "sticker_set_name", (void **) &chat->sticker_set_name },
-			{ "can_set_sticker_set", (void **) &chat->can_set_sticker_set },
-			{ "linked_chat_id", (void **) &chat->linked_chat_id },
-			{ "location", (void **) &chat->location, sizeof ( tebot_chat_location_t ), handler_chat_location }
-		};
+	json_object_put ( root );
 
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
+	return ret;
+}
 
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
+/*
+ * tokener of handler is reused, so its buffers are not allocated again for
+ * every request.
+ */
+static int parse_data_webhook ( tebot_handler_t *h, const char *data, const size_t length, struct data_of_types dot[], const int size, const int index_of_array ) {
 
-		return;
-	}
+	if ( !h->tokener ) h->tokener = json_tokener_new ( );
+	if ( !h->tokener ) return -1;
 
-	if ( type == json_type_array ) {
+	json_tokener_reset ( h->tokener );
+	json_object *root = json_tokener_parse_ex ( h->tokener, data, length );
+	if ( !root ) {
+		/*
+		 * tokener waits for more bytes when body is cut, so truncated
+		 * body is told apart from broken one.
+		 */
+		const enum json_tokener_error jerr = json_tokener_get_error ( h->tokener );
+		if ( length == 0 ) log_time ( h, LOG_LEVEL_NOTICE, "webhook body is empty\n" );
+		else if ( jerr == json_tokener_continue ) log_time ( h, LOG_LEVEL_NOTICE, "webhook body is truncated at %zu bytes\n", length );
+		else log_time ( h, LOG_LEVEL_NOTICE, "webhook body is not json: %s\n", json_tokener_error_desc ( jerr ) );
+		return -1;
+	}
 
-		return;
+	for ( int i = 0; i < size; i++ ) {
+		parse_current_object ( h, root, dot, i );
 	}
-}
 
-static void handler_user ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_user_t *user = ( tebot_user_t * ) data;
+	lazy_keep ( h, root );
 
-	json_type type = json_object_get_type ( ob );
+	return 0;
+}
 
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "id", (void **) &user->id },
-			{ "is_bot", (void **) &user->is_bot },
-			{ "first_name", (void **) &user->first_name },
-			{ "last_name", (void **) &user->last_name },
-			{ "username", (void **) &user->username },
-			{ "language_code", (void **) &user->language_code },
-			{ "can_join_groups", (void **) &user->can_join_groups },
-			{ "can_read_all_group_messages", (void **) &user->can_read_all_group_messages },
-			{ "supports_inline_queries", (void **) &user->supports_inline_queries }
-		};
+tebot_user_t *tebot_method_get_me ( tebot_handler_t *h ) {
 
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
+	char *data = tebot_request_get ( h, "getMe", NULL, 0 );
 
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
+	tebot_user_t *user = tebot_calloc ( &h->allocator, 1, sizeof ( tebot_user_t ) );
+	if ( !user ) return NULL;
 
-		return;
-	}
+	struct data_of_types dot[] = {
+		{ "id", (void **) &user->id },
+		{ "is_bot", (void **) &user->is_bot },
+		{ "first_name", (void **) &user->first_name },
+		{ "username", (void **) &user->username },
+		{ "can_join_groups", (void **) &user->can_join_groups },
+		{ "can_read_all_group_messages", (void **) &user->can_read_all_group_messages },
+		{ "supports_inline_queries", (void **) &user->supports_inline_queries }
+	};
 
-	if ( type == json_type_array ) {
+	/*
+	 * user is kept by caller after tebot_free_update, so it is parsed in
+	 * own arena and its strings are copied out with allocator of handler.
+	 */
+	tebot_arena_t *arena = h->arena;
+	h->arena = NULL;
 
-		return;
+	int ret = parse_data ( h, data, dot, 7, -1 );
+	if ( ret == -1 ) {
+		log_time ( h, LOG_LEVEL_NOTICE, "failed to parse data: %s\n", data );
 	}
-}
 
-static void handler_message ( tebot_handler_t *h, void *data, json_object *ob ) {
-	tebot_message_t *msg = ( tebot_message_t * ) data;
+	if ( user->first_name ) user->first_name = tebot_strdup ( &h->allocator, user->first_name );
+	if ( user->username ) user->username = tebot_strdup ( &h->allocator, user->username );
 
-	json_type type = json_object_get_type ( ob );
+	tebot_arena_free ( h->arena );
+	h->arena = arena;
 
-	if ( type == json_type_object ) {
+	return user;
+}
 
-		struct data_of_types dot[] = {
-			{ "message_id", (void **) &msg->message_id },
-			{ "from", (void **) &msg->from, sizeof ( tebot_user_t ), handler_user },
-			{ "sender_chat", (void **) &msg->sender_chat, sizeof ( tebot_chat_t ), handler_chat },
-			{ "date", (void **) &msg->date },
-			{ "chat", (void **) &msg->chat, sizeof ( tebot_chat_t ), handler_chat },
-			{ "forward_from", (void **) &msg->forward_from, sizeof ( tebot_user_t ), handler_user },
-			{ "forward_from_chat", (void **) &msg->forward_from_chat, sizeof ( tebot_chat_t ), handler_chat },
-			{ "forward_from_message_id", (void **) &msg->forward_from_message_id },
-			{ "forward_signature", (void **) &msg->forward_signature },
-			{ "forward_sender_name", (void **) &msg->forward_sender_name },
-			{ "forward_date", (void **) &msg->forward_date },
-			{ "reply_to_message", (void **) &msg->reply_to_message, sizeof ( tebot_message_t ), handler_message },
-			{ "via_bot", (void **) &msg->via_bot, sizeof ( tebot_user_t ), handler_user },
-			{ "edit_date", (void **) &msg->edit_date },
-			{ "media_group_id", (void **) &msg->media_group_id },
-			{ "author_signature", (void **) &msg->author_signature },
-			{ "text", (void **) &msg->text },
-			{ "entities", (void **) &msg->entities, sizeof ( tebot_message_entity_t ), handler_message_entity },
-			{ "animation", (void **) &msg->animation, sizeof ( tebot_animation_t ), handler_animation },
-			{ "audio", (void **) &msg->audio, sizeof ( tebot_audio_t ), handler_audio },
-			{ "document", (void **) &msg->document, sizeof ( tebot_document_t ), handler_document },
-			{ "photo", (void **) &msg->photo, sizeof ( tebot_photo_size_t ), handler_photo_size },
-			{ "sticker", (void **) &msg->sticker, sizeof ( tebot_sticker_t ), handler_sticker },
-			{ "video", (void **) &msg->video, sizeof ( tebot_video_t ), handler_video },
-			{ "video_note", (void **) &msg->video_note, sizeof ( tebot_video_note_t ), handler_video_note },
-			{ "voice", (void **) &msg->voice, sizeof ( tebot_voice_t ), handler_voice },
-			{ "caption", (void **) &msg->caption },
-			{ "caption_entities", (void **) &msg->caption_entities, sizeof ( tebot_message_entity_t ),
-				handler_message_entity },
-			{ "contact", (void **) &msg->contact, sizeof ( tebot_contact_t ), handler_contact },
-			{ "dice", (void **) &msg->dice, sizeof ( tebot_dice_t ), handler_dice },
-			{ "game", (void **) &msg->game, sizeof ( tebot_game_t ), handler_game },
-			{ "poll", (void **) &msg->poll, sizeof ( tebot_poll_t ), handler_poll },
-			{ "venue", (void **) &msg->venue, sizeof ( tebot_venue_t ), handler_venue },
-			{ "location", (void **) &msg->location, sizeof ( tebot_location_t ), handler_location },
-			{ "new_chat_members", (void **) &msg->new_chat_members, sizeof ( tebot_user_t ), handler_user },
-			{ "left_chat_member", (void **) &msg->left_chat_member, sizeof ( tebot_user_t ), handler_user },
-			{ "new_chat_title", (void **) &msg->new_chat_title },
-			{ "new_chat_photo", (void **) &msg->new_chat_photo, sizeof ( tebot_photo_size_t ), handler_photo_size },
-			{ "delete_chat_photo", (void **) &msg->delete_chat_photo },
-			{ "group_chat_created", (void **) &msg->group_chat_created },
-			{ "supergroup_chat_created", (void **) &msg->supergroup_chat_created },
-			{ "channel_chat_created", (void **) &msg->channel_chat_created },
-			{ "message_auto_delete_timer_changed", (void **) &msg->message_auto_delete_timer_changed,
-				sizeof ( tebot_message_auto_delete_timer_changed_t ),
-				handler_message_auto_delete_timer_changed },
-			{ "migrate_to_chat_id", (void **) &msg->migrate_to_chat_id },
-			{ "migrate_from_chat_id", (void **) &msg->migrate_from_chat_id },
-			{ "pinned_message", (void **) &msg->pinned_message, sizeof ( tebot_message_t ), handler_message },
-			{ "invoice", (void **) &msg->invoice, sizeof ( tebot_invoice_t ), handler_invoice },
-			{ "successful_payment", (void **) &msg->successful_payment, sizeof ( tebot_successful_payment_t ),
-				handler_successful_payment },
-			{ "connected_website", (void **) &msg->connected_website },
-			{ "passport_data", (void **) &msg->passport_data, sizeof ( tebot_passport_data_t ), handler_passport_data },
-			{ "proximity_alert_triggered", (void **) &msg->proximity_alert_triggered, sizeof ( tebot_proximity_alert_triggered_t ),
-				handler_proximity_alert_triggered },
-			{ "voice_chat_started", (void **) &msg->voice_chat_started, sizeof ( tebot_voice_chat_started_t ),
-				handler_voice_chat_started },
-			{ "voice_chat_ended", (void **) &msg->voice_chat_ended, sizeof ( tebot_voice_chat_ended_t ),
-				handler_voice_chat_ended },
-			{ "voice_chat_participants_invited", (void **) &msg->voice_chat_participants_invited,
-				sizeof ( tebot_voice_chat_participants_invited_t ),
-				handler_voice_chat_participants_invited },
-			{ "reply_markup", (void **) &msg->reply_markup, sizeof ( tebot_inline_keyboard_markup_t ),
-				handler_inline_keyboard_markup }
-		};
+void *strdup_printf ( const tebot_allocator_t *a, char *fmt, ... ) {
+	va_list ap;
+	char *p;
+	int size = 0;
 
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
+	va_start ( ap, fmt );
+	size = vsnprintf ( p, size, fmt, ap );
+	va_end ( ap );
 
-		for ( int i = 0; i < size; i++ ) {
-			parse_current_object ( h, ob, dot, i );
-		}
+	if ( size < 0 ) return NULL;
 
-		return;
-	}
+	size++;
+	p = tebot_calloc ( a, size, 1 );
+	if ( !p ) return NULL; 
 
-	if ( type == json_type_array ) {
+	va_start ( ap, fmt );
+	size = vsnprintf ( p, size, fmt, ap );
+	va_end ( ap );
 
-		return;
+	if ( size < 0 ) {
+		tebot_free ( a, p );
+		return NULL;
 	}
-}
-
-
 
+	return p;
+}
 
-static void handler_chat_member_updated ( tebot_handler_t *h, void *data, json_object *ob ) {
-	printf ( "handler_chat_member_updated\n" );
-	tebot_chat_member_updated_t *msg = ( tebot_chat_member_updated_t * ) data;
+/*
+ * handlers of types are generated by tebot_gen from schema/bot_api.def.
+ */
+#include "tebot_types.inc"
 
-	json_type type = json_object_get_type ( ob );
+static long long int usec_now ( void ) {
+	struct timespec ts;
+	clock_gettime ( CLOCK_MONOTONIC, &ts );
 
-	if ( type == json_type_object ) {
-		struct data_of_types dot[] = {
-			{ "chat", (void **) &msg->chat, sizeof ( tebot_chat_t ), handler_chat }
-		};
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
 
-		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
+static long long int usec_real ( void ) {
+	struct timespec ts;
+	clock_gettime ( CLOCK_REALTIME, &ts );
 
-		for ( int i = 0; i < size; i++ ) {
-			printf ( "handler_chat_member_updated: %d of %d\n", i, size );
-			parse_current_object ( h, ob, dot, i );
-		}
+	return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
 
-		return;
-	}
+static void stamp_parsed ( tebot_handler_t *h, tebot_result_updated_t *t, const long long int received ) {
+	if ( !h->is_timing ) return;
 
-	if ( type == json_type_array ) {
+	const long long int parsed = usec_real ( );
 
-		return;
+	for ( int i = 0; i < t->size; i++ ) {
+		if ( !t->update[i] ) continue;
+		t->update[i]->timing.received = received;
+		t->update[i]->timing.parsed = parsed;
 	}
 }
 
-
 tebot_result_updated_t *tebot_method_get_updates ( tebot_handler_t *h, const long long int offset, const int limit, 
 		const int timeout, char **allowed_updates ) {
 
-	h->size_for_free = 0;
-	h->for_free = calloc ( 0, sizeof ( void * ) );
-
-	struct mimes mimes[4] = {
-		{ MIMES_TYPE_PARAM, strdup ( "offset" ), strdup_printf ( "%lld", offset ) },
-		{ MIMES_TYPE_PARAM, strdup ( "limit" ), strdup_printf ( "%d", limit ) },
-		{ MIMES_TYPE_PARAM, strdup ( "timeout" ), strdup_printf ( "%d", timeout ) },
-		{ MIMES_TYPE_ARRAY, strdup ( "allowed_updates" ), .array = allowed_updates }
+	tebot_param_t mimes[4] = {
+		{ MIMES_TYPE_PARAM, tebot_strdup ( &h->allocator, "offset" ), strdup_printf ( &h->allocator, "%lld", offset ) },
+		{ MIMES_TYPE_PARAM, tebot_strdup ( &h->allocator, "limit" ), strdup_printf ( &h->allocator, "%d", limit ) },
+		{ MIMES_TYPE_PARAM, tebot_strdup ( &h->allocator, "timeout" ), strdup_printf ( &h->allocator, "%d", timeout ) },
+		{ MIMES_TYPE_ARRAY, tebot_strdup ( &h->allocator, "allowed_updates" ), .array = allowed_updates ? allowed_updates : h->allowed_updates }
 	};
 
-	void **temp = realloc ( h->for_free, sizeof ( void * ) * 7 );
-	if ( temp ) {
-		h->for_free = temp;
-		h->size_for_free = 7;
+	lazy_reset ( h );
 
-		h->for_free[0] = mimes[0].name;
-		h->for_free[1] = mimes[0].value;
-		h->for_free[2] = mimes[1].name;
-		h->for_free[3] = mimes[1].value;
-		h->for_free[4] = mimes[2].name;
-		h->for_free[5] = mimes[2].value;
-		h->for_free[6] = mimes[3].name;
+	tebot_result_updated_t *t = parse_alloc ( h, sizeof ( tebot_result_updated_t ) );
+	if ( !t ) {
+		log_time ( h, LOG_LEVEL_CRITICAL, "failed to calloc result.\n" );
+		return NULL;
 	}
+	h->res = t;
 
+	t->update = parse_alloc ( h, limit * sizeof ( tebot_update_t * ) );
 
-	tebot_result_updated_t *t = ( tebot_result_updated_t * ) calloc ( 1, sizeof ( tebot_result_updated_t ) );
-	h->res = t;
-	temp = realloc ( h->for_free, sizeof ( void * ) * h->size_for_free + 1 );
-	if ( temp ) {
-		h->for_free = temp;
-		h->for_free[h->size_for_free] = t;
-		h->size_for_free++;
-	}
+	char *data = tebot_request_get ( h, "getUpdates", mimes, 4 );
+	const long long int received = h->is_timing ? usec_real ( ) : 0;
+	if ( h->journal && data ) tebot_journal_append ( h->journal, data, h->offset );
 
-	t->update = ( tebot_update_t ** ) calloc ( limit, sizeof ( tebot_update_t * ) );
-	temp = realloc ( h->for_free, sizeof ( void * ) * h->size_for_free + 1 );
-	if ( temp ) {
-		h->for_free = temp;
-		h->for_free[h->size_for_free] = t->update;
-		h->size_for_free++;
+	for ( int i = 0; i < 4; i++ ) {
+		tebot_free ( &h->allocator, mimes[i].name );
+		tebot_free ( &h->allocator, mimes[i].value );
 	}
 
-	char *data = tebot_request_get ( h, "getUpdates", mimes, 4 );
+	const long long int parse_start = usec_now ( );
+
+	/*
+	 * body is tokenized once for all updates of batch.
+	 */
+	json_object *root = data ? json_tokener_parse ( data ) : NULL;
+	if ( !root ) {
+		log_time ( h, LOG_LEVEL_NOTICE, "failed to parse data: %s\n", data ? data : "" );
+		return t;
+	}
 
 	for ( int i = 0; i < limit; i++ ) {
-		t->update[i] = calloc ( 1, sizeof ( tebot_update_t ) );
+		t->update[i] = parse_alloc ( h, sizeof ( tebot_update_t ) );
 		if ( !t->update[i] ) {
-			log_time ( LOG_LEVEL_CRITICAL, h->log_file, h->show_debug, "failed to calloc update.\n" );
+			log_time ( h, LOG_LEVEL_CRITICAL, "failed to calloc update.\n" );
 			return NULL;
 		}
 
-		temp = realloc ( h->for_free, sizeof ( void * ) * h->size_for_free + 1 );
-		if ( temp ) {
-			h->for_free = temp;
-			h->for_free[h->size_for_free] = t->update[i];
-			h->size_for_free++;
-		}
-
 		struct data_of_types dot[] = {
 			{ "update_id", (void **) &t->update[i]->update_id },
 			{ "message", (void **) &t->update[i]->message, sizeof ( tebot_message_t ), handler_message },
@@ -2058,45 +1212,231 @@ tebot_result_updated_t *tebot_method_get_updates ( tebot_handler_t *h, const lon
 
 		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
 
-		int ret = parse_data ( h, data, dot, size, i );
+		h->mask = h->fields;
+		int ret = parse_result ( h, root, dot, size, i );
+		h->mask = NULL;
 		if ( ret == -1 ) {
-			log_time ( LOG_LEVEL_NOTICE, h->log_file, h->show_debug, "failed to parse data: %s\n", data );
+			log_time ( h, LOG_LEVEL_NOTICE, "failed to parse data: %s\n", data );
 		}
-		t->size++;
 		if ( ret == 1 ) break;
+		t->size++;
+	}
+
+	lazy_keep ( h, root );
+
+	stamp_parsed ( h, t, received );
+	if ( h->metrics ) tebot_metrics_record_parse ( h->metrics, t, usec_now ( ) - parse_start, h->arena ? tebot_arena_allocs ( h->arena ) : 0 );
+
+	return t;
+}
+
+/*
+ * used by getUpdates and setWebhook when they are called without own list,
+ * so telegram does not send update types which nobody handles.
+ */
+int tebot_set_allowed_updates ( tebot_handler_t *h, char **allowed_updates ) {
+	char **copy = NULL;
+
+	if ( allowed_updates ) {
+		int size = 0;
+		while ( allowed_updates[size] ) size++;
+
+		copy = tebot_calloc ( &h->allocator, size + 1, sizeof ( char * ) );
+		if ( !copy ) {
+			log_time ( h, LOG_LEVEL_CRITICAL, "failed to calloc allowed updates.\n" );
+			return -1;
+		}
+
+		for ( int i = 0; i < size; i++ ) copy[i] = tebot_strdup ( &h->allocator, allowed_updates[i] );
+	}
+
+	if ( h->allowed_updates ) {
+		for ( int i = 0; h->allowed_updates[i]; i++ ) tebot_free ( &h->allocator, h->allowed_updates[i] );
+		tebot_free ( &h->allocator, h->allowed_updates );
+	}
+	h->allowed_updates = copy;
+
+	return 0;
+}
+
+void tebot_set_update_timing ( tebot_handler_t *h, const int is_timing ) {
+	h->is_timing = is_timing;
+}
+
+void tebot_update_dispatched ( tebot_handler_t *h, tebot_update_t *u ) {
+	if ( !h->is_timing ) return;
+
+	u->timing.dispatched = usec_real ( );
+}
+
+/*
+ * called by application when reply is sent, lag of every stage goes to
+ * histograms of update type.
+ */
+void tebot_update_finished ( tebot_handler_t *h, tebot_update_t *u ) {
+	if ( !h->is_timing ) return;
+
+	u->timing.finished = usec_real ( );
+	if ( h->metrics ) tebot_metrics_record_lag ( h->metrics, u );
+}
+
+int tebot_set_offset_file ( tebot_handler_t *h, const char *path, const int commit_every ) {
+	tebot_offset_store_t *os = tebot_offset_store_init ( path, commit_every );
+	if ( !os ) {
+		log_time ( h, LOG_LEVEL_CRITICAL, "failed to open offset file: %s\n", path );
+		return -1;
+	}
+
+	tebot_offset_store_free ( h->offsets );
+	h->offsets = os;
+
+	return 0;
+}
+
+/*
+ * every call asks telegram from the committed point, offset after it would
+ * confirm updates which are still in work and they would be lost on crash.
+ * updates in work come again and are skipped by offset store, so they are
+ * given to application once.
+ */
+tebot_result_updated_t *tebot_poll_updates ( tebot_handler_t *h, const int limit, const int timeout, char **allowed_updates ) {
+	if ( !h->offsets ) {
+		log_time ( h, LOG_LEVEL_CRITICAL, "offset file is not set.\n" );
+		return NULL;
+	}
+
+	const long long int committed = tebot_offset_store_committed ( h->offsets );
+
+	tebot_result_updated_t *t = tebot_method_get_updates ( h, committed ? committed + 1 : 0, limit, timeout, allowed_updates );
+	if ( !t ) return NULL;
+
+	int size = 0;
+	for ( int i = 0; i < t->size; i++ ) {
+		tebot_update_t *u = t->update[i];
+		if ( u->update_id <= 0 ) continue;
+
+		/*
+		 * update which could not be queued and all after it are not
+		 * given out, they come again with the next poll.
+		 */
+		const int ret = tebot_offset_store_dispatch ( h->offsets, u->update_id );
+		if ( ret == -1 ) {
+			log_time ( h, LOG_LEVEL_CRITICAL, "failed to queue update %lld, rest of batch comes again.\n", u->update_id );
+			break;
+		}
+		if ( ret == 1 ) continue;
+
+		tebot_update_dispatched ( h, u );
+		t->update[size++] = u;
 	}
+	t->size = size;
 
 	return t;
 }
 
+int tebot_ack_update ( tebot_handler_t *h, const long long int update_id ) {
+	if ( !h->offsets ) return -1;
+
+	return tebot_offset_store_ack ( h->offsets, update_id );
+}
+
+int tebot_commit_offset ( tebot_handler_t *h ) {
+	if ( !h->offsets ) return -1;
+
+	return tebot_offset_store_flush ( h->offsets );
+}
+
+int tebot_set_journal ( tebot_handler_t *h, struct tebot_setup_journal *sj ) {
+	tebot_journal_t *j = tebot_journal_init ( sj );
+	if ( !j ) {
+		log_time ( h, LOG_LEVEL_CRITICAL, "failed to init journal: %s\n", sj->dir );
+		return -1;
+	}
+
+	tebot_journal_free ( h->journal );
+	h->journal = j;
+
+	return 0;
+}
+
+/*
+ * takes only update_id from raw body without parse of json.
+ */
+static long long int peek_update_id ( const char *data, const size_t length ) {
+	const char *end = data + length;
+	const char *p = memmem ( data, length, "\"update_id\"", sizeof ( "\"update_id\"" ) - 1 );
+	if ( !p ) return -1;
+
+	p += sizeof ( "\"update_id\"" ) - 1;
+	while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' ) ) p++;
+	if ( p == end || *p != ':' ) return -1;
+	p++;
+	while ( p < end && ( *p == ' ' || *p == '\t' || *p == '\r' || *p == '\n' ) ) p++;
+	if ( p == end || *p < '0' || *p > '9' ) return -1;
+
+	long long int update_id = 0;
+	while ( p < end && *p >= '0' && *p <= '9' ) update_id = update_id * 10 + ( *p++ - '0' );
+
+	return update_id;
+}
+
+int tebot_set_dedup ( tebot_handler_t *h, const int window ) {
+	tebot_dedup_t *d = tebot_dedup_init ( window );
+	if ( !d ) {
+		log_time ( h, LOG_LEVEL_CRITICAL, "failed to init dedup.\n" );
+		return -1;
+	}
+
+	tebot_dedup_free ( h->dedup );
+	h->dedup = d;
+
+	return 0;
+}
+
 tebot_result_updated_t *tebot_get_data_from_webhook (tebot_handler_t *h, char *post_data) {
+	if ( !post_data ) return NULL;
+
+	return tebot_get_data_from_webhook_len ( h, post_data, strlen ( post_data ) );
+}
+
+/*
+ * body is only read while parsing, so buffer of connection can be given as
+ * is and reused right after return. all memory of result is in arena of
+ * handler.
+ */
+tebot_result_updated_t *tebot_get_data_from_webhook_len ( tebot_handler_t *h, const char *data, const size_t length ) {
 
 	int limit = 1;
 
-	h->size_for_free = 0;
-	h->for_free = calloc ( 0, sizeof ( void * ) );
+	lazy_reset ( h );
 
-	tebot_result_updated_t *t = ( tebot_result_updated_t * ) calloc ( 1, sizeof ( tebot_result_updated_t ) );
+	tebot_result_updated_t *t = parse_alloc ( h, sizeof ( tebot_result_updated_t ) );
+	if ( !t ) {
+		log_time ( h, LOG_LEVEL_CRITICAL, "failed to calloc result.\n" );
+		return NULL;
+	}
 	h->res = t;
 
-	t->update = ( tebot_update_t ** ) calloc ( limit, sizeof ( tebot_update_t * ) );
+	t->update = parse_alloc ( h, limit * sizeof ( tebot_update_t * ) );
 
-	char *data = post_data;
+	const long long int received = h->is_timing ? usec_real ( ) : 0;
+	const long long int parse_start = usec_now ( );
 
 	for ( int i = 0; i < limit; i++ ) {
-		t->update[i] = calloc ( 1, sizeof ( tebot_update_t ) );
+		t->update[i] = parse_alloc ( h, sizeof ( tebot_update_t ) );
 		if ( !t->update[i] ) {
-			log_time ( LOG_LEVEL_CRITICAL, h->log_file, h->show_debug, "failed to calloc update.\n" );
+			log_time ( h, LOG_LEVEL_CRITICAL, "failed to calloc update.\n" );
 			return NULL;
 		}
 
-		void **temp = realloc ( h->for_free, sizeof ( void * ) * h->size_for_free + 1 );
-		if ( temp ) {
-			h->for_free = temp;
-			h->for_free[h->size_for_free] = t->update[i];
-			h->size_for_free++;
+		const long long int update_id = h->dedup ? peek_update_id ( data, length ) : -1;
+		if ( h->dedup && tebot_dedup_seen ( h->dedup, update_id ) ) {
+			log_time ( h, LOG_LEVEL_NOTICE, "skip redelivered update: %lld\n", update_id );
+			break;
 		}
 
+		if ( h->journal ) tebot_journal_append ( h->journal, data, length );
+
 		struct data_of_types dot[] = {
 			{ "update_id", (void **) &t->update[i]->update_id },
 			{ "message", (void **) &t->update[i]->message, sizeof ( tebot_message_t ), handler_message },
@@ -2122,21 +1462,36 @@ tebot_result_updated_t *tebot_get_data_from_webhook (tebot_handler_t *h, char *p
 
 		const int size = sizeof ( dot ) / sizeof ( struct data_of_types );
 
-		int ret = parse_data_webhook ( h, data, dot, size, i );
+		h->mask = h->fields;
+		int ret = parse_data_webhook ( h, data, length, dot, size, i );
+		h->mask = NULL;
 		if ( ret == -1 ) {
-			log_time ( LOG_LEVEL_NOTICE, h->log_file, h->show_debug, "failed to parse data: %s\n", data );
+			log_time ( h, LOG_LEVEL_NOTICE, "failed to parse data: %.*s\n", ( int ) length, data );
 			tebot_free_update (h);
 			return NULL;
 		}
+
+		/*
+		 * marked only after parse. same update parsed at once by other
+		 * listener is dropped here.
+		 */
+		if ( h->dedup && tebot_dedup_check ( h->dedup, update_id ) ) {
+			log_time ( h, LOG_LEVEL_NOTICE, "skip redelivered update: %lld\n", update_id );
+			break;
+		}
 		t->size++;
 		if ( ret == 1 ) break;
 	}
 
+	stamp_parsed ( h, t, received );
+	if ( h->metrics ) tebot_metrics_record_parse ( h->metrics, t, usec_now ( ) - parse_start, h->arena ? tebot_arena_allocs ( h->arena ) : 0 );
+
 	return t;
 }
 
 static void get_inline_keyboard_markup_json_value ( 
-		struct mimes *mimes, 
+		const tebot_allocator_t *a, 
+		tebot_param_t *mimes, 
 		const int index, 
 		int *layout, 
 		const int size_layout, 
@@ -2145,7 +1500,7 @@ static void get_inline_keyboard_markup_json_value (
 
 		int l = 0;
 		mimes[index].type = MIMES_TYPE_PARAM;
-		mimes[index].name = strdup ( "reply_markup" );
+		mimes[index].name = tebot_strdup ( a, "reply_markup" );
 		json_object *root = json_object_new_object ( );
 		json_object *array = json_object_new_array ( );
 		json_object *root_array = json_object_new_array ( );
@@ -2228,11 +1583,12 @@ static void get_inline_keyboard_markup_json_value (
 			border++;
 		}
 		json_object_array_add ( root_array, array );
-		mimes[index].value = strdup ( json_object_to_json_string ( root ) );
+		mimes[index].value = tebot_strdup ( a, json_object_to_json_string ( root ) );
 		json_object_put ( root );
 }
 static void get_reply_keyboard_markup (
-		struct mimes *mimes, 
+		const tebot_allocator_t *a, 
+		tebot_param_t *mimes, 
 		const int index, 
 		int *layout, 
 		const int size_layout, 
@@ -2240,7 +1596,7 @@ static void get_reply_keyboard_markup (
 		) {
 		int l = 0;
 		mimes[index].type = MIMES_TYPE_PARAM;
-		mimes[index].name = strdup ( "reply_markup" );
+		mimes[index].name = tebot_strdup ( a, "reply_markup" );
 		json_object *root = json_object_new_object ( );
 		json_object *array = json_object_new_array ( );
 		json_object *root_array = json_object_new_array ( );
@@ -2293,11 +1649,12 @@ static void get_reply_keyboard_markup (
 			border++;
 		}
 		json_object_array_add ( root_array, array );
-		mimes[index].value = strdup ( json_object_to_json_string ( root ) );
+		mimes[index].value = tebot_strdup ( a, json_object_to_json_string ( root ) );
 		json_object_put ( root );
 }
 static void get_reply_keyboard_remove (
-		struct mimes *mimes, 
+		const tebot_allocator_t *a, 
+		tebot_param_t *mimes, 
 		const int index, 
 		int *layout, 
 		const int size_layout, 
@@ -2305,7 +1662,7 @@ static void get_reply_keyboard_remove (
 		) {
 		int l = 0;
 		mimes[index].type = MIMES_TYPE_PARAM;
-		mimes[index].name = strdup ( "reply_markup" );
+		mimes[index].name = tebot_strdup ( a, "reply_markup" );
 		json_object *root = json_object_new_object ( );
 		tebot_reply_keyboard_remove_t *m = ( tebot_reply_keyboard_remove_t * ) reply_markup;
 		int border = 0;
@@ -2319,11 +1676,12 @@ static void get_reply_keyboard_remove (
 		json_object_object_add ( root, "selective", item_ );
 
 
-		mimes[index].value = strdup ( json_object_to_json_string ( root ) );
+		mimes[index].value = tebot_strdup ( a, json_object_to_json_string ( root ) );
 		json_object_put ( root );
 }
 static void get_force_reply (
-		struct mimes *mimes, 
+		const tebot_allocator_t *a, 
+		tebot_param_t *mimes, 
 		const int index, 
 		int *layout, 
 		const int size_layout, 
@@ -2331,7 +1689,7 @@ static void get_force_reply (
 		) {
 		int l = 0;
 		mimes[index].type = MIMES_TYPE_PARAM;
-		mimes[index].name = strdup ( "reply_markup" );
+		mimes[index].name = tebot_strdup ( a, "reply_markup" );
 		json_object *root = json_object_new_object ( );
 		tebot_force_reply_t *m = ( tebot_force_reply_t * ) reply_markup;
 		int border = 0;
@@ -2345,38 +1703,38 @@ static void get_force_reply (
 		json_object_object_add ( root, "selective", item_ );
 
 
-		mimes[index].value = strdup ( json_object_to_json_string ( root ) );
+		mimes[index].value = tebot_strdup ( a, json_object_to_json_string ( root ) );
 		json_object_put ( root );
 }
 	//parse_reply_makrup ( mimes, &index, layout, size_layout, reply_markup );
-static void parse_reply_markup ( struct mimes mimes[], int *ind, int *layout, int size_layout, void *reply_markup, int type_of_reply_markup ) {
+static void parse_reply_markup ( const tebot_allocator_t *a, tebot_param_t mimes[], int *ind, int *layout, int size_layout, void *reply_markup, int type_of_reply_markup ) {
 
 	int index = *ind;
 
 	if ( reply_markup && type_of_reply_markup == INLINE_KEYBOARD_MARKUP ) {
-		get_inline_keyboard_markup_json_value ( mimes, index, layout, size_layout, reply_markup );
+		get_inline_keyboard_markup_json_value ( a, mimes, index, layout, size_layout, reply_markup );
 		index++;
 	}
 
 	if ( reply_markup && type_of_reply_markup == REPLY_KEYBOARD_MARKUP ) {
-		get_reply_keyboard_markup ( mimes, index, layout, size_layout, reply_markup );
+		get_reply_keyboard_markup ( a, mimes, index, layout, size_layout, reply_markup );
 		index++;
 	}
 
 	if ( reply_markup && type_of_reply_markup == REPLY_KEYBOARD_REMOVE ) {
-		get_reply_keyboard_remove ( mimes, index, layout, size_layout, reply_markup );
+		get_reply_keyboard_remove ( a, mimes, index, layout, size_layout, reply_markup );
 		index++;
 	}
 
 	if ( reply_markup && type_of_reply_markup == FORCE_REPLY ) {
-		get_force_reply ( mimes, index, layout, size_layout, reply_markup );
+		get_force_reply ( a, mimes, index, layout, size_layout, reply_markup );
 		index++;
 	}
 
 	*ind = index;
 }
 
-static void fill_fields ( struct mimes mimes[], int *ind, struct info_of_params *iop, int size_info_of_params ) {
+static void fill_fields ( const tebot_allocator_t *a, tebot_param_t mimes[], int *ind, struct info_of_params *iop, int size_info_of_params ) {
 	int index = *ind;
 	for ( int i = 0; i < size_info_of_params; i++ ) {
 		if ( *iop[i].value != 0 ) {
@@ -2385,8 +1743,8 @@ static void fill_fields ( struct mimes mimes[], int *ind, struct info_of_params
 						long long int value = *(( long long int * ) iop[i].value);
 						if ( value != 0 ) {
 							mimes[index].type = iop[i].type;
-							mimes[index].name = strdup ( iop[i].name );
-							mimes[index].value = strdup_printf ( iop[i].printf, value );
+							mimes[index].name = tebot_strdup ( a, iop[i].name );
+							mimes[index].value = strdup_printf ( a, iop[i].printf, value );
 							index++;
 						}
 					}
@@ -2395,8 +1753,8 @@ static void fill_fields ( struct mimes mimes[], int *ind, struct info_of_params
 						double value = *(( double * ) iop[i].value);
 						if ( value != 0 ) {
 							mimes[index].type = iop[i].type;
-							mimes[index].name = strdup ( iop[i].name );
-							mimes[index].value = strdup_printf ( iop[i].printf, value );
+							mimes[index].name = tebot_strdup ( a, iop[i].name );
+							mimes[index].value = strdup_printf ( a, iop[i].printf, value );
 							index++;
 						}
 					}
@@ -2404,8 +1762,8 @@ static void fill_fields ( struct mimes mimes[], int *ind, struct info_of_params
 				case TYPE_OF_PARAM_PTR_STRING: {
 						char *ptr = *((char **) iop[i].value);
 						mimes[index].type = iop[i].type;
-						mimes[index].name = strdup ( iop[i].name );
-						mimes[index].value = strdup_printf ( iop[i].printf, ptr );
+						mimes[index].name = tebot_strdup ( a, iop[i].name );
+						mimes[index].value = strdup_printf ( a, iop[i].printf, ptr );
 						index++;
 					}
 					break;
@@ -2413,8 +1771,8 @@ static void fill_fields ( struct mimes mimes[], int *ind, struct info_of_params
 						char b = *(( char * ) iop[i].value);
 						if ( b != 0 ) {
 							mimes[index].type = iop[i].type;
-							mimes[index].name = strdup ( iop[i].name );
-							mimes[index].value = strdup ( "true" );
+							mimes[index].name = tebot_strdup ( a, iop[i].name );
+							mimes[index].value = tebot_strdup ( a, "true" );
 							index++;
 						}
 					}
@@ -2425,703 +1783,836 @@ static void fill_fields ( struct mimes mimes[], int *ind, struct info_of_params
 	*ind = index;
 }
 
-void tebot_method_send_message ( tebot_handler_t *h, struct tebot_send_message_t *dt) {
-
-	int l = 0;
-
-	struct mimes mimes[9];
-	int index = 0;
-
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "text", (void **) &dt->text, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "parse_mode", (void **) &dt->parse_mode, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "disable_web_page_preview", (void **) &dt->disable_web_page_preview, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
-
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
-
-	fill_fields ( mimes, &index, iop, size_info_of_params );
-
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
-
-	char *data = tebot_request_get ( h, "sendMessage", mimes, index );
-
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
-	}
+/*
+ * used by generated encoders, value is already allocated.
+ */
+static void add_param ( const tebot_allocator_t *a, tebot_param_t mimes[], int *index, const int type, const char *name, char *value ) {
+	mimes[*index].type = type;
+	mimes[*index].name = tebot_strdup ( a, name );
+	mimes[*index].value = value;
+	( *index )++;
 }
 
-void tebot_free_update ( tebot_handler_t *h ) {
-
-	for ( int i = 0; i < h->size_for_free; i++ ) {
-		free ( h->for_free [ i ] );
-	}
+/*
+ * methods are generated by tebot_gen from schema/bot_api.def.
+ */
+#include "tebot_methods.inc"
 
-	free ( h->for_free );
+void tebot_free_update ( tebot_handler_t *h ) {
+	lazy_reset ( h );
+	if ( h->arena ) tebot_arena_reset ( h->arena );
+	h->res = NULL;
 }
 
 tebot_inline_keyboard_markup_t *tebot_init_inline_keyboard_markup ( const int size ) {
-	tebot_inline_keyboard_markup_t *markup = calloc ( 1, sizeof ( tebot_inline_keyboard_markup_t ) );
-	markup->inline_keyboard = calloc ( size + 1, sizeof ( void * ) );
+	tebot_inline_keyboard_markup_t *markup = tebot_calloc ( NULL, 1, sizeof ( tebot_inline_keyboard_markup_t ) );
+	markup->inline_keyboard = tebot_calloc ( NULL, size + 1, sizeof ( void * ) );
 	for ( int i = 0; i < size; i++ ) {
-		markup->inline_keyboard[i] = calloc ( 1, sizeof ( tebot_inline_keyboard_button_t ) );
+		markup->inline_keyboard[i] = tebot_calloc ( NULL, 1, sizeof ( tebot_inline_keyboard_button_t ) );
 	}
 
 	return markup;
 }
 
 tebot_reply_keyboard_markup_t *tebot_init_reply_keyboard_markup ( const int size ) {
-	tebot_reply_keyboard_markup_t *markup = calloc ( 1, sizeof ( tebot_reply_keyboard_markup_t ) );
-	markup->keyboard = calloc ( size + 1, sizeof ( void * ) );
+	tebot_reply_keyboard_markup_t *markup = tebot_calloc ( NULL, 1, sizeof ( tebot_reply_keyboard_markup_t ) );
+	markup->keyboard = tebot_calloc ( NULL, size + 1, sizeof ( void * ) );
 	for ( int i = 0; i < size; i++ ) {
-		markup->keyboard[i] = calloc ( 1, sizeof ( tebot_keyboard_button_t ) );
+		markup->keyboard[i] = tebot_calloc ( NULL, 1, sizeof ( tebot_keyboard_button_t ) );
 	}
 
 	return markup;
 }
 
-void tebot_method_send_document ( tebot_handler_t *h, struct tebot_send_document_t *dt) {
-
-	int l = 0;
-
-	struct mimes mimes[11];
+long long int tebot_method_get_file ( tebot_handler_t *h, const char *file_id, const char *out_file_name ) {
+	tebot_param_t mimes[1];
 	int index = 0;
+	h->offset = 0;
+	long long int update_id_int = 0;
 
 	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_FILE, "document", (void **) &dt->document, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "parse_mode", (void **) &dt->parse_mode, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "caption", (void **) &dt->caption, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "disable_content_type_detection", (void **) &dt->disable_content_type_detection, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
+		{ MIMES_TYPE_PARAM, "file_id", (void **) &file_id, "%s", TYPE_OF_PARAM_PTR_STRING }
 	};
 
 	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
-
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
-
-	char *data = tebot_request_get ( h, "sendDocument", mimes, index );
-
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
-	}
-}
-
-
-void tebot_method_send_audio ( tebot_handler_t *h, struct tebot_send_audio_t *dt) {
-
-	int l = 0;
-
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "duration", (void **) &dt->duration, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "title", (void **) &dt->title, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "caption", (void **) &dt->caption, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "performer", (void **) &dt->performer, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "thumb", (void **) &dt->thumb, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "disable_content_type_detection", (void **) &dt->disable_content_type_detection, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_FILE, "audio", (void **) &dt->audio, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
-
-	struct mimes mimes[13];
-	int index = 0;
+	fill_fields ( &h->allocator, mimes, &index, iop, size_info_of_params );
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+	char *data = tebot_request_get ( h, "getFile", mimes, index );
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+	json_object *root = json_tokener_parse ( data );
+	if ( !root ) goto error;
+	json_object *ok = json_object_object_get ( root, "ok" );
+	const char *ok_string = json_object_get_string ( ok );
+	if ( !strncmp ( ok_string, "true", 5 ) ) {
+		h->offset = 0;
+		json_object *result = json_object_object_get ( root, "result" );
+		json_object *update_id = json_object_object_get ( result, "update_id" );
+		update_id_int = json_object_get_int64 ( update_id );
+		json_object *file_path = json_object_object_get ( result, "file_path" );
+		const char *file_path_string = json_object_get_string ( file_path );
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+		tebot_param_t mimes[2];
+		int index = 0;
 
-	char *data = tebot_request_get ( h, "sendAudio", mimes, index );
+		struct info_of_params iop[] = {
+			{ MIMES_TYPE_GET_FILE, "file_path", (void **) &file_path_string, "%s", TYPE_OF_PARAM_PTR_STRING }
+		};
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
-	}
-}
+		int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
 
-void tebot_method_send_voice ( tebot_handler_t *h, struct tebot_send_voice_t *dt) {
+		fill_fields ( &h->allocator, mimes, &index, iop, size_info_of_params );
 
-	int l = 0;
+		char *data = tebot_request_get ( h, "getFile", mimes, index );
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "duration", (void **) &dt->duration, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "caption", (void **) &dt->caption, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "parse_mode", (void **) &dt->parse_mode, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_FILE, "voice", (void **) &dt->voice, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
+		const char *name_without_slash = strrchr ( out_file_name, '/' );
+		if ( !name_without_slash ) name_without_slash = out_file_name;
+		else name_without_slash++;
 
-	struct mimes mimes[9];
-	int index = 0;
+		FILE *fp = fopen ( name_without_slash, "w" );
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+		fwrite ( data, h->offset, 1, fp );
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+		fclose ( fp );
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+		for ( int i = 0; i < index; i++ ) {
+			tebot_free ( &h->allocator, mimes[i].name );
+			tebot_free ( &h->allocator, mimes[i].value );
+		}
+	}
 
-	char *data = tebot_request_get ( h, "sendVoice", mimes, index );
+	json_object_put ( root );
 
+error:
 	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
+		tebot_free ( &h->allocator, mimes[i].name );
+		tebot_free ( &h->allocator, mimes[i].value );
 	}
-}
 
-void tebot_method_send_video_note ( tebot_handler_t *h, struct tebot_send_video_note_t *dt) {
-
-	int l = 0;
+	return update_id_int;
+}
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "duration", (void **) &dt->duration, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "length", (void **) &dt->length, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "caption", (void **) &dt->caption, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "parse_mode", (void **) &dt->parse_mode, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "thumb", (void **) &dt->thumb, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_FILE, "video_note", (void **) &dt->video_note, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
+tebot_message_entity_t **tebot_init_message_entity ( const int size ) {
+	tebot_message_entity_t **m = tebot_calloc ( NULL, size + 1, sizeof ( tebot_message_entity_t * ) );
 
-	struct mimes mimes[11];
-	int index = 0;
+	for ( int i = 0; i < size; i++ ) {
+		m[i] = tebot_calloc ( NULL, 1, sizeof ( tebot_message_entity_t ) );
+	}
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+	return m;
+}
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+#include <creqhttp.h>
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+/*
+ * answers are written straight to buffer of creqhttp event, so they are
+ * bounded by its real size too, not only by TEBOT_WEBHOOK_ANSWER_SIZE.
+ */
+#define ANS_DATA_SIZE                      sizeof ( ( ( creqhttp_epoll_event * ) 0 )->data.ans_data )
+#define WEBHOOK_ANSWER_SIZE                ( ANS_DATA_SIZE < TEBOT_WEBHOOK_ANSWER_SIZE ? ANS_DATA_SIZE : TEBOT_WEBHOOK_ANSWER_SIZE )
+
+_Static_assert ( ANS_DATA_SIZE != sizeof ( char * ), "ans_data of creqhttp is expected to be an array" );
+
+struct webhook_listener {
+	creqhttp *cq;
+	tebot_handler_t *h;
+	int cpu;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	int is_ready;
+	tebot_webhook_pool_t *pool;
+};
 
-	char *data = tebot_request_get ( h, "sendVideoNote", mimes, index );
+static __thread tebot_handler_t *listener_handler;
+static __thread tebot_webhook_pool_t *listener_pool;
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
-	}
+/*
+ * handler for parsing in callback of listener, every listener has its own
+ * because parse keeps its state in handler.
+ */
+tebot_handler_t *tebot_webhook_handler ( void ) {
+	return listener_handler;
 }
 
-void tebot_method_send_photo ( tebot_handler_t *h, struct tebot_send_photo_t *dt) {
-
-	int l = 0;
+static void *webhook_accept_connections (void *_data) {
+	struct webhook_listener *wl = (struct webhook_listener *) _data;
 
-	struct mimes mimes[8];
-	int index = 0;
+	if (wl->cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO (&set);
+		CPU_SET (wl->cpu, &set);
+		if (pthread_setaffinity_np (pthread_self ( ), sizeof (set), &set)) {
+			log_time (wl->h, LOG_LEVEL_NOTICE, "failed to pin listener to cpu %d\n", wl->cpu);
+		}
+	}
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_FILE, "photo", (void **) &dt->photo, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "parse_mode", (void **) &dt->parse_mode, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "caption", (void **) &dt->caption, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
+	listener_handler = wl->h;
+	listener_pool = wl->pool;
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+	pthread_mutex_lock (&wl->mutex);
+	wl->is_ready = 1;
+	pthread_cond_signal (&wl->cond);
+	pthread_mutex_unlock (&wl->mutex);
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+	creqhttp_accept_connections (wl->cq);
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+	return NULL;
+}
 
-	char *data = tebot_request_get ( h, "sendPhoto", mimes, index );
+void tebot_handler_clone_free (tebot_handler_t *c) {
+	const tebot_allocator_t a = c->allocator;
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
-	}
+	lazy_reset (c);
+	if (c->curl) curl_easy_cleanup (c->curl);
+	if (c->tokener) json_tokener_free (c->tokener);
+	tebot_arena_free (c->arena);
+	fields_free (&a, c->fields);
+	tebot_free (&a, c->lazy);
+	tebot_free (&a, c->url_get);
+	tebot_free (&a, c->current_buf);
+	tebot_free (&a, c->token);
+	tebot_free (&a, c->url_api);
+	tebot_free (&a, c->url_api_get_file);
+	tebot_free (&a, c);
 }
 
-void tebot_method_send_video ( tebot_handler_t *h, struct tebot_send_video_t *dt) {
-
-	int l = 0;
+/*
+ * shares thread safe parts (logger, metrics, dedup, journal, offsets) with
+ * main handler.
+ */
+tebot_handler_t *tebot_handler_clone (tebot_handler_t *h) {
+	tebot_handler_t *c = tebot_calloc (&h->allocator, 1, sizeof (tebot_handler_t));
+	if (!c) return NULL;
+
+	*c = *h;
+	c->curl = NULL;
+	c->res = NULL;
+	c->arena = NULL;
+	c->tokener = NULL;
+	c->mask = NULL;
+	c->offset = 0;
+	c->allowed_updates = NULL;
+	c->lazy = h->lazy ? tebot_calloc (&h->allocator, 1, sizeof (struct tebot_lazy)) : NULL;
+	c->url_get = tebot_calloc (&h->allocator, 4097, 1);
+	c->current_buf = tebot_calloc (&h->allocator, 4097, 1);
+	c->token = tebot_strdup (&h->allocator, h->token);
+
+	/*
+	 * main handler can change them later, clone keeps its own copy.
+	 */
+	c->url_api = h->url_api ? tebot_strdup (&h->allocator, h->url_api) : NULL;
+	c->url_api_get_file = h->url_api_get_file ? tebot_strdup (&h->allocator, h->url_api_get_file) : NULL;
+	c->fields = h->fields ? fields_copy (&h->allocator, h->fields) : NULL;
+
+	if (!c->url_get || !c->current_buf || !c->token || (h->lazy && !c->lazy) ||
+			(h->url_api && !c->url_api) || (h->url_api_get_file && !c->url_api_get_file) ||
+			(h->fields && !c->fields)) {
+		tebot_handler_clone_free (c);
+		return NULL;
+	}
 
-	struct mimes mimes[13];
-	int index = 0;
+	return c;
+}
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "duration", (void **) &dt->duration, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "width", (void **) &dt->width, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "height", (void **) &dt->height, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_FILE, "video", (void **) &dt->video, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "thumb", (void **) &dt->thumb, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "parse_mode", (void **) &dt->parse_mode, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "caption", (void **) &dt->caption, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "supports_streaming", (void **) &dt->supports_streaming, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
+/*
+ * with several listeners each one binds own socket with SO_REUSEPORT and
+ * gives it to creqhttp in listen_fd, kernel spreads connections between
+ * them.
+ */
+static int webhook_bind_reuseport (const unsigned short port) {
+	int fd = socket (AF_INET, SOCK_STREAM, 0);
+	if (fd == -1) return -1;
+
+	int on = 1;
+	struct sockaddr_in addr = {
+		.sin_family = AF_INET,
+		.sin_port = htons (port),
+		.sin_addr.s_addr = htonl (INADDR_ANY)
 	};
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+	if (setsockopt (fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof (on)) == -1 ||
+			setsockopt (fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof (on)) == -1 ||
+			bind (fd, (struct sockaddr *) &addr, sizeof (addr)) == -1 ||
+			listen (fd, SOMAXCONN) == -1) {
+		close (fd);
+		return -1;
+	}
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+	return fd;
+}
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+static int webhook_start_listener (tebot_handler_t *h, creqhttp_params *args, const int index, struct tebot_setup_webhook *sw) {
+	struct webhook_listener *wl = tebot_calloc (&h->allocator, 1, sizeof (struct webhook_listener));
+	if (!wl) return -1;
 
-	char *data = tebot_request_get ( h, "sendVideo", mimes, index );
+	int fd = -1;
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
+	wl->h = index == 0 ? h : tebot_handler_clone (h);
+	wl->cpu = sw->pin_cpu ? index % sysconf (_SC_NPROCESSORS_ONLN) : -1;
+	if (!wl->h) goto webhook_start_listener_error;
+
+	if (sw->update_handle || sw->secret_token) {
+		/*
+		 * telegram opens up to max_connections at once and each of them
+		 * can be in the middle of body.
+		 */
+		const int pool_size = sw->max_connections > sw->pool_size ? sw->max_connections : sw->pool_size;
+		wl->pool = tebot_webhook_pool_init (pool_size, sw->slab_size, sw->max_body, &h->allocator);
+		if (!wl->pool) goto webhook_start_listener_error;
 	}
-}
 
-void tebot_method_send_animation ( tebot_handler_t *h, struct tebot_send_animation_t *dt) {
+	creqhttp_params a = *args;
+	if (sw->listeners > 1) {
+		fd = webhook_bind_reuseport (args->port);
+		if (fd == -1) {
+			log_time (h, LOG_LEVEL_CRITICAL, "failed to bind listener %d with SO_REUSEPORT\n", index);
+			goto webhook_start_listener_error;
+		}
+		a.listen_fd = fd;
+	}
 
-	int l = 0;
+	/*
+	 * creqhttp owns listen_fd from init and closes it in creqhttp_free.
+	 */
+	wl->cq = creqhttp_init (&a);
+	if (!wl->cq) goto webhook_start_listener_error;
+	fd = -1;
 
-	struct mimes mimes[12];
-	int index = 0;
+	if (creqhttp_init_connection (wl->cq) == -1) goto webhook_start_listener_error;
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "duration", (void **) &dt->duration, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "width", (void **) &dt->width, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "height", (void **) &dt->height, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_FILE, "animation", (void **) &dt->animation, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "thumb", (void **) &dt->thumb, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "parse_mode", (void **) &dt->parse_mode, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "caption", (void **) &dt->caption, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
+	pthread_mutex_init (&wl->mutex, NULL);
+	pthread_cond_init (&wl->cond, NULL);
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+	pthread_t t1;
+	if (pthread_create (&t1, NULL, webhook_accept_connections, (void *) wl)) goto webhook_start_listener_error;
+	pthread_detach (t1);
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+	/*
+	 * socket is bound by init_connection, wait only until the thread
+	 * goes to accept.
+	 */
+	pthread_mutex_lock (&wl->mutex);
+	while (!wl->is_ready) pthread_cond_wait (&wl->cond, &wl->mutex);
+	pthread_mutex_unlock (&wl->mutex);
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+	if (index == 0) h->cq = wl->cq;
 
-	char *data = tebot_request_get ( h, "sendAnimation", mimes, index );
+	return 0;
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
-	}
+webhook_start_listener_error:
+	if (fd != -1) close (fd);
+	if (wl->cq) creqhttp_free (wl->cq);
+	if (wl->h && wl->h != h) tebot_handler_clone_free (wl->h);
+	tebot_webhook_pool_free (wl->pool);
+	tebot_free (&h->allocator, wl);
+	return -1;
 }
 
-void tebot_method_forward_message ( tebot_handler_t *h, struct tebot_forward_message_t *dt) {
+/*
+ * telegram takes method call from answer to webhook, so one reply does
+ * not need own request. files can be sent only by upload.
+ */
+static int webhook_reply_inline ( const char *method, tebot_param_t *mimes, const int size_mimes ) {
+	if ( !strncmp ( method, "get", 3 ) ) return -1;
 
-	struct mimes mimes[4];
-	int index = 0;
+	for ( int i = 0; i < size_mimes; i++ ) {
+		if ( mimes[i].type != MIMES_TYPE_PARAM && mimes[i].type != MIMES_TYPE_ARRAY ) return -1;
+	}
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "from_chat_id", (void **) &dt->from_chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "message_id", (void **) &dt->message_id, "%lld", TYPE_OF_PARAM_INT }
-	};
+	json_object *root = json_object_new_object ( );
+	json_object_object_add ( root, "method", json_object_new_string ( method ) );
+	for ( int i = 0; i < size_mimes; i++ ) {
+		if ( mimes[i].type == MIMES_TYPE_ARRAY ) {
+			if ( !mimes[i].array ) continue;
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+			json_object *array = json_object_new_array ( );
+			for ( int n = 0; mimes[i].array[n]; n++ ) {
+				json_object_array_add ( array, json_object_new_string ( mimes[i].array[n] ) );
+			}
+			json_object_object_add ( root, mimes[i].name, array );
+		} else {
+			json_object_object_add ( root, mimes[i].name, json_object_new_string ( mimes[i].value ) );
+		}
+	}
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+	size_t length = 0;
+	const char *body = json_object_to_json_string_length ( root, JSON_C_TO_STRING_PLAIN, &length );
 
-	char *data = tebot_request_get ( h, "forwardMessage", mimes, index );
+	char header[256];
+	const int size_header = snprintf ( header, sizeof ( header ), "HTTP/1.1 200 OK\r\n"
+			"Content-Type: application/json\r\n"
+			"Content-Length: %zu\r\n\r\n", length );
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
+	/*
+	 * reply which does not fit in answer buffer of creqhttp goes as
+	 * usual request.
+	 */
+	if ( size_header + length > WEBHOOK_ANSWER_SIZE ) {
+		json_object_put ( root );
+		return -1;
 	}
-}
 
-void tebot_method_send_location ( tebot_handler_t *h, struct tebot_send_location_t *dt) {
+	creqhttp_epoll_event *v = reply_event;
+	memcpy ( v->data.ans_data, header, size_header );
+	memcpy ( &v->data.ans_data[size_header], body, length );
+	v->data.ans_len = size_header + length;
+	v->data.is_answer = 1;
 
-	struct mimes mimes[11];
-	int index = 0;
+	reply_event = NULL;
+	reply_handler = NULL;
+	json_object_put ( root );
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "latitude", (void **) &dt->latitude, "%f", TYPE_OF_PARAM_FLOAT },
-		{ MIMES_TYPE_PARAM, "longitude", (void **) &dt->longitude, "%f", TYPE_OF_PARAM_FLOAT },
-		{ MIMES_TYPE_PARAM, "horizontal_accuracy", (void **) &dt->horizontal_accuracy, "%f", TYPE_OF_PARAM_FLOAT },
-		{ MIMES_TYPE_PARAM, "live_period", (void **) &dt->live_period, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "heading", (void **) &dt->heading, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "proximity_alert_radius", (void **) &dt->proximity_alert_radius, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
+	return 0;
+}
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+void tebot_webhook_reply_begin (tebot_handler_t *h, creqhttp_epoll_event *v) {
+	reply_event = v;
+	reply_handler = h;
+}
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+int tebot_webhook_reply_end (tebot_handler_t *h, creqhttp_epoll_event *v) {
+	if (reply_event != v || reply_handler != h) return 1;
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+	reply_event = NULL;
+	reply_handler = NULL;
 
-	char *data = tebot_request_get ( h, "sendLocation", mimes, index );
+	char *ans = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+	memcpy (v->data.ans_data, ans, strlen (ans) + 1);
+	v->data.ans_len = strlen (ans);
+	v->data.is_answer = 1;
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
-	}
+	return 0;
 }
 
-void tebot_method_send_venue ( tebot_handler_t *h, struct tebot_send_venue_t *dt) {
-
-	struct mimes mimes[12];
-	int index = 0;
+/*
+ * creqhttp gives no user data to callback, so every webhook gets its own
+ * trampoline which knows the slot with handler.
+ */
+struct webhook_slot {
+	tebot_handler_t *h;
+	void (*msg_handle) (creqhttp_epoll_event *);
+	void (*update_handle) (tebot_handler_t *h, tebot_result_updated_t *t, creqhttp_epoll_event *v);
+	char *metrics_route;
+	char *secret_token;
+};
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "latitude", (void **) &dt->latitude, "%f", TYPE_OF_PARAM_FLOAT },
-		{ MIMES_TYPE_PARAM, "longitude", (void **) &dt->longitude, "%f", TYPE_OF_PARAM_FLOAT },
-		{ MIMES_TYPE_PARAM, "title", (void **) &dt->title, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "address", (void **) &dt->address, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "foursquare_id", (void **) &dt->foursquare_id, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "google_place_id", (void **) &dt->google_place_id, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "google_place_type", (void **) &dt->google_place_type, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
+static struct webhook_slot webhook_slots[TEBOT_MAX_WEBHOOKS];
+static int webhook_slots_size;
+static pthread_mutex_t webhook_slots_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+static __thread char metrics_buf[TEBOT_WEBHOOK_ANSWER_SIZE];
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+static int is_get_route ( const char *data, const int len, const char *route ) {
+	const size_t size_route = strlen ( route );
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+	if ( !data || len < 4 + size_route + 1 ) return 0;
+	if ( strncmp ( data, "GET ", 4 ) ) return 0;
+	if ( strncmp ( &data[4], route, size_route ) ) return 0;
 
-	char *data = tebot_request_get ( h, "sendVenue", mimes, index );
+	const char c = data[4 + size_route];
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
-	}
+	return c == ' ' || c == '?';
 }
 
-void tebot_method_send_contact ( tebot_handler_t *h, struct tebot_send_contact_t *dt) {
-
-	struct mimes mimes[9];
-	int index = 0;
-
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "phone_number", (void **) &dt->phone_number, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "first_name", (void **) &dt->first_name, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "last_name", (void **) &dt->last_name, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "vcard", (void **) &dt->vcard, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
+static void answer_metrics ( tebot_handler_t *h, creqhttp_epoll_event *v ) {
+	char header[256];
+	const size_t size_header = sizeof ( header ) - 16;
+	const size_t size_body = tebot_metrics_prometheus ( h, metrics_buf, WEBHOOK_ANSWER_SIZE - size_header );
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+	int length = snprintf ( header, sizeof ( header ), "HTTP/1.1 200 OK\r\n"
+			"Content-Type: text/plain; version=0.0.4\r\n"
+			"Content-Length: %zu\r\n"
+			"Connection: close\r\n\r\n", size_body );
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+	memcpy ( v->data.ans_data, header, length );
+	memcpy ( &v->data.ans_data[length], metrics_buf, size_body );
+	v->data.ans_len = length + size_body;
+	v->data.is_answer = 1;
+	v->is_disconnect = 1;
+}
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+#define SECRET_TOKEN_HEADER                "X-Telegram-Bot-Api-Secret-Token:"
 
-	char *data = tebot_request_get ( h, "sendContact", mimes, index );
+static int is_request_line ( const char *data, const int len ) {
+	int i = 0;
+	while ( i < len && data[i] >= 'A' && data[i] <= 'Z' ) i++;
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
-	}
+	return i > 0 && i + 1 < len && data[i] == ' ' && data[i + 1] == '/';
 }
 
-void tebot_method_send_poll ( tebot_handler_t *h, struct tebot_send_poll_t *dt) {
+/*
+ * gets whole head of request put together by pool of listener, anything
+ * else is rejected. token is compared in constant time.
+ */
+static int is_secret_token_valid ( const char *data, const int len, const char *token ) {
+	if ( !data || !is_request_line ( data, len ) ) return 0;
 
-	struct mimes mimes[15];
-	int index = 0;
+	const size_t size_header = sizeof ( SECRET_TOKEN_HEADER ) - 1;
+	const size_t size_token = strlen ( token );
+	const char *end = data + len;
+	const char *p = memchr ( data, '\n', len );
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "question", (void **) &dt->question, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "options", (void **) &dt->options, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "is_anonymous", (void **) &dt->is_anonymous, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "type", (void **) &dt->type, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "allows_multiple_answers", (void **) &dt->allows_multiple_answers, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "explanation", (void **) &dt->explanation, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "explanation_parse_mode", (void **) &dt->explanation_parse_mode, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "open_period", (void **) &dt->open_period, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "close_date", (void **) &dt->close_date, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "is_closed", (void **) &dt->is_closed, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
+	while ( p && ++p < end && *p != '\r' && *p != '\n' ) {
+		const char *eol = memchr ( p, '\n', end - p );
+		if ( !eol ) break;
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+		if ( eol - p > size_header && !strncasecmp ( p, SECRET_TOKEN_HEADER, size_header ) ) {
+			const char *value = p + size_header;
+			const char *value_end = eol;
+			while ( value < value_end && ( *value == ' ' || *value == '\t' ) ) value++;
+			while ( value_end > value && ( value_end[-1] == '\r' || value_end[-1] == ' ' ) ) value_end--;
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+			if ( value_end - value != size_token ) return 0;
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+			unsigned char diff = 0;
+			for ( size_t i = 0; i < size_token; i++ ) diff |= value[i] ^ token[i];
 
-	char *data = tebot_request_get ( h, "sendPoll", mimes, index );
+			return diff == 0;
+		}
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
+		p = eol;
 	}
-}
-
-void tebot_method_send_dice ( tebot_handler_t *h, struct tebot_send_dice_t *dt) {
-
-	struct mimes mimes[6];
-	int index = 0;
-
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "emoji", (void **) &dt->emoji, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
-
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+	return 0;
+}
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+static void answer_close ( creqhttp_epoll_event *v, const char *status ) {
+	v->data.ans_len = snprintf ( v->data.ans_data, WEBHOOK_ANSWER_SIZE, "HTTP/1.1 %s\r\n"
+			"Content-Length: 0\r\n"
+			"Connection: close\r\n\r\n", status );
+	v->data.is_answer = 1;
+	v->is_disconnect = 1;
+}
+
+static void answer_forbidden ( creqhttp_epoll_event *v ) {
+	answer_close ( v, "403 Forbidden" );
+}
+
+static void webhook_answer_request ( struct webhook_slot *ws, tebot_handler_t *h, creqhttp_epoll_event *v,
+		const struct tebot_http_request *req ) {
+	if ( ws->metrics_route && is_get_route ( req->head, req->size_head, ws->metrics_route ) ) {
+		answer_metrics ( h, v );
+	} else if ( ws->secret_token && !is_secret_token_valid ( req->head, req->size_head, ws->secret_token ) ) {
+		if ( h->metrics ) tebot_metrics_record_rejected ( h->metrics );
+		answer_forbidden ( v );
+	} else if ( !ws->update_handle ) {
+		/*
+		 * msg_handle gets the whole request checked by secret token in
+		 * one event.
+		 */
+		char *data = v->data.data;
+		const int len = v->data.len;
+		v->data.data = ( char * ) req->head;
+		v->data.len = req->size_head + req->size_body;
+		ws->msg_handle ( v );
+		v->data.data = data;
+		v->data.len = len;
+
+		if ( req->is_close ) v->is_disconnect = 1;
+		if ( h->metrics ) tebot_metrics_record_webhook ( h->metrics, v->is_disconnect );
+	} else {
+		tebot_result_updated_t *t = tebot_get_data_from_webhook_len ( h, req->body, req->size_body );
+
+		if ( t ) {
+			tebot_webhook_reply_begin ( h, v );
+			if ( t->size > 0 ) ws->update_handle ( h, t, v );
+			tebot_webhook_reply_end ( h, v );
+			tebot_free_update ( h );
+		} else {
+			answer_close ( v, "400 Bad Request" );
+		}
 
-	char *data = tebot_request_get ( h, "sendDice", mimes, index );
+		if ( req->is_close ) v->is_disconnect = 1;
+		if ( h->metrics ) tebot_metrics_record_webhook ( h->metrics, v->is_disconnect );
+	}
+}
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
+static const char *pool_error_status ( const int ret ) {
+	switch ( ret ) {
+		case TEBOT_POOL_BAD_REQUEST: return "400 Bad Request";
+		case TEBOT_POOL_FULL: return "503 Service Unavailable";
+		default: return "413 Payload Too Large";
 	}
 }
 
-void tebot_method_send_chat_action ( tebot_handler_t *h, struct tebot_send_chat_action_t *dt) {
+static __thread char pipeline_buf[WEBHOOK_ANSWER_SIZE];
 
-	struct mimes mimes[2];
-	int index = 0;
+/*
+ * answer of one request is put after answers of previous ones from the
+ * same read. answer which does not fit closes connection, telegram sends
+ * the update again.
+ */
+static int pipeline_add ( creqhttp_epoll_event *v, size_t *size_answer ) {
+	if ( !v->data.is_answer ) return 0;
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "action", (void **) &dt->action, "%s", TYPE_OF_PARAM_PTR_STRING }
-	};
+	if ( *size_answer + v->data.ans_len > WEBHOOK_ANSWER_SIZE ) {
+		v->is_disconnect = 1;
+		return -1;
+	}
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+	memcpy ( &pipeline_buf[*size_answer], v->data.ans_data, v->data.ans_len );
+	*size_answer += v->data.ans_len;
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+	return 0;
+}
 
-	char *data = tebot_request_get ( h, "sendChatAction", mimes, index );
+/*
+ * connection stays open after answer unless client asked to close it, so
+ * next updates come without accept and tls handshake. slab of connection
+ * is held only while body is not read whole. one read can hold several
+ * pipelined requests or start of next one after body, every whole request
+ * is answered in order.
+ */
+static void webhook_handle_request ( struct webhook_slot *ws, creqhttp_epoll_event *v ) {
+	tebot_handler_t *h = listener_handler ? listener_handler : ws->h;
+	tebot_webhook_pool_t *pool = listener_pool;
+	struct tebot_http_request req;
+	const char *data = v->data.data;
+	size_t length = v->data.len;
+	size_t size_answer = 0;
+	int ret;
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
-	}
-}
+	v->is_disconnect = 0;
 
-void tebot_method_copy_message ( tebot_handler_t *h, struct tebot_copy_message_t *dt) {
+	while ( ( ret = tebot_webhook_pool_feed ( pool, v, data, length, &req ) ) == 1 ) {
+		length = 0;
+		v->data.is_answer = 0;
 
-	struct mimes mimes[9];
-	int index = 0;
+		webhook_answer_request ( ws, h, v, &req );
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "chat_id", (void **) &dt->chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "from_chat_id", (void **) &dt->from_chat_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "message_id", (void **) &dt->message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "reply_to_message_id", (void **) &dt->reply_to_message_id, "%lld", TYPE_OF_PARAM_INT },
-		{ MIMES_TYPE_PARAM, "caption", (void **) &dt->caption, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "parse_mode", (void **) &dt->parse_mode, "%s", TYPE_OF_PARAM_PTR_STRING },
-		{ MIMES_TYPE_PARAM, "disable_notification", (void **) &dt->disable_notification, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "allow_sending_without_reply", (void **) &dt->allow_sending_without_reply, "true", TYPE_OF_PARAM_BOOLEAN },
-		{ MIMES_TYPE_PARAM, "protect_content", (void **) &dt->protect_content, "true", TYPE_OF_PARAM_BOOLEAN }
-	};
+		if ( pipeline_add ( v, &size_answer ) == -1 || v->is_disconnect ) break;
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+		tebot_webhook_pool_done ( pool, v );
+	}
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+	if ( ret < 0 ) {
+		answer_close ( v, pool_error_status ( ret ) );
+		pipeline_add ( v, &size_answer );
+	}
 
-	parse_reply_markup ( mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );
+	if ( v->is_disconnect ) tebot_webhook_pool_drop ( pool, v );
 
-	char *data = tebot_request_get ( h, "copyMessage", mimes, index );
+	memcpy ( v->data.ans_data, pipeline_buf, size_answer );
+	v->data.ans_len = size_answer;
+	v->data.is_answer = size_answer > 0;
+}
 
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
+/*
+ * headers can come over several reads, so with secret token request is
+ * put together by pool of listener before it is checked.
+ */
+static void webhook_handle ( struct webhook_slot *ws, creqhttp_epoll_event *v ) {
+	if ( ws->update_handle || ws->secret_token ) {
+		webhook_handle_request ( ws, v );
+		return;
 	}
-}
 
-long long int tebot_method_get_file ( tebot_handler_t *h, const char *file_id, const char *out_file_name ) {
-	struct mimes mimes[1];
-	int index = 0;
-	h->offset = 0;
-	long long int update_id_int = 0;
+	if ( ws->metrics_route && is_get_route ( v->data.data, v->data.len, ws->metrics_route ) ) {
+		answer_metrics ( ws->h, v );
+		return;
+	}
 
-	struct info_of_params iop[] = {
-		{ MIMES_TYPE_PARAM, "file_id", (void **) &file_id, "%s", TYPE_OF_PARAM_PTR_STRING }
-	};
+	ws->msg_handle ( v );
 
-	int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+	if ( ws->h->metrics ) tebot_metrics_record_webhook ( ws->h->metrics, v->is_disconnect );
+}
 
-	fill_fields ( mimes, &index, iop, size_info_of_params );
+#define WEBHOOK_TRAMPOLINE(n) \
+	static void webhook_handle_##n ( creqhttp_epoll_event *v ) { webhook_handle ( &webhook_slots[n], v ); }
 
-	char *data = tebot_request_get ( h, "getFile", mimes, index );
+WEBHOOK_TRAMPOLINE(0)
+WEBHOOK_TRAMPOLINE(1)
+WEBHOOK_TRAMPOLINE(2)
+WEBHOOK_TRAMPOLINE(3)
+WEBHOOK_TRAMPOLINE(4)
+WEBHOOK_TRAMPOLINE(5)
+WEBHOOK_TRAMPOLINE(6)
+WEBHOOK_TRAMPOLINE(7)
 
-	json_object *root = json_tokener_parse ( data );
-	if ( !root ) goto error;
-	json_object *ok = json_object_object_get ( root, "ok" );
-	const char *ok_string = json_object_get_string ( ok );
-	if ( !strncmp ( ok_string, "true", 5 ) ) {
-		h->offset = 0;
-		json_object *result = json_object_object_get ( root, "result" );
-		json_object *update_id = json_object_object_get ( result, "update_id" );
-		update_id_int = json_object_get_int64 ( update_id );
-		json_object *file_path = json_object_object_get ( result, "file_path" );
-		const char *file_path_string = json_object_get_string ( file_path );
+static void (*webhook_trampolines[TEBOT_MAX_WEBHOOKS]) (creqhttp_epoll_event *) = {
+	webhook_handle_0,
+	webhook_handle_1,
+	webhook_handle_2,
+	webhook_handle_3,
+	webhook_handle_4,
+	webhook_handle_5,
+	webhook_handle_6,
+	webhook_handle_7
+};
 
-		struct mimes mimes[2];
-		int index = 0;
+static void (*webhook_get_handle ( tebot_handler_t *h, struct tebot_setup_webhook *sw )) (creqhttp_epoll_event *) {
+	void (*cb_handle) (creqhttp_epoll_event *) = sw->msg_handle;
+
+	pthread_mutex_lock ( &webhook_slots_mutex );
+	if ( webhook_slots_size < TEBOT_MAX_WEBHOOKS ) {
+		struct webhook_slot *ws = &webhook_slots[webhook_slots_size];
+		ws->h = h;
+		ws->msg_handle = sw->msg_handle;
+		ws->update_handle = sw->update_handle;
+		ws->metrics_route = sw->metrics_route ? tebot_strdup ( &h->allocator, sw->metrics_route ) : NULL;
+		ws->secret_token = sw->secret_token ? tebot_strdup ( &h->allocator, sw->secret_token ) : NULL;
+		cb_handle = webhook_trampolines[webhook_slots_size++];
+	} else if ( sw->update_handle || sw->secret_token ) {
+		/*
+		 * without own slot updates would go unchecked by secret token,
+		 * so webhook is not started at all.
+		 */
+		log_time ( h, LOG_LEVEL_CRITICAL, "too many webhooks, update_handle and secret_token need own slot.\n" );
+		cb_handle = NULL;
+	} else {
+		log_time ( h, LOG_LEVEL_NOTICE, "too many webhooks, metrics route is not checked.\n" );
+	}
+	pthread_mutex_unlock ( &webhook_slots_mutex );
+
+	return cb_handle;
+}
+
+static int is_same_array (json_object *obj, char **array) {
+	int size = 0;
+	while (array[size]) size++;
 
-		struct info_of_params iop[] = {
-			{ MIMES_TYPE_GET_FILE, "file_path", (void **) &file_path_string, "%s", TYPE_OF_PARAM_PTR_STRING }
-		};
+	if (!obj || json_object_get_type (obj) != json_type_array) return size == 0;
+	if (json_object_array_length (obj) != size) return 0;
 
-		int size_info_of_params = sizeof ( iop ) / sizeof ( struct info_of_params );
+	for (int i = 0; i < size; i++) {
+		if (strcmp (json_object_get_string (json_object_array_get_idx (obj, i)), array[i])) return 0;
+	}
 
-		fill_fields ( mimes, &index, iop, size_info_of_params );
+	return 1;
+}
 
-		char *data = tebot_request_get ( h, "getFile", mimes, index );
+/*
+ * secret token is not given back by getWebhookInfo and drop of pending
+ * updates is an action, so with them webhook is always set.
+ */
+static int webhook_is_registered (tebot_handler_t *h, struct tebot_setup_webhook *sw) {
+	if (sw->secret_token || sw->drop_pending_updates) return 0;
 
-		const char *name_without_slash = strrchr ( out_file_name, '/' );
-		if ( !name_without_slash ) name_without_slash = out_file_name;
-		else name_without_slash++;
+	char *data = tebot_request_get (h, "getWebhookInfo", NULL, 0);
+	if (!data) return 0;
 
-		FILE *fp = fopen ( name_without_slash, "w" );
+	json_object *root = json_tokener_parse (data);
+	if (!root) return 0;
 
-		fwrite ( data, h->offset, 1, fp );
+	int ret = 0;
+	json_object *result = json_object_object_get (root, "result");
+	if (!result) goto webhook_is_registered_exit;
 
-		fclose ( fp );
+	json_object *url = json_object_object_get (result, "url");
+	if (!url || strcmp (json_object_get_string (url), sw->route)) goto webhook_is_registered_exit;
 
-		for ( int i = 0; i < index; i++ ) {
-			free ( mimes[i].name );
-			free ( mimes[i].value );
-		}
+	if (sw->max_connections > 0) {
+		json_object *max_connections = json_object_object_get (result, "max_connections");
+		if (!max_connections || json_object_get_int64 (max_connections) != sw->max_connections) goto webhook_is_registered_exit;
 	}
 
-	json_object_put ( root );
-
-error:
-	for ( int i = 0; i < index; i++ ) {
-		free ( mimes[i].name );
-		free ( mimes[i].value );
+	if (sw->ip_address) {
+		json_object *ip_address = json_object_object_get (result, "ip_address");
+		if (!ip_address || strcmp (json_object_get_string (ip_address), sw->ip_address)) goto webhook_is_registered_exit;
 	}
 
-	return update_id_int;
-}
+	char **allowed_updates = sw->allowed_updates ? sw->allowed_updates : h->allowed_updates;
+	if (allowed_updates && !is_same_array (json_object_object_get (result, "allowed_updates"), allowed_updates)) {
+		goto webhook_is_registered_exit;
+	}
 
-tebot_message_entity_t **tebot_init_message_entity ( const int size ) {
-	tebot_message_entity_t **m = calloc ( size + 1, sizeof ( tebot_message_entity_t * ) );
+	ret = 1;
 
-	for ( int i = 0; i < size; i++ ) {
-		m[i] = calloc ( 1, sizeof ( tebot_message_entity_t ) );
-	}
+webhook_is_registered_exit:
+	json_object_put (root);
 
-	return m;
+	return ret;
 }
 
-#include <creqhttp.h>
+static void webhook_register (tebot_handler_t *h, struct tebot_setup_webhook *sw) {
+	tebot_param_t mimes[6];
+	int index = 0;
+	char **allowed_updates = sw->allowed_updates ? sw->allowed_updates : h->allowed_updates;
 
-static void *webhook_accept_connections (void *_data) {
-	creqhttp *cq = (creqhttp *) _data;
+	mimes[index++] = (tebot_param_t) { MIMES_TYPE_PARAM, tebot_strdup (&h->allocator, "url"), tebot_strdup (&h->allocator, sw->route) };
 
-	creqhttp_accept_connections (cq);
-}
+	if (sw->max_connections > 0) {
+		mimes[index++] = (tebot_param_t) { MIMES_TYPE_PARAM, tebot_strdup (&h->allocator, "max_connections"), strdup_printf (&h->allocator, "%d", sw->max_connections) };
+	}
+	if (allowed_updates) {
+		mimes[index++] = (tebot_param_t) { MIMES_TYPE_ARRAY, tebot_strdup (&h->allocator, "allowed_updates"), NULL, allowed_updates };
+	}
+	if (sw->drop_pending_updates) {
+		mimes[index++] = (tebot_param_t) { MIMES_TYPE_PARAM, tebot_strdup (&h->allocator, "drop_pending_updates"), tebot_strdup (&h->allocator, "true") };
+	}
+	if (sw->ip_address) {
+		mimes[index++] = (tebot_param_t) { MIMES_TYPE_PARAM, tebot_strdup (&h->allocator, "ip_address"), tebot_strdup (&h->allocator, sw->ip_address) };
+	}
+	if (sw->secret_token) {
+		mimes[index++] = (tebot_param_t) { MIMES_TYPE_PARAM, tebot_strdup (&h->allocator, "secret_token"), tebot_strdup (&h->allocator, sw->secret_token) };
+	}
 
-static size_t prevent_output (void *buffer, size_t size, size_t nmemb, void *userp) {
-	return size * nmemb;
+	tebot_request_get (h, "setWebhook", mimes, index);
+
+	for (int i = 0; i < index; i++) {
+		tebot_free (&h->allocator, mimes[i].name);
+		tebot_free (&h->allocator, mimes[i].value);
+	}
 }
 
 void tebot_set_webhook (tebot_handler_t *h, struct tebot_setup_webhook *sw) {
+	const long long int start = usec_now ( );
+
 	creqhttp_params args = {
 		.is_ssl = sw->is_ssl,
 		.port = sw->port,
-		.cb_handle = sw->msg_handle,
+		.cb_handle = webhook_get_handle ( h, sw ),
 		.cert_file = sw->cert_file,
-		.private_key_file = sw->private_key_file
+		.private_key_file = sw->private_key_file,
+		.listen_fd = -1
 	};
 
-	creqhttp *cq = creqhttp_init (&args);
-	int ret = creqhttp_init_connection (cq);
-	if (ret == -1) {
-		fprintf (stderr, "creqhttp_init_connection error exit: %d\n", ret);
+	if (!args.cb_handle) {
+		fprintf (stderr, "webhook handle error exit: %d\n", -1);
 		exit (EXIT_FAILURE);
 	}
 
-	h->cq = cq;
-	pthread_t t1;
-	pthread_create (&t1, NULL, webhook_accept_connections, (void *) cq);
-
-	sleep (2);
-
-	char url[1024];
-	snprintf (url, 1024, "https://api.telegram.org/bot%s/setWebhook",
-			h->token);
-
-	char post_data[1024];
-	snprintf (post_data, 1024, "{\"url\":\"\"}");
-
-	CURL *curl = curl_easy_init ( );
-	curl_easy_setopt (curl, CURLOPT_URL, url);
-	curl_easy_setopt (curl, CURLOPT_POSTFIELDS, post_data);
-	curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, prevent_output);
-
-	struct curl_slist *chunk = NULL;
-
-	chunk = curl_slist_append (chunk, "Content-Type: application/json");
-	curl_easy_setopt (curl, CURLOPT_HTTPHEADER, chunk);
-
-	CURLcode res = curl_easy_perform (curl);
-	if (res != CURLE_OK) {
-		fprintf (stderr, "curl_easy_perform() failed: %s\n", 
-				curl_easy_strerror (res));
+	if (webhook_start_listener (h, &args, 0, sw) == -1) {
+		fprintf (stderr, "creqhttp_init_connection error exit: %d\n", -1);
+		exit (EXIT_FAILURE);
 	}
-	curl_easy_cleanup (curl);
-
-	snprintf (post_data, 1024, "{\"url\":\"%s\"}", sw->route);
-
-	curl = curl_easy_init ( );
-	curl_easy_setopt (curl, CURLOPT_URL, url);
-	curl_easy_setopt (curl, CURLOPT_POSTFIELDS, post_data);
-	curl_easy_setopt (curl, CURLOPT_WRITEFUNCTION, prevent_output);
 
-	chunk = NULL;
-
-	chunk = curl_slist_append (chunk, "Content-Type: application/json");
-	curl_easy_setopt (curl, CURLOPT_HTTPHEADER, chunk);
+	/*
+	 * other listeners bind to the same port with SO_REUSEPORT and kernel
+	 * spreads connections between them. fewer listeners than asked is a
+	 * setup error, not a slower server.
+	 */
+	for (int i = 1; i < sw->listeners; i++) {
+		if (webhook_start_listener (h, &args, i, sw) == -1) {
+			log_time (h, LOG_LEVEL_CRITICAL, "failed to start webhook listener %d of %d\n", i, sw->listeners);
+			fprintf (stderr, "webhook listener %d of %d error exit: %d\n", i, sw->listeners, -1);
+			exit (EXIT_FAILURE);
+		}
+	}
+
+	const long long int ready = usec_now ( );
+	long long int registered = ready;
+
+	if (sw->route) {
+		/*
+		 * listener 0 already parses and answers with h, so requests go
+		 * through own handler and are not written into its webhook answer.
+		 */
+		tebot_handler_t *c = tebot_handler_clone (h);
+		if (c) {
+			c->allowed_updates = h->allowed_updates;
+			if (!webhook_is_registered (c, sw)) webhook_register (c, sw);
+			c->allowed_updates = NULL;
+			tebot_handler_clone_free (c);
+		} else {
+			log_time (h, LOG_LEVEL_CRITICAL, "failed to clone handler, webhook is not registered.\n");
+		}
 
-	res = curl_easy_perform (curl);
-	if (res != CURLE_OK) {
-		fprintf (stderr, "curl_easy_perform() failed: %s\n", 
-				curl_easy_strerror (res));
+		registered = usec_now ( );
 	}
 
-	curl_easy_cleanup (curl);
+	if (h->metrics) tebot_metrics_record_startup (h->metrics, ready - start, registered - ready);
+
+	log_time (h, LOG_LEVEL_NOTICE, "webhook is ready in %lld us, registered in %lld us\n",
+			ready - start, registered - ready);
 }
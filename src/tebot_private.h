@@ -0,0 +1,104 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#ifndef __TEBOT_PRIVATE__
+#define __TEBOT_PRIVATE__
+
+#include "tebot.h"
+
+/*
+ * modules inside library, application reaches them only through handler.
+ */
+
+tebot_arena_t *tebot_arena_init ( const size_t chunk_size, const tebot_allocator_t *allocator );
+void *tebot_arena_alloc ( tebot_arena_t *a, const size_t size );
+char *tebot_arena_strndup ( tebot_arena_t *a, const char *str, const size_t length );
+long long int tebot_arena_allocs ( tebot_arena_t *a );
+long long int tebot_arena_chunks ( tebot_arena_t *a );
+void tebot_arena_reset ( tebot_arena_t *a );
+void tebot_arena_free ( tebot_arena_t *a );
+
+tebot_metrics_t *tebot_metrics_init ( void );
+int tebot_metrics_method_index ( const char *method );
+void tebot_metrics_record ( tebot_metrics_t *m, const int method, const long status, const CURLcode error, CURL *curl );
+void tebot_metrics_record_parse ( tebot_metrics_t *m, tebot_result_updated_t *t, const long long int usec, const int allocations );
+void tebot_metrics_record_webhook ( tebot_metrics_t *m, const int is_disconnect );
+void tebot_metrics_record_rejected ( tebot_metrics_t *m );
+void tebot_metrics_record_lag ( tebot_metrics_t *m, tebot_update_t *u );
+void tebot_metrics_record_startup ( tebot_metrics_t *m, const long long int listen_usec, const long long int register_usec );
+void tebot_metrics_snapshot ( tebot_metrics_t *m, tebot_metrics_snapshot_t *s );
+void tebot_metrics_free ( tebot_metrics_t *m );
+int tebot_histogram_bucket ( const unsigned long long int value );
+
+tebot_logger_t *tebot_logger_init ( const char *log_file, const int show_debug );
+void tebot_logger_vwrite ( tebot_logger_t *l, const tebot_log_level_enum log_level, const char *fmt, va_list ap );
+void tebot_logger_write ( tebot_logger_t *l, const tebot_log_level_enum log_level, const char *fmt, ... );
+void tebot_logger_set_level ( tebot_logger_t *l, const tebot_log_level_enum max_level );
+void tebot_logger_set_rate_limit ( tebot_logger_t *l, const int per_second );
+long long int tebot_logger_dropped ( tebot_logger_t *l );
+long long int tebot_logger_depth ( tebot_logger_t *l );
+void tebot_logger_free ( tebot_logger_t *l );
+
+tebot_offset_store_t *tebot_offset_store_init ( const char *path, const int commit_every );
+int tebot_offset_store_dispatch ( tebot_offset_store_t *os, const long long int update_id );
+int tebot_offset_store_ack ( tebot_offset_store_t *os, const long long int update_id );
+int tebot_offset_store_flush ( tebot_offset_store_t *os );
+long long int tebot_offset_store_committed ( tebot_offset_store_t *os );
+long long int tebot_offset_store_pending ( tebot_offset_store_t *os );
+void tebot_offset_store_free ( tebot_offset_store_t *os );
+
+typedef struct tebot_webhook_pool tebot_webhook_pool_t;
+
+/*
+ * feed returns 1 when request is whole, 0 when more bytes are needed and
+ * one of errors below. feed with length 0 gives next request left in
+ * connection after done.
+ */
+#define TEBOT_POOL_TOO_BIG                 -1
+#define TEBOT_POOL_BAD_REQUEST             -2
+#define TEBOT_POOL_FULL                    -3
+
+struct tebot_http_request {
+	const char *head;
+	size_t size_head;
+	const char *body;
+	size_t size_body;
+	int is_close;
+};
+
+tebot_webhook_pool_t *tebot_webhook_pool_init ( const int slots, const size_t slab_size, const size_t max_body,
+		const tebot_allocator_t *allocator );
+int tebot_webhook_pool_feed ( tebot_webhook_pool_t *p, const void *key, const char *data, const size_t length, struct tebot_http_request *req );
+void tebot_webhook_pool_done ( tebot_webhook_pool_t *p, const void *key );
+void tebot_webhook_pool_drop ( tebot_webhook_pool_t *p, const void *key );
+int tebot_webhook_pool_used ( tebot_webhook_pool_t *p );
+void tebot_webhook_pool_free ( tebot_webhook_pool_t *p );
+
+tebot_dedup_t *tebot_dedup_init ( const int window );
+int tebot_dedup_check ( tebot_dedup_t *d, const long long int update_id );
+int tebot_dedup_seen ( tebot_dedup_t *d, const long long int update_id );
+void tebot_dedup_free ( tebot_dedup_t *d );
+
+tebot_journal_t *tebot_journal_init ( struct tebot_setup_journal *sj );
+int tebot_journal_append ( tebot_journal_t *j, const char *data, const size_t length );
+long long int tebot_journal_dropped ( tebot_journal_t *j );
+long long int tebot_journal_queue_size ( tebot_journal_t *j );
+void tebot_journal_free ( tebot_journal_t *j );
+
+#endif
@@ -0,0 +1,318 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "tebot_private.h"
+
+#define POOL_DEFAULT_SLOTS                64
+#define POOL_DEFAULT_SLAB_SIZE            ( 16 * 1024 )
+#define POOL_DEFAULT_MAX_BODY             ( 1024 * 1024 )
+#define POOL_IDLE_TIMEOUT                 60
+
+/*
+ * state of connection is kept only while request is not whole. size_done
+ * is set when request in buf was given to caller and not released yet.
+ */
+struct pool_conn {
+	const void *key;
+	char *buf;
+	size_t capacity;
+	size_t length;
+	size_t size_done;
+	int is_overflow;
+	long long int last_used;
+};
+
+struct tebot_webhook_pool {
+	struct pool_conn *conns;
+	int size;
+	char **free_slabs;
+	int size_free;
+	char *slabs;
+	size_t slab_size;
+	size_t max_body;
+	tebot_allocator_t allocator;
+};
+
+tebot_webhook_pool_t *tebot_webhook_pool_init ( const int slots, const size_t slab_size, const size_t max_body,
+		const tebot_allocator_t *allocator ) {
+	if ( !allocator ) allocator = tebot_default_allocator ( );
+
+	tebot_webhook_pool_t *p = tebot_calloc ( allocator, 1, sizeof ( tebot_webhook_pool_t ) );
+	if ( !p ) return NULL;
+
+	p->allocator = *allocator;
+	p->size = slots > 0 ? slots : POOL_DEFAULT_SLOTS;
+	p->slab_size = slab_size > 0 ? slab_size : POOL_DEFAULT_SLAB_SIZE;
+	p->max_body = max_body > 0 ? max_body : POOL_DEFAULT_MAX_BODY;
+
+	p->conns = tebot_calloc ( &p->allocator, p->size, sizeof ( struct pool_conn ) );
+	p->free_slabs = tebot_calloc ( &p->allocator, p->size, sizeof ( char * ) );
+	p->slabs = tebot_malloc ( &p->allocator, p->size * p->slab_size );
+	if ( !p->conns || !p->free_slabs || !p->slabs ) {
+		tebot_webhook_pool_free ( p );
+		return NULL;
+	}
+
+	for ( int i = 0; i < p->size; i++ ) {
+		p->free_slabs[p->size_free++] = &p->slabs[i * p->slab_size];
+	}
+
+	return p;
+}
+
+void tebot_webhook_pool_free ( tebot_webhook_pool_t *p ) {
+	if ( !p ) return;
+
+	if ( p->conns ) {
+		for ( int i = 0; i < p->size; i++ ) {
+			if ( p->conns[i].is_overflow ) tebot_free_sized ( &p->allocator, p->conns[i].buf, p->conns[i].capacity );
+		}
+	}
+
+	tebot_free ( &p->allocator, p->conns );
+	tebot_free ( &p->allocator, p->free_slabs );
+	tebot_free ( &p->allocator, p->slabs );
+
+	tebot_allocator_t allocator = p->allocator;
+	tebot_free ( &allocator, p );
+}
+
+static struct pool_conn *conn_find ( tebot_webhook_pool_t *p, const void *key ) {
+	for ( int i = 0; i < p->size; i++ ) {
+		if ( p->conns[i].key == key ) return &p->conns[i];
+	}
+
+	return NULL;
+}
+
+static void conn_release ( tebot_webhook_pool_t *p, struct pool_conn *c ) {
+	if ( c->is_overflow ) tebot_free_sized ( &p->allocator, c->buf, c->capacity );
+	else if ( c->buf ) p->free_slabs[p->size_free++] = c->buf;
+
+	memset ( c, 0, sizeof ( struct pool_conn ) );
+}
+
+static long long int sec_now ( void ) {
+	struct timespec ts;
+	clock_gettime ( CLOCK_MONOTONIC, &ts );
+	return ts.tv_sec;
+}
+
+/*
+ * when all slots are taken, only the oldest one idle for POOL_IDLE_TIMEOUT
+ * is given away: it is a request of connection which was closed in the
+ * middle of body. body still being read is never dropped for a new one.
+ */
+static struct pool_conn *conn_new ( tebot_webhook_pool_t *p, const void *key ) {
+	struct pool_conn *c = NULL;
+
+	for ( int i = 0; i < p->size; i++ ) {
+		if ( !p->conns[i].key ) {
+			c = &p->conns[i];
+			break;
+		}
+		if ( !c || p->conns[i].last_used < c->last_used ) c = &p->conns[i];
+	}
+
+	if ( c->key ) {
+		if ( sec_now ( ) - c->last_used < POOL_IDLE_TIMEOUT ) return NULL;
+		conn_release ( p, c );
+	}
+
+	c->key = key;
+	c->buf = p->free_slabs[--p->size_free];
+	c->capacity = p->slab_size;
+
+	return c;
+}
+
+/*
+ * head of request is not bigger than slab, so whole request is bounded by
+ * max_body and slab.
+ */
+static int conn_reserve ( tebot_webhook_pool_t *p, struct pool_conn *c, const size_t size ) {
+	if ( size <= c->capacity ) return 0;
+	if ( size > p->max_body + p->slab_size ) return -1;
+
+	char *buf = tebot_malloc ( &p->allocator, size );
+	if ( !buf ) return -1;
+
+	memcpy ( buf, c->buf, c->length );
+	if ( c->is_overflow ) tebot_free_sized ( &p->allocator, c->buf, c->capacity );
+	else p->free_slabs[p->size_free++] = c->buf;
+
+	c->buf = buf;
+	c->capacity = size;
+	c->is_overflow = 1;
+
+	return 0;
+}
+
+static int is_request_line ( const char *data, const size_t length ) {
+	size_t i = 0;
+	while ( i < length && data[i] >= 'A' && data[i] <= 'Z' ) i++;
+
+	return i > 0 && i + 1 < length && data[i] == ' ' && data[i + 1] == '/';
+}
+
+static const char *find_header ( const char *head, const size_t size_head, const char *name, size_t *size_value ) {
+	const size_t size_name = strlen ( name );
+	const char *end = head + size_head;
+	const char *p = memchr ( head, '\n', size_head );
+
+	while ( p && ++p < end ) {
+		const char *eol = memchr ( p, '\n', end - p );
+		if ( !eol ) break;
+
+		if ( eol - p > size_name && !strncasecmp ( p, name, size_name ) ) {
+			const char *value = p + size_name;
+			const char *value_end = eol;
+			while ( value < value_end && ( *value == ' ' || *value == '\t' ) ) value++;
+			while ( value_end > value && ( value_end[-1] == '\r' || value_end[-1] == ' ' ) ) value_end--;
+
+			*size_value = value_end - value;
+			return value;
+		}
+
+		p = eol;
+	}
+
+	return NULL;
+}
+
+/*
+ * returns size of whole request, 0 if it is not whole yet or one of
+ * TEBOT_POOL_* errors.
+ */
+static long long int parse_request ( tebot_webhook_pool_t *p, const char *data, const size_t length, struct tebot_http_request *req ) {
+	if ( !is_request_line ( data, length ) ) return length > 0 ? TEBOT_POOL_BAD_REQUEST : 0;
+
+	const char *end_head = memmem ( data, length, "\r\n\r\n", 4 );
+	if ( !end_head ) return length >= p->slab_size ? TEBOT_POOL_TOO_BIG : 0;
+
+	const size_t size_head = end_head - data + 4;
+	size_t size_value = 0;
+	size_t size_body = 0;
+
+	const char *value = find_header ( data, size_head, "Content-Length:", &size_value );
+	for ( size_t i = 0; value && i < size_value; i++ ) {
+		if ( value[i] < '0' || value[i] > '9' ) return TEBOT_POOL_BAD_REQUEST;
+		size_body = size_body * 10 + ( value[i] - '0' );
+		if ( size_body > p->max_body ) return TEBOT_POOL_TOO_BIG;
+	}
+
+	if ( find_header ( data, size_head, "Transfer-Encoding:", &size_value ) ) return TEBOT_POOL_BAD_REQUEST;
+
+	if ( length < size_head + size_body ) return 0;
+
+	value = find_header ( data, size_head, "Connection:", &size_value );
+
+	req->head = data;
+	req->size_head = size_head;
+	req->body = data + size_head;
+	req->size_body = size_body;
+	req->is_close = value && size_value == 5 && !strncasecmp ( value, "close", 5 );
+
+	return size_head + size_body;
+}
+
+/*
+ * whole request in one read is given straight from data. only the part of
+ * request goes to slab of connection and waits for the rest.
+ */
+int tebot_webhook_pool_feed ( tebot_webhook_pool_t *p, const void *key, const char *data, const size_t length, struct tebot_http_request *req ) {
+	struct pool_conn *c = conn_find ( p, key );
+	const long long int now = sec_now ( );
+
+	/*
+	 * new request line on the key with a part of body means the old
+	 * connection was closed and its event is reused.
+	 */
+	if ( c && c->length > 0 && is_request_line ( data, length ) && is_request_line ( c->buf, c->length ) &&
+			memmem ( c->buf, c->length, "\r\n\r\n", 4 ) ) {
+		conn_release ( p, c );
+		c = NULL;
+	}
+
+	if ( !c || c->length == 0 ) {
+		long long int size = parse_request ( p, data, length, req );
+		if ( size < 0 ) return size;
+
+		if ( size > 0 ) {
+			if ( size < length ) {
+				if ( !c ) c = conn_new ( p, key );
+				if ( !c ) return TEBOT_POOL_FULL;
+				if ( conn_reserve ( p, c, length - size ) == -1 ) return TEBOT_POOL_TOO_BIG;
+				memcpy ( c->buf, &data[size], length - size );
+				c->length = length - size;
+				c->last_used = now;
+			}
+
+			return 1;
+		}
+
+		if ( length == 0 ) return 0;
+		if ( !c ) c = conn_new ( p, key );
+		if ( !c ) return TEBOT_POOL_FULL;
+	}
+
+	if ( conn_reserve ( p, c, c->length + length ) == -1 ) return TEBOT_POOL_TOO_BIG;
+
+	memcpy ( &c->buf[c->length], data, length );
+	c->length += length;
+	c->last_used = now;
+
+	long long int size = parse_request ( p, c->buf, c->length, req );
+	if ( size <= 0 ) return size;
+
+	c->size_done = size;
+
+	return 1;
+}
+
+/*
+ * called when the request from feed was handled. bytes after it stay for
+ * next read, empty connection gives slab back to pool.
+ */
+void tebot_webhook_pool_done ( tebot_webhook_pool_t *p, const void *key ) {
+	struct pool_conn *c = conn_find ( p, key );
+	if ( !c ) return;
+
+	if ( c->size_done ) {
+		c->length -= c->size_done;
+		memmove ( c->buf, &c->buf[c->size_done], c->length );
+		c->size_done = 0;
+	}
+
+	if ( c->length == 0 ) conn_release ( p, c );
+}
+
+void tebot_webhook_pool_drop ( tebot_webhook_pool_t *p, const void *key ) {
+	struct pool_conn *c = conn_find ( p, key );
+	if ( c ) conn_release ( p, c );
+}
+
+int tebot_webhook_pool_used ( tebot_webhook_pool_t *p ) {
+	return p->size - p->size_free;
+}
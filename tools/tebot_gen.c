@@ -0,0 +1,296 @@
+/*
+ * libtebot - библиотека telegram api для бота
+ *
+ * Copyright (C) 2023 Naidolinskii Dmitrii <naidv88@gmail.com>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY of FITNESS for A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <http://www.gnu.org/licenses/>.
+ * -------------------------------------------------------------------/
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+ * writes parsers of types and encoders of methods from description of bot
+ * api, see schema/bot_api.def. keys of type are dispatched by switch on
+ * length and memcmp, so parser does not look up every known key in json
+ * object.
+ */
+
+#define MAX_NAME                      64
+
+/*
+ * mask of tebot.c keeps bit for every field, FIELDS_BITS words of 64.
+ */
+#define MAX_FIELDS                    128
+#define MAX_BLOCKS                    256
+#define MAX_LINE                      512
+
+struct field {
+	char key[MAX_NAME];
+	char kind[MAX_NAME];
+};
+
+struct block {
+	int is_method;
+	int is_markup;
+	char name[MAX_NAME];
+	char api[MAX_NAME];
+	char c_type[MAX_NAME];
+	struct field fields[MAX_FIELDS];
+	int size;
+	int line;
+};
+
+static struct block blocks[MAX_BLOCKS];
+static int size_blocks;
+static const char *schema_file;
+
+static const char *scalars[] = { "int", "float", "bool", "string", NULL };
+
+static void fail ( const int line, const char *message, const char *name ) {
+	fprintf ( stderr, "%s:%d: %s: %s\n", schema_file, line, message, name );
+	exit ( EXIT_FAILURE );
+}
+
+static int is_scalar ( const char *kind ) {
+	for ( int i = 0; scalars[i]; i++ ) {
+		if ( !strcmp ( scalars[i], kind ) ) return 1;
+	}
+
+	return 0;
+}
+
+static struct block *find_type ( const char *name ) {
+	for ( int i = 0; i < size_blocks; i++ ) {
+		if ( !blocks[i].is_method && !strcmp ( blocks[i].name, name ) ) return &blocks[i];
+	}
+
+	return NULL;
+}
+
+static void read_schema ( FILE *fp ) {
+	char line[MAX_LINE];
+	struct block *b = NULL;
+	int number = 0;
+
+	while ( fgets ( line, sizeof ( line ), fp ) ) {
+		number++;
+		line[strcspn ( line, "\r\n" )] = 0;
+
+		const char *p = line + strspn ( line, " \t" );
+		if ( !*p || *p == '#' ) continue;
+
+		if ( line[0] == '\t' ) {
+			if ( !b ) fail ( number, "field out of block", p );
+			if ( b->size == MAX_FIELDS ) fail ( number, "too many fields", b->name );
+
+			struct field *f = &b->fields[b->size];
+			if ( sscanf ( p, "%63s %63s", f->key, f->kind ) != 2 ) fail ( number, "expected key and kind", p );
+			for ( int i = 0; i < b->size; i++ ) {
+				if ( !strcmp ( b->fields[i].key, f->key ) ) fail ( number, "duplicate key", f->key );
+			}
+
+			b->size++;
+			continue;
+		}
+
+		if ( size_blocks == MAX_BLOCKS ) fail ( number, "too many blocks", p );
+		b = &blocks[size_blocks];
+		b->line = number;
+
+		char markup[MAX_NAME] = "";
+		if ( sscanf ( p, "type %63s %63s", b->name, b->c_type ) == 2 ) {
+			b->is_method = 0;
+		} else if ( sscanf ( p, "method %63s %63s %63s %63s", b->name, b->api, b->c_type, markup ) >= 3 ) {
+			b->is_method = 1;
+			if ( *markup && strcmp ( markup, "markup" ) ) fail ( number, "unknown option", markup );
+			b->is_markup = *markup != 0;
+		} else {
+			fail ( number, "expected type or method", p );
+		}
+
+		for ( int i = 0; i < size_blocks; i++ ) {
+			if ( blocks[i].is_method == b->is_method && !strcmp ( blocks[i].name, b->name ) ) fail ( number, "duplicate block", b->name );
+		}
+
+		size_blocks++;
+	}
+}
+
+static void check_schema ( void ) {
+	for ( int i = 0; i < size_blocks; i++ ) {
+		struct block *b = &blocks[i];
+		for ( int n = 0; n < b->size; n++ ) {
+			const char *kind = b->fields[n].kind;
+			if ( b->is_method ) {
+				if ( !is_scalar ( kind ) && strcmp ( kind, "file" ) ) fail ( b->line, "unknown kind of param", kind );
+			} else {
+				if ( !is_scalar ( kind ) && !find_type ( kind ) ) fail ( b->line, "unknown type", kind );
+			}
+		}
+	}
+}
+
+static const char *type_of_param ( const char *kind ) {
+	if ( !strcmp ( kind, "int" ) ) return "TYPE_OF_PARAM_INT";
+	if ( !strcmp ( kind, "float" ) ) return "TYPE_OF_PARAM_FLOAT";
+	if ( !strcmp ( kind, "bool" ) ) return "TYPE_OF_PARAM_BOOLEAN";
+	if ( !strcmp ( kind, "string" ) ) return "TYPE_OF_PARAM_PTR_STRING";
+
+	return "TYPE_OF_PARAM_OBJECT";
+}
+
+static int by_length ( const void *a, const void *b ) {
+	const struct field *fa = *( const struct field ** ) a;
+	const struct field *fb = *( const struct field ** ) b;
+	const int la = strlen ( fa->key );
+	const int lb = strlen ( fb->key );
+
+	if ( la != lb ) return la - lb;
+
+	return fa < fb ? -1 : fa > fb;
+}
+
+static void write_type ( FILE *fp, struct block *b ) {
+	if ( b->size ) {
+		fprintf ( fp, "static const struct field_of_type fields_of_%s[] = {\n", b->name );
+		for ( int i = 0; i < b->size; i++ ) {
+			struct field *f = &b->fields[i];
+			struct block *t = find_type ( f->kind );
+			if ( t ) fprintf ( fp, "\t{ \"%s\", %s, offsetof ( %s, %s ), sizeof ( %s ), handler_%s },\n",
+					f->key, type_of_param ( f->kind ), b->c_type, f->key, t->c_type, t->name );
+			else fprintf ( fp, "\t{ \"%s\", %s, offsetof ( %s, %s ) },\n", f->key, type_of_param ( f->kind ), b->c_type, f->key );
+		}
+		fprintf ( fp, "};\n\n" );
+	}
+
+	fprintf ( fp, "static void handler_%s ( tebot_handler_t *h, void *data, json_object *ob ) {\n", b->name );
+	if ( !b->size ) {
+		fprintf ( fp, "}\n\n" );
+		return;
+	}
+
+	struct field *sorted[MAX_FIELDS];
+	for ( int i = 0; i < b->size; i++ ) sorted[i] = &b->fields[i];
+	qsort ( sorted, b->size, sizeof ( struct field * ), by_length );
+
+	fprintf ( fp, "\tif ( json_object_get_type ( ob ) != json_type_object ) return;\n\n" );
+	fprintf ( fp, "\tconst unsigned long long int *bits = h->mask ? fields_bits ( h->mask, fields_of_%s, %d ) : NULL;\n\n",
+			b->name, b->size );
+	fprintf ( fp, "\tjson_object_object_foreach ( ob, key, param ) {\n" );
+	fprintf ( fp, "\t\tint n = -1;\n\n" );
+	fprintf ( fp, "\t\tswitch ( strlen ( key ) ) {\n" );
+
+	int length = -1;
+	for ( int i = 0; i < b->size; i++ ) {
+		const int l = strlen ( sorted[i]->key );
+		if ( l != length ) {
+			if ( length != -1 ) fprintf ( fp, "\t\t\t\tbreak;\n" );
+			fprintf ( fp, "\t\t\tcase %d:\n\t\t\t\t", l );
+			length = l;
+		} else {
+			fprintf ( fp, "\t\t\t\telse " );
+		}
+		fprintf ( fp, "if ( !memcmp ( key, \"%s\", %d ) ) n = %ld;\n", sorted[i]->key, l,
+				( long ) ( sorted[i] - b->fields ) );
+	}
+
+	fprintf ( fp, "\t\t\t\tbreak;\n\t\t}\n\n" );
+	fprintf ( fp, "\t\tif ( n != -1 && FIELD_SELECTED ( bits, n ) ) parse_field ( h, param, data, &fields_of_%s[n] );\n", b->name );
+	fprintf ( fp, "\t}\n}\n\n" );
+}
+
+static void write_method ( FILE *fp, struct block *b ) {
+	fprintf ( fp, "void tebot_method_%s ( tebot_handler_t *h, struct %s *dt ) {\n", b->name, b->c_type );
+	fprintf ( fp, "\tconst tebot_allocator_t *a = &h->allocator;\n" );
+	fprintf ( fp, "\ttebot_param_t mimes[%d];\n", b->size + b->is_markup );
+	fprintf ( fp, "\tint index = 0;\n\n" );
+
+	for ( int i = 0; i < b->size; i++ ) {
+		const char *key = b->fields[i].key;
+		const char *kind = b->fields[i].kind;
+		fprintf ( fp, "\tif ( dt->%s ) add_param ( a, mimes, &index, %s, \"%s\", ", key,
+				strcmp ( kind, "file" ) ? "MIMES_TYPE_PARAM" : "MIMES_TYPE_FILE", key );
+		if ( !strcmp ( kind, "int" ) ) fprintf ( fp, "strdup_printf ( a, \"%%lld\", ( long long int ) dt->%s ) );\n", key );
+		else if ( !strcmp ( kind, "float" ) ) fprintf ( fp, "strdup_printf ( a, \"%%f\", dt->%s ) );\n", key );
+		else if ( !strcmp ( kind, "bool" ) ) fprintf ( fp, "tebot_strdup ( a, \"true\" ) );\n" );
+		else fprintf ( fp, "tebot_strdup ( a, dt->%s ) );\n", key );
+	}
+
+	if ( b->is_markup ) {
+		fprintf ( fp, "\n\tparse_reply_markup ( a, mimes, &index, dt->layout, dt->size_layout, dt->reply_markup, dt->type_of_reply_markup );\n" );
+	}
+
+	fprintf ( fp, "\n\ttebot_request_get ( h, \"%s\", mimes, index );\n\n", b->api );
+	fprintf ( fp, "\tfor ( int i = 0; i < index; i++ ) {\n" );
+	fprintf ( fp, "\t\ttebot_free ( a, mimes[i].name );\n" );
+	fprintf ( fp, "\t\ttebot_free ( a, mimes[i].value );\n" );
+	fprintf ( fp, "\t}\n}\n\n" );
+}
+
+static FILE *open_output ( const char *path ) {
+	FILE *fp = fopen ( path, "w" );
+	if ( !fp ) {
+		perror ( path );
+		exit ( EXIT_FAILURE );
+	}
+
+	fprintf ( fp, "/*\n * generated by tebot_gen from bot_api.def, do not edit.\n */\n\n" );
+
+	return fp;
+}
+
+static void close_output ( FILE *fp, const char *path ) {
+	if ( ferror ( fp ) || fclose ( fp ) ) {
+		fprintf ( stderr, "failed to write %s\n", path );
+		exit ( EXIT_FAILURE );
+	}
+}
+
+int main ( int argc, char **argv ) {
+	if ( argc != 4 ) {
+		fprintf ( stderr, "usage: %s bot_api.def types.inc methods.inc\n", argv[0] );
+		return EXIT_FAILURE;
+	}
+
+	schema_file = argv[1];
+	FILE *fp = fopen ( schema_file, "r" );
+	if ( !fp ) {
+		perror ( schema_file );
+		return EXIT_FAILURE;
+	}
+	read_schema ( fp );
+	fclose ( fp );
+
+	check_schema ( );
+
+	fp = open_output ( argv[2] );
+	for ( int i = 0; i < size_blocks; i++ ) {
+		if ( !blocks[i].is_method ) fprintf ( fp, "static void handler_%s ( tebot_handler_t *h, void *data, json_object *ob );\n", blocks[i].name );
+	}
+	fprintf ( fp, "\n" );
+	for ( int i = 0; i < size_blocks; i++ ) {
+		if ( !blocks[i].is_method ) write_type ( fp, &blocks[i] );
+	}
+	close_output ( fp, argv[2] );
+
+	fp = open_output ( argv[3] );
+	for ( int i = 0; i < size_blocks; i++ ) {
+		if ( blocks[i].is_method ) write_method ( fp, &blocks[i] );
+	}
+	close_output ( fp, argv[3] );
+
+	return EXIT_SUCCESS;
+}